@@ -1,56 +1,274 @@
 #pragma once
 
 #include <utility>
+#include <memory>
+#include <chrono>
+#include <optional>
+#include <stdexcept>
 #include <functional>
 #include <type_traits>
 
+#include "../private/latency_stats.hpp"
 #include "async_result.hpp"
+#include "executor.hpp"
+#include "task_group.hpp"
 #include "thread_pool.hpp"
 
 
+// The executor is either a ThreadPool, a Strand or anything else convertible to Executor.
 template <class Ret, class Fun, class ...Args>
-inline AsyncResult<Ret> call_async(ThreadPool& pool, Fun&& fun, Args &&...args);
+inline AsyncResult<Ret> call_async(Executor executor, Fun&& fun, Args &&...args);
+
+// Tasks submitted with a stopped token are skipped by the pool and their results
+// are resolved with CancelledError. The token is inherited by continuations.
+template <class Ret, class Fun, class ...Args>
+inline AsyncResult<Ret> call_async(Executor executor, StopToken token, Fun&& fun, Args &&...args);
+
+// The task is not submitted until the result is demanded: by a subscription
+// (then, flatten, catch_err, share, TaskGroup::join, ...), which schedules it in the executor,
+// or by get/wait, which run it in the calling thread. If the result is dropped, the task never runs.
+template <class Ret, class Fun, class ...Args>
+inline AsyncResult<Ret> call_deferred(Executor executor, Fun&& fun, Args &&...args);
+
+template <class Ret, class Fun, class ...Args>
+inline AsyncResult<Ret> call_deferred(Executor executor, StopToken token, Fun&& fun, Args &&...args);
 
 template <class Fun>
-inline auto make_async(ThreadPool& pool, Fun&& fun);
+inline auto make_async(Executor executor, Fun&& fun);
+
+
+// Delay before each backup attempt of AsyncFunction::hedge: either fixed, or a percentile
+// of the latencies of the attempts recently hedged by the same AsyncFunction.
+class HedgeDelay {
+public:
+    template <class Rep, class Period>
+    HedgeDelay(const std::chrono::duration<Rep, Period>& delay)
+        : quantile_(std::nullopt)
+        , delay_(std::chrono::duration_cast<std::chrono::nanoseconds>(delay))
+    {   }
+
+    // `quantile` is given in percents. The fallback is used until enough latencies are observed.
+    template <class Rep, class Period>
+    static HedgeDelay percentile(double quantile, const std::chrono::duration<Rep, Period>& fallback) {
+        HedgeDelay delay(fallback);
+        delay.quantile_ = quantile;
+        return delay;
+    }
+
+    std::chrono::nanoseconds resolve(const details::LatencyStats& stats) const {
+        if (quantile_) {
+            if (auto latency = stats.percentile(*quantile_)) {
+                return *latency;
+            }
+        }
+        return delay_;
+    }
+
+private:
+    std::optional<double> quantile_;
+    std::chrono::nanoseconds delay_;
+};
 
 
 template <class Fun>
 class AsyncFunction {
 private:
-    AsyncFunction(ThreadPool& pool, std::function<Fun> fun) : parent_pool_(&pool), callable_(std::move(fun)) { }
+    AsyncFunction(Executor executor, std::function<Fun> fun)
+        : executor_(executor)
+        , callable_(std::move(fun))
+        , stats_(std::make_shared<details::LatencyStats>())
+    {   }
 
 public:
     template <class Ret, class ...Args>
     AsyncResult<Ret> invoke(Args &&...args) {
-        return call_async<Ret>(*parent_pool_, callable_, std::forward<Args>(args)...);
+        return call_async<Ret>(executor_, callable_, std::forward<Args>(args)...);
     }
 
     template <class ...Args>
     AsyncResult<std::invoke_result_t<Fun, Args...> > operator()(Args &&...args) {
-        return call_async<std::invoke_result_t<Fun, Args...> >(*parent_pool_, callable_, std::forward<Args>(args)...);
+        return call_async<std::invoke_result_t<Fun, Args...> >(executor_, callable_, std::forward<Args>(args)...);
+    }
+
+    // Issues up to max_attempts attempts of the same call in order to cut the tail latency.
+    // Backups follow a fixed schedule: the i-th one is issued `i * delay` after the call, unless
+    // a value has arrived by then. A failed attempt does not bring the next one forward.
+    // The first value wins; the attempts that have not started yet are cancelled,
+    // and the running ones can observe cancellation via StopToken::current().
+    // Fails only if every attempt fails. Backups are run by the pool behind the executor.
+    // Only the latencies of hedged attempts are recorded, so plain calls pay nothing for it.
+    template <class ...Args>
+    AsyncResult<std::invoke_result_t<Fun, Args...> > hedge(HedgeDelay delay, int max_attempts, Args &&...args);
+
+private:
+    // Wraps the callable so that its latency is recorded
+    auto timed() const {
+        return [stats = stats_, fun = callable_](auto &&...args) -> decltype(auto) {
+            details::LatencyRecorder recorder(*stats);
+            return fun(std::forward<decltype(args)>(args)...);
+        };
     }
 
 private:
-    ThreadPool* parent_pool_;
+    Executor executor_;
     std::function<Fun> callable_;
+    // Shared by copies of the AsyncFunction
+    std::shared_ptr<details::LatencyStats> stats_;
 
 template <class F>
-friend inline auto make_async(ThreadPool& pool, F&& fun);
+friend inline auto make_async(Executor executor, F&& fun);
 };
 
 
 
 template <class Ret, class Fun, class ...Args>
-inline AsyncResult<Ret> call_async(ThreadPool& pool, Fun&& fun, Args &&...args) {
+inline AsyncResult<Ret> call_async(Executor executor, Fun&& fun, Args &&...args) {
+    return call_async<Ret>(executor, StopToken(), std::forward<Fun>(fun), std::forward<Args>(args)...);
+}
+
+template <class Ret, class Fun, class ...Args>
+inline AsyncResult<Ret> call_async(Executor executor, StopToken token, Fun&& fun, Args &&...args) {
     auto [promise, future] = contract<Ret>();
     FunctionType<Ret, void> task = std::bind(std::forward<Fun>(fun), std::forward<Args>(args)...);
-    ThreadPool::Task pool_task = std::make_unique<details::AsyncTask<Ret> >(std::move(task), std::move(promise));
-    pool.submit(std::move(pool_task));
-    return AsyncResult<Ret>{&pool, std::move(future)};
+    ThreadPool::Task pool_task = std::make_unique<details::AsyncTask<Ret> >(std::move(task), std::move(promise), token);
+    executor.submit(std::move(pool_task));
+    return details::AsyncResultAccess::make(executor, std::move(future), std::move(token));
+}
+
+template <class Ret, class Fun, class ...Args>
+inline AsyncResult<Ret> call_deferred(Executor executor, Fun&& fun, Args &&...args) {
+    return call_deferred<Ret>(executor, StopToken(), std::forward<Fun>(fun), std::forward<Args>(args)...);
+}
+
+template <class Ret, class Fun, class ...Args>
+inline AsyncResult<Ret> call_deferred(Executor executor, StopToken token, Fun&& fun, Args &&...args) {
+    auto [promise, future] = contract<Ret>();
+    FunctionType<Ret, void> task = std::bind(std::forward<Fun>(fun), std::forward<Args>(args)...);
+    ThreadPool::Task pool_task = std::make_unique<details::AsyncTask<Ret> >(std::move(task), std::move(promise), token);
+    return details::AsyncResultAccess::makeDeferred(executor, std::move(future), std::move(token), std::move(pool_task));
+}
+
+template <class Fun>
+inline auto make_async(Executor executor, Fun&& fun) {
+    return AsyncFunction{executor, std::function(fun)};
+}
+
+
+
+// ================================================ //
+// ==================== TIMERS ==================== //
+// ================================================ //
+
+template <class Fun>
+AsyncResult<std::invoke_result_t<Fun> > ThreadPool::submitAt(Clock::time_point deadline, Fun&& fun, StopToken token) {
+    using Ret = std::invoke_result_t<Fun>;
+    auto [promise, future] = contract<Ret>();
+    addTimer(deadline, details::make_async_task<Ret>(
+        FunctionType<Ret, void>(std::forward<Fun>(fun)), std::move(promise), token), false);
+    return details::AsyncResultAccess::make<Ret>(*this, std::move(future), std::move(token));
+}
+
+template <class Rep, class Period, class Fun>
+AsyncResult<std::invoke_result_t<Fun> > ThreadPool::submitAfter(const std::chrono::duration<Rep, Period>& delay,
+                                                                Fun&& fun, StopToken token) {
+    auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(delay);
+    return submitAt(deadline, std::forward<Fun>(fun), std::move(token));
+}
+
+namespace details {
+
+// Runs the callable and then reschedules itself via a new timer
+class PeriodicTask : public ITaskBase {
+public:
+    struct Schedule {
+        std::function<void()> func;
+        Promise<void> promise;
+        StopToken token;
+        ThreadPool* pool;
+        ThreadPool::Clock::duration period;
+        ThreadPool::Clock::time_point deadline;
+    };
+
+    explicit PeriodicTask(std::unique_ptr<Schedule> schedule) : schedule_(std::move(schedule)) {   }
+
+    bool cancelled() const override {
+        return schedule_->token.stopRequested();
+    }
+
+    void cancel() override {
+        schedule_->promise.setError(std::make_exception_ptr(CancelledError()));
+    }
+
+    void run() override {
+        {
+            details::CurrentStopTokenScope token_scope(schedule_->token);
+            try {
+                schedule_->func();
+            } catch (...) {
+                schedule_->promise.setError(std::current_exception());
+                return;
+            }
+        }
+        auto now = ThreadPool::Clock::now();
+        do {
+            schedule_->deadline += schedule_->period;
+        } while (schedule_->deadline <= now);
+        ThreadPool* pool = schedule_->pool;
+        auto deadline = schedule_->deadline;
+        pool->addTimer(deadline, std::make_unique<PeriodicTask>(std::move(schedule_)), false);
+    }
+
+private:
+    std::unique_ptr<Schedule> schedule_;
+};
+
+}  // namespace details
+
+template <class Rep, class Period, class Fun>
+AsyncResult<void> ThreadPool::schedulePeriodic(const std::chrono::duration<Rep, Period>& period,
+                                               Fun&& fun, StopToken token) {
+    auto step = std::chrono::duration_cast<Clock::duration>(period);
+    if (step <= Clock::duration::zero()) {
+        throw std::invalid_argument("Period must be positive");
+    }
+    auto [promise, future] = contract<void>();
+    auto deadline = Clock::now() + step;
+    auto schedule = std::make_unique<details::PeriodicTask::Schedule>(details::PeriodicTask::Schedule{
+        std::forward<Fun>(fun), std::move(promise), token, this, step, deadline});
+    addTimer(deadline, std::make_unique<details::PeriodicTask>(std::move(schedule)), false);
+    return details::AsyncResultAccess::make<void>(*this, std::move(future), std::move(token));
 }
 
+// =============================================== //
+// ==================== HEDGE ==================== //
+// =============================================== //
+
 template <class Fun>
-inline auto make_async(ThreadPool& pool, Fun&& fun) {
-    return AsyncFunction{pool, std::function(fun)};
+template <class ...Args>
+AsyncResult<std::invoke_result_t<Fun, Args...> >
+AsyncFunction<Fun>::hedge(HedgeDelay delay, int max_attempts, Args &&...args) {
+    using Ret = std::invoke_result_t<Fun, Args...>;
+    if (max_attempts < 1) {
+        throw std::invalid_argument("Hedged call requires at least one attempt");
+    }
+    ThreadPool* timer_pool = executor_.pool();
+    if (timer_pool == nullptr) {
+        throw std::runtime_error("Hedged call requires an executor backed by a thread pool");
+    }
+    FunctionType<Ret, void> attempt = std::bind(timed(), std::forward<Args>(args)...);
+    const auto step = delay.resolve(*stats_);
+    const auto start = ThreadPool::Clock::now();
+
+    TaskGroup<Ret> attempts;
+    attempts.join(call_async<Ret>(executor_, attempts.token(), attempt));
+    for (int idx = 1; idx < max_attempts; ++idx) {
+        // Backups are kept by the pool timer and skipped once the group token is stopped
+        attempts.join(timer_pool->submitAt(start + idx * step, attempt, attempts.token()));
+    }
+    return attempts.first(CancelPolicy::CancelRest).in(executor_);
+}
+
+template <class Fun, class ...Args>
+inline auto hedge(AsyncFunction<Fun>& fun, HedgeDelay delay, int max_attempts, Args &&...args) {
+    return fun.hedge(delay, max_attempts, std::forward<Args>(args)...);
 }
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <queue>
+
+#include "async_result.hpp"
+#include "contract.hpp"
+#include "executor.hpp"
+
+
+namespace details {
+
+class AsyncPermits;
+
+// Owns a single permit and returns it on destruction.
+class PermitGuard {
+
+friend class AsyncPermits;
+
+private:
+    explicit PermitGuard(AsyncPermits* permits) : permits_(permits) {   }
+
+public:
+    PermitGuard(const PermitGuard&) = delete;
+    PermitGuard& operator=(const PermitGuard&) = delete;
+    PermitGuard(PermitGuard&& other) : permits_(std::exchange(other.permits_, nullptr)) {   }
+    PermitGuard& operator=(PermitGuard&& other);
+    ~PermitGuard() { release(); }
+
+    // Returns the permit before the guard is destroyed.
+    void release();
+
+    bool ownsPermit() const { return permits_ != nullptr; }
+
+private:
+    AsyncPermits* permits_;
+};
+
+
+// A counting semaphore, whose waiters are promises rather than threads.
+// count_ holds the number of free permits minus the number of waiters, so an uncontended
+// acquire or release is a single atomic operation. The queue is only touched under contention:
+// a release, that finds count_ negative, hands its permit over to the oldest waiter directly.
+// If that waiter has not enqueued yet, the permit is left in handoffs_ for it to pick up.
+class AsyncPermits {
+public:
+    explicit AsyncPermits(int64_t permits);
+
+    AsyncPermits(const AsyncPermits&) = delete;
+    AsyncPermits& operator=(const AsyncPermits&) = delete;
+
+    AsyncResult<PermitGuard> acquire(Executor executor);
+    std::optional<PermitGuard> tryAcquire();
+    void release();
+
+private:
+    std::atomic<int64_t> count_;
+    std::mutex mtx_;
+    std::queue<Promise<PermitGuard> > waiters_;
+    int64_t handoffs_;
+};
+
+}  // namespace details
+
+
+// ===================================================== //
+// ==================== ASYNC MUTEX ==================== //
+// ===================================================== //
+
+// A mutex for pool tasks, which never blocks a thread. lock() returns a result,
+// that is resolved with a guard once the mutex is acquired: until then the waiter is
+// just a queued continuation, and the worker is free to run other tasks.
+// Continuations of a contended lock run in the given executor, not in the releasing thread.
+// The mutex must outlive its guards. Waiters are resumed in FIFO order.
+class AsyncMutex {
+public:
+    using Guard = details::PermitGuard;
+
+    AsyncMutex() : permits_(1) {   }
+
+    AsyncResult<Guard> lock(Executor executor) { return permits_.acquire(executor); }
+    std::optional<Guard> tryLock() { return permits_.tryAcquire(); }
+
+private:
+    details::AsyncPermits permits_;
+};
+
+
+// ========================================================= //
+// ==================== ASYNC SEMAPHORE ==================== //
+// ========================================================= //
+
+// Same as AsyncMutex, but lets up to a given number of holders in at once,
+// e.g. to limit the number of concurrent writers to a disk.
+class AsyncSemaphore {
+public:
+    using Guard = details::PermitGuard;
+
+    explicit AsyncSemaphore(int64_t permits);
+
+    AsyncResult<Guard> acquire(Executor executor) { return permits_.acquire(executor); }
+    std::optional<Guard> tryAcquire() { return permits_.tryAcquire(); }
+
+private:
+    details::AsyncPermits permits_;
+};
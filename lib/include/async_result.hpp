@@ -4,10 +4,15 @@
 #include <utility>
 #include <future>
 #include <memory>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
 
 #include "../private/async_task.hpp"
 #include "../private/type_traits.hpp"
 #include "contract.hpp"
+#include "executor.hpp"
+#include "stop_token.hpp"
 #include "thread_pool.hpp"
 
 
@@ -16,25 +21,60 @@ enum class ThenPolicy { Lazy, Eager, NoSchedule };
 template <class T, class Err>
 using ErrorHandler = std::function<T(const Err&)>;
 
+// Delivered by AsyncResult::withTimeout when the deadline passes first.
+class TimeoutError : public std::runtime_error {
+public:
+    TimeoutError() : std::runtime_error("Deadline has been exceeded") {   }
+};
+
+// Forward declare
+template <class T> class SharedAsyncResult;
+template <class T> class AsyncResult;
+namespace details {
+
+// The task of a deferred result, which is not scheduled until the result is demanded.
+struct DeferredLaunch {
+    std::unique_ptr<ITaskBase> task;
+    Executor executor;
+};
+
+// The way for the rest of the library to make results and to subscribe to them,
+// so that AsyncResult does not befriend every producer and consumer.
+struct AsyncResultAccess {
+    template <class T>
+    static AsyncResult<T> make(Executor executor, Future<T> fut, StopToken token = StopToken());
+
+    // The task is not scheduled until the result is demanded
+    template <class T>
+    static AsyncResult<T> makeDeferred(Executor executor, Future<T> fut, StopToken token, std::unique_ptr<ITaskBase> task);
+
+    // Schedules the deferred task, if any, and takes the future over.
+    // Invalidates the result.
+    template <class T>
+    static Future<T> takeFuture(AsyncResult<T>& result);
+
+    template <class T>
+    static Executor executor(const AsyncResult<T>& result);
+};
+
+}  // namespace details
+
 
 template <class T>
 class AsyncResult {
 
-friend class ThreadPool;
 template <class U> friend class AsyncResult;
-template <class U> friend class TaskGroup;
-template <class U> friend class FlattenSubscription;
-template <class Ret, class Fun, class ...Args>
-friend inline AsyncResult<Ret> call_async(ThreadPool& pool, Fun&& fun, Args &&...args);
+friend struct details::AsyncResultAccess;
 
 private:
-    AsyncResult(ThreadPool* pool, Future<T> fut)
+    AsyncResult(Executor executor, Future<T> fut, StopToken token = StopToken())
         : fut_(std::move(fut))
-        , parent_pool_(pool)
+        , executor_(executor)
+        , token_(std::move(token))
     {    }
 
 public:
-    AsyncResult() : fut_(), parent_pool_(nullptr) { }
+    AsyncResult() : fut_(), executor_(), token_() { }
     AsyncResult(const AsyncResult&) = delete;
     AsyncResult(AsyncResult&&) = default;
     AsyncResult& operator=(AsyncResult&&) = default;
@@ -44,6 +84,14 @@ public:
     // Does not invalidate the object.
     void wait();
 
+    // Same as wait, but bounded in time.
+    // Returns true if the result has been produced.
+    // Does not invalidate the object.
+    template <class Rep, class Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout);
+    template <class Clock, class Duration>
+    bool wait_until(const std::chrono::time_point<Clock, Duration>& deadline);
+
     // Synchronously get the result.
     // Invalidates the object.
     T get();
@@ -68,7 +116,7 @@ public:
     // Create a ready-to-use AsyncResult filled with error
     static AsyncResult<T> instantFail(std::exception_ptr error);
 
-    // Continue task execution in parent ThreadPool.
+    // Continue task execution in the parent executor.
     // Invalidates the object.
     template <class Ret>
     AsyncResult<Ret> then(FunctionType<Ret, T> func, ThenPolicy policy = ThenPolicy::Lazy);
@@ -78,27 +126,130 @@ public:
     template <class Err>
     AsyncResult<T> catch_err(ErrorHandler<T, Err> handler);
 
-    // Schedules subsequent execution to another ThreadPool.
+    // Schedules subsequent execution to another executor, e.g. ThreadPool or Strand.
+    // Invalidates the object.
+    AsyncResult<T> in(Executor executor);
+
+    // Resolves with TimeoutError unless the result is produced within the timeout.
+    // The deadline is tracked by the timer of the pool behind the parent executor, so no thread is blocked.
+    // The timeout is delivered by the timer thread even if all workers are busy.
+    // Throws std::runtime_error if the parent executor has no pool, e.g. for results of TaskGroup.
     // Invalidates the object.
-    AsyncResult<T> in(ThreadPool& pool);
+    template <class Rep, class Period>
+    AsyncResult<T> withTimeout(const std::chrono::duration<Rep, Period>& timeout);
+
+    // Same, but the deadline is tracked by the timer of the given pool, which must outlive the result.
+    // Invalidates the object.
+    template <class Rep, class Period>
+    AsyncResult<T> withTimeout(ThreadPool& timer_pool, const std::chrono::duration<Rep, Period>& timeout);
+
+    // Attaches a cancellation token to subsequent continuations. Once it is stopped,
+    // queued continuations are skipped and resolved with CancelledError.
+    // Invalidates the object.
+    AsyncResult<T> withStopToken(StopToken token);
+
+    // Converts to a copyable handle, that supports any number of consumers.
+    // Requires shared_async_result.hpp.
+    // Invalidates the object.
+    template <class U = T>
+    SharedAsyncResult<U> share();
+
+private:
+    // Schedules the deferred task, if any. Called by every subscription.
+    void launch();
+    // Runs the deferred task, if any, in the calling thread.
+    void runDeferred();
 
 private:
     Future<T> fut_;
-    ThreadPool* parent_pool_;
+    Executor executor_;
+    StopToken token_;
+    // Only set for results of call_deferred, that have not been demanded yet
+    std::unique_ptr<details::DeferredLaunch> deferred_;
 };
 
 
+// ================================================ //
+// ==================== ACCESS ==================== //
+// ================================================ //
+
+namespace details {
+
+template <class T>
+AsyncResult<T> AsyncResultAccess::make(Executor executor, Future<T> fut, StopToken token) {
+    return AsyncResult<T>{executor, std::move(fut), std::move(token)};
+}
+
+template <class T>
+AsyncResult<T> AsyncResultAccess::makeDeferred(Executor executor, Future<T> fut, StopToken token,
+                                               std::unique_ptr<ITaskBase> task) {
+    AsyncResult<T> result{executor, std::move(fut), std::move(token)};
+    result.deferred_ = std::make_unique<DeferredLaunch>(DeferredLaunch{std::move(task), executor});
+    return result;
+}
+
+template <class T>
+Future<T> AsyncResultAccess::takeFuture(AsyncResult<T>& result) {
+    result.launch();
+    return std::move(result.fut_);
+}
+
+template <class T>
+Executor AsyncResultAccess::executor(const AsyncResult<T>& result) {
+    return result.executor_;
+}
+
+}  // namespace details
+
+
+// ================================================== //
+// ==================== DEFERRED ==================== //
+// ================================================== //
+
+template <class T>
+void AsyncResult<T>::launch() {
+    if (deferred_) {
+        auto deferred = std::move(deferred_);
+        deferred->executor.submit(std::move(deferred->task));
+    }
+}
+
+template <class T>
+void AsyncResult<T>::runDeferred() {
+    if (deferred_) {
+        auto deferred = std::move(deferred_);
+        InlineExecutor::instance().submit(std::move(deferred->task));
+    }
+}
+
+
 // ==================================================== //
 // ==================== WAIT & GET ==================== //
 // ==================================================== //
 
 template <class T>
 void AsyncResult<T>::wait() {
+    runDeferred();
     fut_.wait();
 }
 
+template <class T>
+template <class Rep, class Period>
+bool AsyncResult<T>::wait_for(const std::chrono::duration<Rep, Period>& timeout) {
+    launch();
+    return fut_.waitUntil(std::chrono::steady_clock::now() + timeout);
+}
+
+template <class T>
+template <class Clock, class Duration>
+bool AsyncResult<T>::wait_until(const std::chrono::time_point<Clock, Duration>& deadline) {
+    launch();
+    return fut_.waitUntil(deadline);
+}
+
 template <class T>
 T AsyncResult<T>::get() {
+    runDeferred();
     if constexpr (std::is_same_v<T, void>) {
         fut_.get();
     } else {
@@ -137,6 +288,7 @@ template <class T>
 std::future<T> AsyncResult<T>::to_std() {
     auto std_promise = std::promise<T>();
     auto std_future = std_promise.get_future();
+    launch();
     fut_.subscribe(std::make_unique<ToStdSubscription<T> >(std::move(std_promise)));
     return std_future;
 }
@@ -150,20 +302,20 @@ template <class T>
 template <class U>
 std::enable_if_t<std::is_same_v<U, void>, AsyncResult<U>> AsyncResult<T>::instant() {
     static_assert(std::is_same_v<T, U>, "Cannot call instant with non-default template argument");
-    return AsyncResult<void>{nullptr, Future<void>::instantValue(Void{})};
+    return AsyncResult<void>{Executor(), Future<void>::instantValue(Void{})};
 }
 
 template <class T>
 template <class U>
 std::enable_if_t<!std::is_same_v<U, void>, AsyncResult<U>> AsyncResult<T>::instant(U value) {
     static_assert(std::is_same_v<T, U>, "Cannot call instant with non-default template argument");
-    return AsyncResult<U>{nullptr, Future<U>::instantValue(std::move(value))};
+    return AsyncResult<U>{Executor(), Future<U>::instantValue(std::move(value))};
 }
 
 
 template <class T>
 AsyncResult<T> AsyncResult<T>::instantFail(std::exception_ptr error) {
-    return AsyncResult<T>{nullptr, Future<T>::instantError(std::move(error))};
+    return AsyncResult<T>{Executor(), Future<T>::instantError(std::move(error))};
 }
 
 
@@ -172,8 +324,118 @@ AsyncResult<T> AsyncResult<T>::instantFail(std::exception_ptr error) {
 // ============================================ //
 
 template <class T>
-AsyncResult<T> AsyncResult<T>::in(ThreadPool& pool) {
-    return AsyncResult<T>{&pool, std::move(fut_)};
+AsyncResult<T> AsyncResult<T>::in(Executor executor) {
+    AsyncResult<T> result{executor, std::move(fut_), std::move(token_)};
+    result.deferred_ = std::move(deferred_);
+    return result;
+}
+
+
+// ========================================================= //
+// ==================== WITH STOP TOKEN ==================== //
+// ========================================================= //
+
+template <class T>
+AsyncResult<T> AsyncResult<T>::withStopToken(StopToken token) {
+    AsyncResult<T> result{executor_, std::move(fut_), std::move(token)};
+    result.deferred_ = std::move(deferred_);
+    return result;
+}
+
+
+// ================================================= //
+// ==================== TIMEOUT ==================== //
+// ================================================= //
+
+namespace details {
+
+// Either the result or the timer resolves the promise, whichever comes first.
+template <class T>
+struct TimeoutState {
+    TimeoutState(ThreadPool& timer_pool, Promise<T> promise)
+        : resolved(false), timer_pool(timer_pool), promise(std::move(promise)) {   }
+
+    bool tryResolve() { return !resolved.exchange(true, std::memory_order_acq_rel); }
+
+    // The result has come first, so the timer is of no use anymore
+    void retireTimer() { timer_pool.retireTimer(); }
+
+    std::atomic<bool> resolved;
+    ThreadPool& timer_pool;
+    Promise<T> promise;
+};
+
+template <class T>
+class TimeoutTask : public ITaskBase {
+public:
+    explicit TimeoutTask(std::shared_ptr<TimeoutState<T> > state) : state_(std::move(state)) {   }
+
+    void run() override {
+        if (state_->tryResolve()) {
+            state_->promise.setError(std::make_exception_ptr(TimeoutError()));
+        }
+    }
+
+    // Lets the wheel drop the timer before its deadline
+    bool cancelled() const override { return state_->resolved.load(std::memory_order_acquire); }
+
+    // The timer has stopped before the deadline, so the timeout can no longer be delivered
+    void cancel() override {
+        if (state_->tryResolve()) {
+            state_->promise.setError(std::make_exception_ptr(CancelledError()));
+        }
+    }
+
+private:
+    std::shared_ptr<TimeoutState<T> > state_;
+};
+
+}  // namespace details
+
+template <class T>
+class TimeoutSubscription : public ISubscription<PhysicalType<T> > {
+public:
+    explicit TimeoutSubscription(std::shared_ptr<details::TimeoutState<T> > state)
+        : state_(std::move(state)) {   }
+
+    void resolveValue(PhysicalType<T> val, ResolvedBy) override {
+        if (state_->tryResolve()) {
+            state_->promise.setValue(std::move(val));
+            state_->retireTimer();
+        }
+    }
+
+    void resolveError(std::exception_ptr err, ResolvedBy) override {
+        if (state_->tryResolve()) {
+            state_->promise.setError(std::move(err));
+            state_->retireTimer();
+        }
+    }
+
+private:
+    std::shared_ptr<details::TimeoutState<T> > state_;
+};
+
+template <class T>
+template <class Rep, class Period>
+AsyncResult<T> AsyncResult<T>::withTimeout(const std::chrono::duration<Rep, Period>& timeout) {
+    ThreadPool* timer_pool = executor_.pool();
+    if (timer_pool == nullptr) {
+        throw std::runtime_error("Timeout requires an executor backed by a thread pool, or a timer pool");
+    }
+    return withTimeout(*timer_pool, timeout);
+}
+
+template <class T>
+template <class Rep, class Period>
+AsyncResult<T> AsyncResult<T>::withTimeout(ThreadPool& timer_pool, const std::chrono::duration<Rep, Period>& timeout) {
+    auto [promise, future] = contract<T>();
+    auto state = std::make_shared<details::TimeoutState<T> >(timer_pool, std::move(promise));
+    auto deadline = ThreadPool::Clock::now() + std::chrono::duration_cast<ThreadPool::Clock::duration>(timeout);
+    timer_pool.fireAt(deadline, std::make_unique<details::TimeoutTask<T> >(state));
+    launch();
+    fut_.subscribe(std::make_unique<TimeoutSubscription<T> >(std::move(state)));
+    return AsyncResult<T>{executor_, std::move(future), std::move(token_)};
 }
 
 
@@ -222,9 +484,10 @@ template <class T>
 template <class Err>
 AsyncResult<T> AsyncResult<T>::catch_err(ErrorHandler<T, Err> handler) {
     auto [promise, future] = contract<T>();
+    launch();
     fut_.subscribe(std::make_unique<CatchSubscription<T, Err> >(
         std::move(handler), std::move(promise)));
-    return AsyncResult<T>{parent_pool_, std::move(future)};
+    return AsyncResult<T>{executor_, std::move(future), std::move(token_)};
 }
 
 
@@ -232,55 +495,77 @@ AsyncResult<T> AsyncResult<T>::catch_err(ErrorHandler<T, Err> handler) {
 // ==================== THEN ==================== //
 // ============================================== //
 
+namespace details {
+
+// Either run the continuation task in place or submit it to the executor.
+inline void dispatchContinuation(ThreadPool::Task task,
+                                 Executor continuation_executor,
+                                 ThenPolicy policy,
+                                 ResolvedBy by
+) {
+    if (policy == ThenPolicy::NoSchedule) {
+        task->run();
+    } else if (policy == ThenPolicy::Eager && by == ResolvedBy::kProducer) {
+        task->run();
+    } else {
+        continuation_executor.submit(std::move(task));
+    }
+}
+
+inline std::exception_ptr cancelledError() {
+    return std::make_exception_ptr(CancelledError());
+}
+
+}  // namespace details
+
 template <class Ret, class Arg>
 class ThenSubscription : public PipeSubscription<Ret, Arg> {
 public:
     ThenSubscription(FunctionType<Ret, Arg> func,
                      Promise<Ret> promise,
-                     ThreadPool* continuation_pool,
-                     ThenPolicy policy
+                     Executor continuation_executor,
+                     ThenPolicy policy,
+                     StopToken token
     )
         : PipeSubscription<Ret, Arg> (std::move(promise))
         , func_(std::move(func))
-        , continuation_pool_(continuation_pool)
+        , continuation_executor_(continuation_executor)
         , execution_policy_(policy)
-    {
-        if (continuation_pool_ == nullptr && execution_policy_ != ThenPolicy::NoSchedule) {
-            LOG_WARN << "Enforcing ThenPolicy::NoSchedule due to empty thread pool";
-            execution_policy_ = ThenPolicy::NoSchedule;
-        }
-    }
+        , token_(std::move(token))
+    {   }
 
     void resolveValue([[maybe_unused]] PhysicalType<Arg> value, ResolvedBy by) override {
+        if (token_.stopRequested()) {
+            // Short-circuit the rest of the chain without scheduling anything
+            promise_.setError(details::cancelledError());
+            return;
+        }
         ThreadPool::Task pool_task = nullptr;
         if constexpr (std::is_same_v<Arg, void>) {
-            pool_task = details::make_async_task<Ret>(std::move(func_), std::move(promise_));
-        } else {
-            pool_task = details::make_bound_async_task<Ret, Arg>(std::move(func_), std::move(promise_), std::move(value));
-        }
-        if (execution_policy_ == ThenPolicy::NoSchedule) {
-            pool_task->run();
-        } else if (execution_policy_ == ThenPolicy::Eager && by == ResolvedBy::kProducer) {
-            pool_task->run();
+            pool_task = details::make_async_task<Ret>(std::move(func_), std::move(promise_), std::move(token_));
         } else {
-            continuation_pool_->submit(std::move(pool_task));
+            pool_task = details::make_bound_async_task<Ret, Arg>(
+                std::move(func_), std::move(promise_), std::move(value), std::move(token_));
         }
+        details::dispatchContinuation(std::move(pool_task), continuation_executor_, execution_policy_, by);
     }
 
 private:
     using PipeSubscription<Ret, Arg>::promise_;
     FunctionType<Ret, Arg> func_;
-    ThreadPool * continuation_pool_;
+    Executor continuation_executor_;
     ThenPolicy execution_policy_;
+    StopToken token_;
 };
 
 template <class T>
 template <class Ret>
 AsyncResult<Ret> AsyncResult<T>::then(FunctionType<Ret, T> func, ThenPolicy policy) {
     auto [promise, future] = contract<Ret>();
+    launch();
     fut_.subscribe(std::make_unique<ThenSubscription<Ret, T> >(
-        std::move(func), std::move(promise), parent_pool_, policy));
-    return AsyncResult<Ret>{parent_pool_, std::move(future)};
+        std::move(func), std::move(promise), executor_, policy, token_));
+    return AsyncResult<Ret>{executor_, std::move(future), std::move(token_)};
 }
 
 
@@ -296,7 +581,7 @@ public:
     {   }
 
     void resolveValue(AsyncResult<Ret> async_val, ResolvedBy) override {
-        async_val.fut_.subscribe(
+        details::AsyncResultAccess::takeFuture(async_val).subscribe(
             std::make_unique<ForwardSubscription<Ret> >(std::move(promise_))
         );
     }
@@ -312,6 +597,7 @@ std::enable_if_t<is_async_result<U>::value, T> AsyncResult<T>::flatten() {
     using Ret = typename async_type<T>::type;
     // Utilize duck typing
     auto [promise, future] = contract<Ret>();
+    launch();
     fut_.subscribe( std::make_unique<FlattenSubscription<Ret> >(std::move(promise)) );
-    return AsyncResult<Ret>{parent_pool_, std::move(future)};
+    return AsyncResult<Ret>{executor_, std::move(future), std::move(token_)};
 }
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.hpp"
+#include "task_graph.hpp"
+#include "task_group.hpp"
+
+
+// Forward declare
+template <class T> class Captured;
+class AsyncCapture;
+
+
+namespace details {
+
+struct CaptureSlotBase {
+    virtual ~CaptureSlotBase() = default;
+
+    // Set by the step once it is done, and cleared at the start of every replay unless it is an input.
+    // The value itself is kept, so that the next replay reuses its storage.
+    bool ready = false;
+    bool input = false;
+};
+
+// Result of a captured step. Allocated once by the capture and overwritten by every replay.
+template <class T>
+struct CaptureSlot : CaptureSlotBase {
+    std::optional<T> value = std::nullopt;
+};
+
+template <>
+struct CaptureSlot<void> : CaptureSlotBase {   };
+
+template <class T>
+struct IsCaptured : std::false_type {   };
+
+template <class T>
+struct IsCaptured<Captured<T> > : std::true_type {   };
+
+// Results of other steps are read at replay, any other argument is bound at capture
+template <class Arg>
+const auto& replayArg(const Arg& arg) {
+    if constexpr (IsCaptured<Arg>::value) {
+        return arg.get();
+    } else {
+        return arg;
+    }
+}
+
+template <class Ret, class Fun>
+void storeResult(CaptureSlot<Ret>& slot, Fun&& fun) {
+    if constexpr (std::is_void_v<Ret>) {
+        fun();
+    } else {
+        slot.value.emplace(fun());
+    }
+    slot.ready = true;
+}
+
+}  // namespace details
+
+
+// ================================================== //
+// ==================== CAPTURED ==================== //
+// ================================================== //
+
+// A step of a captured computation, like an AsyncResult of it. Valid as long as its capture.
+template <class T>
+class Captured {
+public:
+    // The value of the last replay. Throws std::bad_optional_access if the step has not run in it:
+    // before the first replay, or if the replay failed before the step or in it.
+    template <class U = T>
+    const U& get() const {
+        static_assert(std::is_same_v<T, U>, "Cannot call get with non-default template argument");
+        if (!slot_->ready) {
+            throw std::bad_optional_access();
+        }
+        return *slot_->value;
+    }
+
+    // Sets the value of an input for the following replays
+    template <class U = T>
+    void set(U value) {
+        static_assert(std::is_same_v<T, U>, "Cannot call set with non-default template argument");
+        if (node_) {
+            throw std::logic_error("Only inputs of a capture can be set");
+        }
+        slot_->value.emplace(std::move(value));
+    }
+
+    // Like AsyncResult::then: runs fun(value), or fun() for void, once this step is done
+    template <class Ret, class Fun>
+    Captured<Ret> then(Fun&& fun);
+
+private:
+    Captured(AsyncCapture& capture, details::CaptureSlot<T>& slot, std::optional<TaskGraph::NodeId> node)
+        : capture_(&capture), slot_(&slot), node_(node) {   }
+
+private:
+    AsyncCapture* capture_;
+    details::CaptureSlot<T>* slot_;
+    // Inputs are not computed by any node
+    std::optional<TaskGraph::NodeId> node_;
+
+friend class AsyncCapture;
+template <class U> friend class Captured;
+};
+
+
+// ======================================================= //
+// ==================== ASYNC CAPTURE ==================== //
+// ======================================================= //
+
+// Records the shape of an async computation once, and replays it any number of times.
+// The steps mirror call_async, AsyncResult::then and TaskGroup::all, but instead of a shared state
+// and a subscription per call, every step becomes a node of a TaskGraph with a preallocated slot
+// for its result. A replay only resets the dependency counters, so it does not allocate unless
+// the steps do. New inputs are set between replays; captured references are read by each replay.
+class AsyncCapture {
+public:
+    AsyncCapture() = default;
+    AsyncCapture(const AsyncCapture&) = delete;
+    AsyncCapture& operator=(const AsyncCapture&) = delete;
+
+    template <class T>
+    Captured<T> input(T initial) {
+        auto& slot = newSlot<T>();
+        slot.value.emplace(std::move(initial));
+        slot.input = slot.ready = true;
+        return Captured<T>(*this, slot, std::nullopt);
+    }
+
+    // Like call_async: runs fun(args...) in every replay. Captured arguments are replaced
+    // by their values and make the step wait for them; the rest are copied once.
+    template <class Ret, class Fun, class ...Args>
+    Captured<Ret> call(Fun&& fun, Args &&...args) {
+        std::vector<TaskGraph::NodeId> dependencies;
+        (collectDependency(args, dependencies), ...);
+        auto& slot = newSlot<Ret>();
+        TaskGraph::NodeId node = graph_.addTask(
+            [&slot, fun = std::forward<Fun>(fun), bound = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+                details::storeResult<Ret>(slot, [&fun, &bound]() -> Ret {
+                    return std::apply([&fun](const auto &...arg) -> Ret {
+                        return fun(details::replayArg(arg)...);
+                    }, bound);
+                });
+            });
+        for (TaskGraph::NodeId dependency : dependencies) {
+            graph_.addEdge(dependency, node);
+        }
+        return Captured<Ret>(*this, slot, node);
+    }
+
+    // Like TaskGroup::all: the values of the members in their order, once all of them are done.
+    // The vector is allocated at capture and overwritten by every replay.
+    template <class T>
+    Captured<GroupAllType<T> > all(const std::vector<Captured<T> >& members) {
+        auto& slot = newSlot<GroupAllType<T> >();
+        TaskGraph::NodeId node;
+        if constexpr (std::is_void_v<T>) {
+            node = graph_.addTask([&slot]() { slot.ready = true; });
+        } else {
+            slot.value.emplace(members.size());
+            node = graph_.addTask([&slot, members]() {
+                for (size_t idx = 0; idx < members.size(); ++idx) {
+                    (*slot.value)[idx] = members[idx].get();
+                }
+                slot.ready = true;
+            });
+        }
+        std::vector<TaskGraph::NodeId> dependencies;
+        for (const Captured<T>& member : members) {
+            collectDependency(member, dependencies);
+        }
+        for (TaskGraph::NodeId dependency : dependencies) {
+            graph_.addEdge(dependency, node);
+        }
+        return Captured<GroupAllType<T> >(*this, slot, node);
+    }
+
+    size_t size() const { return graph_.size(); }
+
+    // Runs every captured step once, in the pool. Rethrows the first error of a step: the steps,
+    // that have not run then, hold no value until the next replay.
+    void replay(ThreadPool& pool) {
+        for (auto& slot : slots_) {
+            slot->ready = slot->input;
+        }
+        graph_.run(pool);
+    }
+
+private:
+    template <class T>
+    details::CaptureSlot<T>& newSlot() {
+        slots_.push_back(std::make_unique<details::CaptureSlot<T> >());
+        return static_cast<details::CaptureSlot<T>&>(*slots_.back());
+    }
+
+    // The node of a captured argument, if any. Collected before the argument is bound.
+    template <class Arg>
+    void collectDependency(const Arg& arg, std::vector<TaskGraph::NodeId>& dependencies) const {
+        if constexpr (details::IsCaptured<std::decay_t<Arg> >::value) {
+            if (arg.capture_ != this) {
+                throw std::invalid_argument("Captured step belongs to another capture");
+            }
+            if (arg.node_) {
+                dependencies.push_back(*arg.node_);
+            }
+        }
+    }
+
+private:
+    TaskGraph graph_;
+    std::vector<std::unique_ptr<details::CaptureSlotBase> > slots_;
+
+template <class T> friend class Captured;
+};
+
+
+template <class T>
+template <class Ret, class Fun>
+Captured<Ret> Captured<T>::then(Fun&& fun) {
+    if constexpr (std::is_void_v<T>) {
+        // There is no value to pass, only the order
+        Captured<Ret> next = capture_->call<Ret>(std::forward<Fun>(fun));
+        if (node_) {
+            capture_->graph_.addEdge(*node_, *next.node_);
+        }
+        return next;
+    } else {
+        return capture_->call<Ret>(std::forward<Fun>(fun), *this);
+    }
+}
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "async_result.hpp"
+#include "contract.hpp"
+#include "executor.hpp"
+
+
+// Delivered to senders of a closed channel.
+class ChannelClosedError : public std::runtime_error {
+public:
+    ChannelClosedError() : std::runtime_error("Channel is closed") {   }
+};
+
+
+namespace details {
+
+// A fixed-capacity FIFO queue over a contiguous buffer.
+template <class T>
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t capacity) : slots_(capacity), head_(0), size_(0) {   }
+
+    bool empty() const { return size_ == 0; }
+    bool full() const { return size_ == slots_.size(); }
+    size_t size() const { return size_; }
+
+    void push(T value) {
+        slots_[(head_ + size_) % slots_.size()].emplace(std::move(value));
+        ++size_;
+    }
+
+    T pop() {
+        T value = std::move(*slots_[head_]);
+        slots_[head_].reset();
+        head_ = (head_ + 1) % slots_.size();
+        --size_;
+        return value;
+    }
+
+private:
+    std::vector<std::optional<T> > slots_;
+    size_t head_;
+    size_t size_;
+};
+
+}  // namespace details
+
+
+// A bounded multi-producer multi-consumer queue for streaming data between pool stages.
+// Neither side ever blocks a thread: a sender to a full channel and a receiver from an empty
+// one get a pending result, which is resolved by the counterpart, and their continuations
+// run in the executor of the channel. A value is handed over to a waiting receiver directly,
+// bypassing the buffer. Waiters are served in FIFO order.
+// Once the channel is closed, receivers drain the buffer and then get std::nullopt.
+template <class T>
+class Channel {
+public:
+    Channel(size_t capacity, Executor executor);
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    // Resolved once the value is in the channel, or with ChannelClosedError.
+    AsyncResult<void> send(T value);
+
+    // Returns false if the channel is full or closed, in which case the value is left intact.
+    bool trySend(T&& value);
+
+    // Resolved with the next value, or with std::nullopt once the channel is closed and drained.
+    AsyncResult<std::optional<T> > receive();
+
+    // Returns std::nullopt if there is no value at the moment.
+    std::optional<T> tryReceive();
+
+    // Resolved with 1 to max_items values, as soon as at least one is available.
+    // An empty vector means that the channel is closed and drained.
+    AsyncResult<std::vector<T> > receiveMany(size_t max_items);
+
+    // Pending receivers get std::nullopt, and pending senders get ChannelClosedError.
+    void close();
+    bool closed() const;
+
+private:
+    struct PendingSend {
+        T value;
+        Promise<void> promise;
+    };
+
+    struct PendingReceive {
+        std::optional<Promise<std::optional<T> > > one;
+        std::optional<Promise<std::vector<T> > > many;
+    };
+
+    // Takes the oldest value, refilling the buffer from the oldest blocked sender if any
+    T takeLocked(std::optional<Promise<void> >& unblocked);
+    static void deliver(PendingReceive receiver, T value);
+
+    template <class U>
+    AsyncResult<U> ready(PhysicalType<U> value) {
+        return details::AsyncResultAccess::make(executor_, Future<U>::instantValue(std::move(value)));
+    }
+
+private:
+    const Executor executor_;
+    mutable std::mutex mtx_;
+    details::RingBuffer<T> buffer_;
+    // Not empty only if the buffer is full
+    std::deque<PendingSend> senders_;
+    // Not empty only if the buffer is empty
+    std::deque<PendingReceive> receivers_;
+    bool closed_;
+};
+
+
+// ============================================== //
+// ==================== SEND ==================== //
+// ============================================== //
+
+template <class T>
+Channel<T>::Channel(size_t capacity, Executor executor)
+    : executor_(executor)
+    , buffer_(capacity)
+    , closed_(false)
+{
+    if (capacity == 0) {
+        throw std::invalid_argument("Channel capacity must be positive");
+    }
+}
+
+template <class T>
+AsyncResult<void> Channel<T>::send(T value) {
+    std::unique_lock guard(mtx_);
+    if (closed_) {
+        return details::AsyncResultAccess::make(executor_, Future<void>::instantError(std::make_exception_ptr(ChannelClosedError())));
+    }
+    if (!receivers_.empty()) {
+        PendingReceive receiver = std::move(receivers_.front());
+        receivers_.pop_front();
+        guard.unlock();
+        deliver(std::move(receiver), std::move(value));
+        return ready<void>(Void{});
+    }
+    if (!buffer_.full()) {
+        buffer_.push(std::move(value));
+        return ready<void>(Void{});
+    }
+    auto [promise, future] = contract<void>();
+    senders_.push_back(PendingSend{std::move(value), std::move(promise)});
+    return details::AsyncResultAccess::make(executor_, std::move(future));
+}
+
+template <class T>
+bool Channel<T>::trySend(T&& value) {
+    std::unique_lock guard(mtx_);
+    if (closed_) {
+        return false;
+    }
+    if (!receivers_.empty()) {
+        PendingReceive receiver = std::move(receivers_.front());
+        receivers_.pop_front();
+        guard.unlock();
+        deliver(std::move(receiver), std::move(value));
+        return true;
+    }
+    if (!buffer_.full()) {
+        buffer_.push(std::move(value));
+        return true;
+    }
+    return false;
+}
+
+template <class T>
+void Channel<T>::deliver(PendingReceive receiver, T value) {
+    if (receiver.one.has_value()) {
+        receiver.one->setValue(std::optional<T>(std::move(value)));
+    } else {
+        std::vector<T> values;
+        values.push_back(std::move(value));
+        receiver.many->setValue(std::move(values));
+    }
+}
+
+
+// ================================================= //
+// ==================== RECEIVE ==================== //
+// ================================================= //
+
+template <class T>
+T Channel<T>::takeLocked(std::optional<Promise<void> >& unblocked) {
+    T value = buffer_.pop();
+    if (!senders_.empty()) {
+        buffer_.push(std::move(senders_.front().value));
+        unblocked.emplace(std::move(senders_.front().promise));
+        senders_.pop_front();
+    }
+    return value;
+}
+
+template <class T>
+AsyncResult<std::optional<T> > Channel<T>::receive() {
+    std::unique_lock guard(mtx_);
+    if (!buffer_.empty()) {
+        std::optional<Promise<void> > unblocked;
+        std::optional<T> value(takeLocked(unblocked));
+        guard.unlock();
+        if (unblocked.has_value()) {
+            unblocked->setValue(Void{});
+        }
+        return ready<std::optional<T> >(std::move(value));
+    }
+    if (closed_) {
+        return ready<std::optional<T> >(std::nullopt);
+    }
+    auto [promise, future] = contract<std::optional<T> >();
+    receivers_.push_back(PendingReceive{std::move(promise), std::nullopt});
+    return details::AsyncResultAccess::make(executor_, std::move(future));
+}
+
+template <class T>
+std::optional<T> Channel<T>::tryReceive() {
+    std::unique_lock guard(mtx_);
+    if (buffer_.empty()) {
+        return std::nullopt;
+    }
+    std::optional<Promise<void> > unblocked;
+    std::optional<T> value(takeLocked(unblocked));
+    guard.unlock();
+    if (unblocked.has_value()) {
+        unblocked->setValue(Void{});
+    }
+    return value;
+}
+
+template <class T>
+AsyncResult<std::vector<T> > Channel<T>::receiveMany(size_t max_items) {
+    if (max_items == 0) {
+        throw std::invalid_argument("receiveMany requires a positive number of items");
+    }
+    std::unique_lock guard(mtx_);
+    if (!buffer_.empty()) {
+        std::vector<T> values;
+        std::vector<Promise<void> > unblocked;
+        values.reserve(std::min(max_items, buffer_.size()));
+        while (values.size() < max_items && !buffer_.empty()) {
+            std::optional<Promise<void> > sender;
+            values.push_back(takeLocked(sender));
+            if (sender.has_value()) {
+                unblocked.push_back(std::move(*sender));
+            }
+        }
+        guard.unlock();
+        for (auto& promise : unblocked) {
+            promise.setValue(Void{});
+        }
+        return ready<std::vector<T> >(std::move(values));
+    }
+    if (closed_) {
+        return ready<std::vector<T> >(std::vector<T>());
+    }
+    auto [promise, future] = contract<std::vector<T> >();
+    receivers_.push_back(PendingReceive{std::nullopt, std::move(promise)});
+    return details::AsyncResultAccess::make(executor_, std::move(future));
+}
+
+
+// =============================================== //
+// ==================== CLOSE ==================== //
+// =============================================== //
+
+template <class T>
+void Channel<T>::close() {
+    std::deque<PendingSend> senders;
+    std::deque<PendingReceive> receivers;
+    {
+        std::lock_guard guard(mtx_);
+        if (closed_) {
+            return;
+        }
+        closed_ = true;
+        std::swap(senders, senders_);
+        std::swap(receivers, receivers_);
+    }
+    for (auto& receiver : receivers) {
+        if (receiver.one.has_value()) {
+            receiver.one->setValue(std::nullopt);
+        } else {
+            receiver.many->setValue(std::vector<T>());
+        }
+    }
+    for (auto& sender : senders) {
+        sender.promise.setError(std::make_exception_ptr(ChannelClosedError()));
+    }
+}
+
+template <class T>
+bool Channel<T>::closed() const {
+    std::lock_guard guard(mtx_);
+    return closed_;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cassert>
+#include <chrono>
 #include <memory>
 #include <utility>
 #include <stdexcept>
@@ -62,6 +63,11 @@ public:
     // Wait for the Promise to be resolved, but does not invalidate the Future.
     void wait();
 
+    // Same as wait, but gives up once the deadline has passed.
+    // Returns true if the Promise has been resolved.
+    template <class Clock, class Duration>
+    bool waitUntil(const std::chrono::time_point<Clock, Duration>& deadline);
+
     // Wait for the Promise to be resolved and return value. Invalidates the Future.
     PhysicalType<T> get();
 
@@ -213,6 +219,16 @@ void Future<T>::wait() {
     }
 }
 
+template <class T>
+template <class Clock, class Duration>
+bool Future<T>::waitUntil(const std::chrono::time_point<Clock, Duration>& deadline) {
+    if (!state_) {
+        throw std::runtime_error("Trying to wait for spoiled state");
+    }
+    std::unique_lock guard(state_->mtx_);
+    return state_->cv_.wait_until(guard, deadline, [this]() { return state_->produced_; });
+}
+
 template <class T>
 void Future<T>::subscribe(ValueCallback<PhysicalType<T>> on_value, ErrorCallback on_error) {
     subscribe(std::make_unique<SimpleSubscription<T>>(std::move(on_value), std::move(on_error)));
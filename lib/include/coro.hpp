@@ -0,0 +1,430 @@
+#pragma once
+
+// Requires C++20 coroutines. Nothing is defined otherwise, so the header is safe to include anywhere.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "../private/type_traits.hpp"
+#include "thread_pool_task_base.hpp"
+#include "async_result.hpp"
+#include "contract.hpp"
+#include "executor.hpp"
+
+
+namespace details {
+
+// ========================================================= //
+// ==================== FRAME ALLOCATOR ==================== //
+// ========================================================= //
+
+// Recycles coroutine frames via per-thread free lists, one for each size class.
+// A frame may be freed by another thread than the one that allocated it:
+// it just moves to the free list of that thread. Frames over kMaxSize go to the heap.
+class FrameAllocator {
+public:
+    static constexpr size_t kGranularity = 64;
+    static constexpr size_t kMaxSize = 2048;
+    static constexpr size_t kNumClasses = kMaxSize / kGranularity;
+    // Cached frames per class and thread, so that memory returns to the heap eventually
+    static constexpr size_t kMaxCached = 256;
+
+    static void* allocate(size_t size) {
+        if (size > kMaxSize) {
+            return ::operator new(size);
+        }
+        FreeList& list = freeLists().lists[sizeClass(size)];
+        if (list.head == nullptr) {
+            return ::operator new(roundUp(size));
+        }
+        FreeNode* node = list.head;
+        list.head = node->next;
+        --list.size;
+        return node;
+    }
+
+    static void deallocate(void* ptr, size_t size) {
+        if (size > kMaxSize) {
+            ::operator delete(ptr);
+            return;
+        }
+        FreeList& list = freeLists().lists[sizeClass(size)];
+        if (list.size == kMaxCached) {
+            ::operator delete(ptr);
+            return;
+        }
+        list.head = new (ptr) FreeNode{list.head};
+        ++list.size;
+    }
+
+private:
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    struct FreeList {
+        FreeNode* head = nullptr;
+        size_t size = 0;
+    };
+
+    struct ThreadCache {
+        ~ThreadCache() {
+            for (FreeList& list : lists) {
+                while (list.head != nullptr) {
+                    ::operator delete(std::exchange(list.head, list.head->next));
+                }
+            }
+        }
+
+        std::array<FreeList, kNumClasses> lists;
+    };
+
+    static size_t roundUp(size_t size) { return (size + kGranularity - 1) / kGranularity * kGranularity; }
+    static size_t sizeClass(size_t size) { return roundUp(size) / kGranularity - 1; }
+
+    static ThreadCache& freeLists() {
+        thread_local ThreadCache cache;
+        return cache;
+    }
+};
+
+// Coroutine frames of promises, derived from it, are allocated by FrameAllocator.
+struct RecycledFrame {
+    static void* operator new(size_t size) { return FrameAllocator::allocate(size); }
+    static void operator delete(void* ptr, size_t size) { FrameAllocator::deallocate(ptr, size); }
+};
+
+// Resumes a suspended coroutine from an executor. If the executor drops the task instead,
+// e.g. a stopped pool, the coroutine is resumed all the same with CancelledError in the error
+// slot of its awaiter, which rethrows it: the coroutine unwinds rather than leaking its frame.
+class ResumeTask : public ITaskBase {
+public:
+    ResumeTask(std::coroutine_handle<> handle, std::exception_ptr& error) : handle_(handle), error_(error) {   }
+
+    void run() override { handle_.resume(); }
+
+    void cancel() override {
+        error_ = std::make_exception_ptr(CancelledError());
+        handle_.resume();
+    }
+
+private:
+    std::coroutine_handle<> handle_;
+    std::exception_ptr& error_;
+};
+
+}  // namespace details
+
+
+// ============================================== //
+// ==================== TASK ==================== //
+// ============================================== //
+
+template <class T> class Task;
+
+namespace details {
+
+class TaskPromiseBase : public RecycledFrame {
+public:
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        // Symmetric transfer to the awaiting coroutine, so that no stack is consumed
+        template <class Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            std::coroutine_handle<> continuation = handle.promise().continuation_;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {   }
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() noexcept { error_ = std::current_exception(); }
+
+    void setContinuation(std::coroutine_handle<> continuation) { continuation_ = continuation; }
+
+protected:
+    void rethrowIfFailed() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    std::coroutine_handle<> continuation_;
+    std::exception_ptr error_;
+};
+
+template <class T>
+class TaskPromise : public TaskPromiseBase {
+public:
+    Task<T> get_return_object();
+
+    template <class U>
+    void return_value(U&& value) { value_.emplace(std::forward<U>(value)); }
+
+    T result() {
+        rethrowIfFailed();
+        return std::move(*value_);
+    }
+
+private:
+    std::optional<T> value_;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+public:
+    Task<void> get_return_object();
+
+    void return_void() {   }
+
+    void result() { rethrowIfFailed(); }
+};
+
+}  // namespace details
+
+
+// A lazily started coroutine: it starts running once awaited, on the thread of the awaiter,
+// and resumes the awaiter on completion via symmetric transfer. It runs in a pool, when
+// spawned there, and moves between executors by awaiting AsyncResults or resume_on.
+template <class T>
+class Task {
+
+friend class details::TaskPromise<T>;
+
+private:
+    using Handle = std::coroutine_handle<details::TaskPromise<T> >;
+
+    explicit Task(Handle handle) : handle_(handle) {   }
+
+public:
+    using promise_type = details::TaskPromise<T>;
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    Task(Task&& other) : handle_(std::exchange(other.handle_, nullptr)) {   }
+    Task& operator=(Task&& other) {
+        if (this != &other) {
+            reset();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    ~Task() { reset(); }
+
+    class Awaiter {
+    public:
+        explicit Awaiter(Handle handle) : handle_(handle) {   }
+
+        bool await_ready() { return false; }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) {
+            handle_.promise().setContinuation(awaiter);
+            return handle_;
+        }
+
+        T await_resume() { return handle_.promise().result(); }
+
+    private:
+        Handle handle_;
+    };
+
+    // Invalidates the object.
+    Awaiter operator co_await() && { return Awaiter(handle_); }
+
+private:
+    void reset() {
+        if (handle_) {
+            std::exchange(handle_, nullptr).destroy();
+        }
+    }
+
+private:
+    Handle handle_;
+};
+
+namespace details {
+
+template <class T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>{std::coroutine_handle<TaskPromise<T> >::from_promise(*this)};
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>{std::coroutine_handle<TaskPromise<void> >::from_promise(*this)};
+}
+
+}  // namespace details
+
+
+// ================================================== //
+// ==================== AWAITERS ==================== //
+// ================================================== //
+
+namespace details {
+
+template <class T>
+class AsyncResultAwaiter {
+public:
+    explicit AsyncResultAwaiter(AsyncResult<T>&& result)
+        : fut_(AsyncResultAccess::takeFuture(result))
+        , executor_(AsyncResultAccess::executor(result))
+    {   }
+
+    bool await_ready() { return false; }
+
+    // Does not suspend if the result is already there. Once subscribed, the producer may resume
+    // the coroutine and destroy the awaiter at any moment, so the flag lives on the stack.
+    bool await_suspend(std::coroutine_handle<> handle) {
+        bool resolved_inline = false;
+        fut_.subscribe(std::make_unique<ResumeSubscription>(this, handle, &resolved_inline));
+        return !resolved_inline;
+    }
+
+    T await_resume() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        if constexpr (!std::is_same_v<T, void>) {
+            return std::move(*value_);
+        }
+    }
+
+private:
+    // Resumes the coroutine in the executor of the result, the same way as then does
+    class ResumeSubscription : public ISubscription<PhysicalType<T> > {
+    public:
+        ResumeSubscription(AsyncResultAwaiter* awaiter, std::coroutine_handle<> handle, bool* resolved_inline)
+            : awaiter_(awaiter)
+            , handle_(handle)
+            , resolved_inline_(resolved_inline)
+        {   }
+
+        void resolveValue(PhysicalType<T> value, ResolvedBy by) override {
+            awaiter_->value_.emplace(std::move(value));
+            resume(by);
+        }
+
+        void resolveError(std::exception_ptr error, ResolvedBy by) override {
+            awaiter_->error_ = std::move(error);
+            resume(by);
+        }
+
+    private:
+        void resume(ResolvedBy by) {
+            if (by == ResolvedBy::kConsumer) {
+                // Still inside await_suspend
+                *resolved_inline_ = true;
+            } else {
+                awaiter_->executor_.submit(std::make_unique<ResumeTask>(handle_, awaiter_->error_));
+            }
+        }
+
+        AsyncResultAwaiter* awaiter_;
+        std::coroutine_handle<> handle_;
+        // Only valid while await_suspend runs
+        bool* resolved_inline_;
+    };
+
+private:
+    Future<T> fut_;
+    Executor executor_;
+    std::optional<PhysicalType<T> > value_;
+    std::exception_ptr error_;
+};
+
+}  // namespace details
+
+// Makes AsyncResult awaitable: the coroutine is resumed in the executor of the result.
+// Invalidates the object.
+template <class T>
+details::AsyncResultAwaiter<T> operator co_await(AsyncResult<T>&& result) {
+    return details::AsyncResultAwaiter<T>(std::move(result));
+}
+
+
+class ResumeOnAwaiter {
+public:
+    explicit ResumeOnAwaiter(Executor executor) : executor_(executor) {   }
+
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        executor_.submit(std::make_unique<details::ResumeTask>(handle, error_));
+    }
+    void await_resume() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    Executor executor_;
+    std::exception_ptr error_;
+};
+
+// co_await resume_on(pool) continues the coroutine in the pool.
+// Throws CancelledError if the executor drops the continuation, e.g. a stopped pool.
+inline ResumeOnAwaiter resume_on(Executor executor) {
+    return ResumeOnAwaiter(executor);
+}
+
+
+// =============================================== //
+// ==================== SPAWN ==================== //
+// =============================================== //
+
+namespace details {
+
+// Starts right away and destroys itself on completion.
+struct DetachedTask {
+    struct promise_type : RecycledFrame {
+        DetachedTask get_return_object() {
+            return DetachedTask{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {   }
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+template <class T>
+DetachedTask fulfill(Executor executor, Task<T> task, Promise<T> promise) {
+    try {
+        // A stopped pool fails the promise with CancelledError here, before the task starts
+        co_await resume_on(executor);
+        if constexpr (std::is_same_v<T, void>) {
+            co_await std::move(task);
+            promise.setValue(Void{});
+        } else {
+            promise.setValue(co_await std::move(task));
+        }
+    } catch (...) {
+        promise.setError(std::current_exception());
+    }
+}
+
+}  // namespace details
+
+// Starts the task in the executor, bridging it to the callback world.
+// The result is CancelledError, if the executor drops the task, e.g. a stopped pool.
+template <class T>
+AsyncResult<T> spawn(Executor executor, Task<T> task) {
+    auto [promise, future] = contract<T>();
+    details::fulfill<T>(executor, std::move(task), std::move(promise));
+    return details::AsyncResultAccess::make(executor, std::move(future));
+}
+
+#endif
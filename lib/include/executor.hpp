@@ -0,0 +1,169 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <queue>
+#include <mutex>
+
+#include "thread_pool_task_base.hpp"
+
+
+// Forward declare
+class ThreadPool;
+
+
+// Anything tasks can be submitted to via submit(std::unique_ptr<ITaskBase>).
+template <class E, class = void>
+struct is_executor : std::false_type { };
+
+template <class E>
+struct is_executor<E, std::void_t<
+    decltype(std::declval<E&>().submit(std::declval<std::unique_ptr<ITaskBase> >()))
+> > : std::true_type { };
+
+// Executors, backed by a thread pool, expose it via pool(), so that its timer can be used.
+template <class E, class = void>
+struct has_backing_pool : std::false_type { };
+
+template <class E>
+struct has_backing_pool<E, std::void_t<decltype(std::declval<E&>().pool())> > : std::true_type { };
+
+
+// =================================================== //
+// ==================== EXECUTORS ==================== //
+// =================================================== //
+
+// Runs tasks right away on the submitting thread.
+class InlineExecutor {
+public:
+    using Task = std::unique_ptr<ITaskBase>;
+
+    void submit(Task task) {
+        if (task->cancelled()) {
+            task->cancel();
+        } else {
+            task->run();
+        }
+    }
+
+    static InlineExecutor& instance() {
+        static InlineExecutor executor;
+        return executor;
+    }
+};
+
+
+// Queues tasks until the owner runs them, e.g. from an existing event loop.
+// Submission is thread safe; tasks run on whichever thread calls a run method.
+class ManualExecutor {
+public:
+    using Task = std::unique_ptr<ITaskBase>;
+
+    void submit(Task task) {
+        std::lock_guard guard(mtx_);
+        tasks_.push(std::move(task));
+    }
+
+    // Runs a single task if any. Returns whether a task has been run.
+    bool runOne() {
+        Task task = nullptr;
+        {
+            std::lock_guard guard(mtx_);
+            if (tasks_.empty()) {
+                return false;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+        InlineExecutor::instance().submit(std::move(task));
+        return true;
+    }
+
+    // Runs the tasks queued by the moment of the call, but not the ones they submit,
+    // so that a loop iteration is bounded. Returns the number of tasks run.
+    size_t runPending() {
+        std::queue<Task> batch;
+        {
+            std::lock_guard guard(mtx_);
+            std::swap(batch, tasks_);
+        }
+        size_t num_run = batch.size();
+        for (; !batch.empty(); batch.pop()) {
+            InlineExecutor::instance().submit(std::move(batch.front()));
+        }
+        return num_run;
+    }
+
+    // Runs tasks until the queue is empty, including the ones submitted meanwhile.
+    size_t runAll() {
+        size_t num_run = 0;
+        while (size_t batch = runPending()) {
+            num_run += batch;
+        }
+        return num_run;
+    }
+
+    size_t pending() const {
+        std::lock_guard guard(mtx_);
+        return tasks_.size();
+    }
+
+private:
+    mutable std::mutex mtx_;
+    std::queue<Task> tasks_;
+};
+
+
+// ================================================== //
+// ==================== EXECUTOR ==================== //
+// ================================================== //
+
+// A non-owning reference to an executor: ThreadPool, Strand, InlineExecutor, ManualExecutor
+// or anything else with submit(std::unique_ptr<ITaskBase>). Submission is a single indirect call,
+// so executors share no base class and pay for no virtual dispatch of their own.
+// The referenced executor must outlive every task submitted through the reference.
+class Executor {
+public:
+    using Task = std::unique_ptr<ITaskBase>;
+
+    // Refers to InlineExecutor by default
+    Executor() : Executor(InlineExecutor::instance()) {   }
+
+    template <class E, class = std::enable_if_t<is_executor<E>::value && !std::is_same_v<E, Executor> > >
+    Executor(E& executor)
+        : impl_(&executor)
+        , submit_(&submitTo<E>)
+        , pool_(backingPool(executor))
+    {   }
+
+    void submit(Task task) const { submit_(impl_, std::move(task)); }
+
+    bool operator==(const Executor& other) const { return impl_ == other.impl_; }
+    bool operator!=(const Executor& other) const { return impl_ != other.impl_; }
+
+    // The pool, which runs tasks of this executor, if any. Its timer serves deadlines.
+    ThreadPool* pool() const { return pool_; }
+
+private:
+    template <class E>
+    static void submitTo(void* impl, Task task) {
+        static_cast<E*>(impl)->submit(std::move(task));
+    }
+
+    template <class E>
+    static ThreadPool* backingPool(E& executor) {
+        if constexpr (std::is_same_v<E, ThreadPool>) {
+            return &executor;
+        } else if constexpr (has_backing_pool<E>::value) {
+            return &executor.pool();
+        } else {
+            return nullptr;
+        }
+    }
+
+private:
+    void* impl_;
+    void (*submit_)(void*, Task);
+    ThreadPool* pool_;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+#include "thread_pool_task_base.hpp"
+#include "thread_pool.hpp"
+
+
+namespace details {
+
+template <class Fun>
+class ForkTask : public StackTask {
+public:
+    explicit ForkTask(Fun& fun) : fun_(fun) {   }
+
+    void run() override {
+        try {
+            fun_();
+        } catch (...) {
+            error_ = std::current_exception();
+        }
+    }
+
+    void rethrowIfFailed() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    Fun& fun_;
+    std::exception_ptr error_;
+};
+
+}  // namespace details
+
+
+// Runs both callables, possibly in parallel, and returns once both have completed.
+// The second one is offered to the workers of the pool, while the first one runs inline.
+// Then the second one runs inline as well, unless a worker has stolen it; in that case
+// the calling worker helps with other tasks until it completes. Nothing is allocated,
+// so it is cheap enough for fine-grained recursion. Rethrows the error of the first
+// callable or, failing that, of the second one.
+template <class F, class G>
+void invoke_parallel(ThreadPool& pool, F&& first, G&& second) {
+    details::ForkTask<std::remove_reference_t<G> > forked(second);
+    forked.fork(pool);
+    try {
+        first();
+    } catch (...) {
+        // The second callable must not outlive the call
+        forked.join();
+        throw;
+    }
+    forked.join();
+    forked.rethrowIfFailed();
+}
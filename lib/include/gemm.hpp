@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+#include "thread_pool.hpp"
+
+
+// ============================================== //
+// ==================== GEMM ==================== //
+// ============================================== //
+
+// c = a * b for row-major matrices: a is m x k, b is k x n and c is m x n, where lda, ldb and ldc
+// are the row strides. Panels of a and b are packed for the caches, and 2D tiles of c are
+// distributed across the pool. The microkernel is chosen at runtime: AVX-512, AVX2 or portable.
+// Throws std::invalid_argument for negative sizes and strides shorter than a row.
+void parallel_gemm(ThreadPool& pool, int64_t m, int64_t n, int64_t k,
+                   const float* a, int64_t lda, const float* b, int64_t ldb, float* c, int64_t ldc);
+
+void parallel_gemm(ThreadPool& pool, int64_t m, int64_t n, int64_t k,
+                   const double* a, int64_t lda, const double* b, int64_t ldb, double* c, int64_t ldc);
+
+void parallel_gemm(ThreadPool& pool, int64_t m, int64_t n, int64_t k,
+                   const int64_t* a, int64_t lda, const int64_t* b, int64_t ldb, int64_t* c, int64_t ldc);
+
+// Instruction set of the microkernels: "avx512", "avx2" or "portable"
+const char* gemm_isa();
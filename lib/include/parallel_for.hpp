@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include "thread_pool.hpp"
+#include "fork_join.hpp"
+
+
+// ====================================================== //
+// ==================== PARTITIONERS ==================== //
+// ====================================================== //
+
+// Ranges are never split below the grain size.
+
+// Splits the range into one contiguous block per worker upfront.
+// The cheapest choice for uniform iterations on an otherwise idle pool.
+struct StaticPartitioner {
+    explicit StaticPartitioner(int64_t grain = 1) : grain(grain) {   }
+    int64_t grain;
+};
+
+// Workers grab chunks from a shared cursor. Chunks start large and shrink as the range
+// runs out: each one is a share of the remaining iterations, but no less than the grain.
+struct GuidedPartitioner {
+    explicit GuidedPartitioner(int64_t grain = 1) : grain(grain) {   }
+    int64_t grain;
+};
+
+// Lazy binary splitting: half of the range is offered for stealing, while the other half
+// runs chunk by chunk. It is only split further once a worker has stolen the offered half,
+// so the number of splits follows the actual parallelism rather than the range size.
+struct AutoPartitioner {
+    explicit AutoPartitioner(int64_t grain = 1) : grain(grain) {   }
+    int64_t grain;
+};
+
+
+namespace details {
+
+template <class Body>
+void runChunk(Body& body, int64_t begin, int64_t end) {
+    if constexpr (std::is_invocable_v<Body&, int64_t, int64_t>) {
+        body(begin, end);
+    } else {
+        for (int64_t idx = begin; idx < end; ++idx) {
+            body(idx);
+        }
+    }
+}
+
+// Runs fun(first), ..., fun(last - 1) via fork-join, so that idle workers may pick them up.
+template <class Fun>
+void forkEach(ThreadPool& pool, int64_t first, int64_t last, Fun& fun) {
+    if (last - first == 1) {
+        fun(first);
+        return;
+    }
+    int64_t mid = first + (last - first) / 2;
+    invoke_parallel(pool,
+        [&]() { forkEach(pool, first, mid, fun); },
+        [&]() { forkEach(pool, mid, last, fun); });
+}
+
+template <class Body>
+void partition(ThreadPool& pool, int64_t begin, int64_t end, Body& body, const StaticPartitioner& partitioner) {
+    const int64_t size = end - begin;
+    const int64_t num_blocks = std::clamp<int64_t>(size / partitioner.grain, 1, std::max(pool.size(), 1));
+    auto run_block = [&](int64_t block) {
+        runChunk(body, begin + size * block / num_blocks, begin + size * (block + 1) / num_blocks);
+    };
+    forkEach(pool, 0, num_blocks, run_block);
+}
+
+template <class Body>
+void partition(ThreadPool& pool, int64_t begin, int64_t end, Body& body, const GuidedPartitioner& partitioner) {
+    const int64_t num_participants = std::max(pool.size(), 1);
+    std::atomic<int64_t> cursor { begin };
+    auto participate = [&](int64_t) {
+        for (;;) {
+            int64_t chunk_begin = cursor.load(std::memory_order_relaxed);
+            int64_t chunk_end = 0;
+            do {
+                if (chunk_begin >= end) {
+                    return;
+                }
+                int64_t chunk = std::max((end - chunk_begin) / (2 * num_participants), partitioner.grain);
+                chunk_end = std::min(chunk_begin + chunk, end);
+            } while (!cursor.compare_exchange_weak(chunk_begin, chunk_end, std::memory_order_relaxed));
+            runChunk(body, chunk_begin, chunk_end);
+        }
+    };
+    forkEach(pool, 0, num_participants, participate);
+}
+
+template <class Body>
+void runAdaptive(ThreadPool& pool, int64_t begin, int64_t end, Body& body, int64_t grain) {
+    if (end - begin <= grain) {
+        runChunk(body, begin, end);
+        return;
+    }
+    const int64_t mid = begin + (end - begin) / 2;
+    auto run_right = [&]() { runAdaptive(pool, mid, end, body, grain); };
+    ForkTask<decltype(run_right)> right(run_right);
+    right.fork(pool);
+    int64_t cursor = begin;
+    try {
+        while (cursor < mid) {
+            if (right.stolen()) {
+                // A worker is idle enough to steal, so the rest of this half gets split as well
+                runAdaptive(pool, cursor, mid, body, grain);
+                break;
+            }
+            int64_t chunk_end = std::min(cursor + grain, mid);
+            runChunk(body, cursor, chunk_end);
+            cursor = chunk_end;
+        }
+    } catch (...) {
+        right.join();
+        throw;
+    }
+    right.join();
+    right.rethrowIfFailed();
+}
+
+template <class Body>
+void partition(ThreadPool& pool, int64_t begin, int64_t end, Body& body, const AutoPartitioner& partitioner) {
+    runAdaptive(pool, begin, end, body, partitioner.grain);
+}
+
+}  // namespace details
+
+
+// ====================================================== //
+// ==================== PARALLEL FOR ==================== //
+// ====================================================== //
+
+// Runs the body for every index of [begin, end) in the pool and returns once all of them
+// are done. The calling thread takes part in the work. The body is either called per index,
+// body(idx), or per chunk, body(chunk_begin, chunk_end), whichever it accepts.
+// Rethrows an error of the body, if any; the iterations, that have not started yet, may be skipped.
+template <class Body, class Partitioner = AutoPartitioner>
+void parallel_for(ThreadPool& pool, int64_t begin, int64_t end, Body&& body, Partitioner partitioner = Partitioner()) {
+    if (partitioner.grain <= 0) {
+        throw std::invalid_argument("Grain size must be positive");
+    }
+    if (begin >= end) {
+        return;
+    }
+    details::partition(pool, begin, end, body, partitioner);
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../private/cache_aligned.hpp"
+#include "thread_pool.hpp"
+#include "parallel_for.hpp"
+
+
+// How partial results are combined.
+enum class ReduceOrder {
+    // Chunk results are accumulated per worker in whatever order the chunks complete,
+    // then the per-worker results are combined. The combine has to be commutative,
+    // and floating-point results may differ from run to run.
+    Any,
+    // The range is cut into blocks of the grain size, which are combined by a fixed tree.
+    // The result only depends on the range and the grain, not on the pool or the timing.
+    Deterministic,
+};
+
+
+namespace details {
+
+constexpr int64_t kDefaultReduceGrain = 1024;
+
+// Combines the values pairwise: 0 with 1, 2 with 3, then 0 with 2, and so on.
+template <class T, class Combine>
+std::optional<T> combineTree(std::vector<std::optional<T> >& values, Combine& combine) {
+    const size_t size = values.size();
+    for (size_t stride = 1; stride < size; stride *= 2) {
+        for (size_t idx = 0; idx + stride < size; idx += 2 * stride) {
+            std::optional<T>& lhs = values[idx];
+            std::optional<T>& rhs = values[idx + stride];
+            if (!lhs) {
+                lhs = std::move(rhs);
+            } else if (rhs) {
+                lhs = combine(std::move(*lhs), std::move(*rhs));
+            }
+        }
+    }
+    return size == 0 ? std::nullopt : std::move(values[0]);
+}
+
+// Reduces non-empty chunks via chunk_fn(chunk_begin, chunk_end) and combines their results.
+// Returns nullopt for an empty range.
+template <class T, class ChunkFn, class Combine>
+std::optional<T> reduceChunks(ThreadPool& pool, int64_t begin, int64_t end,
+                              ChunkFn& chunk_fn, Combine& combine, ReduceOrder order, int64_t grain)
+{
+    if (grain <= 0) {
+        throw std::invalid_argument("Grain size must be positive");
+    }
+    if (begin >= end) {
+        return std::nullopt;
+    }
+    if (order == ReduceOrder::Deterministic) {
+        const int64_t num_blocks = (end - begin + grain - 1) / grain;
+        std::vector<std::optional<T> > blocks(num_blocks);
+        parallel_for(pool, 0, num_blocks, [&](int64_t block) {
+            blocks[block].emplace(chunk_fn(begin + block * grain, std::min(begin + (block + 1) * grain, end)));
+        });
+        return combineTree(blocks, combine);
+    }
+    // The last slot is for the calling thread, unless it is a worker of the pool
+    const int num_slots = pool.size() + 1;
+    std::vector<CacheAligned<std::optional<T> > > slots(num_slots);
+    parallel_for(pool, begin, end, [&](int64_t chunk_begin, int64_t chunk_end) {
+        T partial = chunk_fn(chunk_begin, chunk_end);
+        int worker = pool.currentWorker();
+        std::optional<T>& slot = slots[worker >= 0 ? worker : num_slots - 1].value;
+        if (slot) {
+            slot = combine(std::move(*slot), std::move(partial));
+        } else {
+            slot.emplace(std::move(partial));
+        }
+    }, AutoPartitioner(grain));
+    std::vector<std::optional<T> > partials;
+    partials.reserve(num_slots);
+    for (auto& slot : slots) {
+        partials.push_back(std::move(slot.value));
+    }
+    return combineTree(partials, combine);
+}
+
+template <class Iterator>
+using EnableIfIterator = std::enable_if_t<!std::is_integral_v<Iterator>, int>;
+
+}  // namespace details
+
+
+// ========================================================= //
+// ==================== PARALLEL REDUCE ==================== //
+// ========================================================= //
+
+// reduce(chunk_begin, chunk_end, acc) folds a chunk of indices into the accumulator,
+// which starts from the identity for every chunk. combine(lhs, rhs) merges two partial results.
+// Returns the identity for an empty range.
+template <class T, class Reduce, class Combine>
+T parallel_reduce(ThreadPool& pool, int64_t begin, int64_t end, T identity, Reduce&& reduce, Combine&& combine,
+                  ReduceOrder order = ReduceOrder::Any, int64_t grain = details::kDefaultReduceGrain)
+{
+    auto chunk_fn = [&](int64_t chunk_begin, int64_t chunk_end) -> T {
+        return reduce(chunk_begin, chunk_end, T(identity));
+    };
+    std::optional<T> result = details::reduceChunks<T>(pool, begin, end, chunk_fn, combine, order, grain);
+    return result ? std::move(*result) : std::move(identity);
+}
+
+// The same over random access iterators: reduce(chunk_first, chunk_last, acc).
+template <class Iterator, class T, class Reduce, class Combine, details::EnableIfIterator<Iterator> = 0>
+T parallel_reduce(ThreadPool& pool, Iterator first, Iterator last, T identity, Reduce&& reduce, Combine&& combine,
+                  ReduceOrder order = ReduceOrder::Any, int64_t grain = details::kDefaultReduceGrain)
+{
+    return parallel_reduce(pool, int64_t(0), static_cast<int64_t>(std::distance(first, last)), std::move(identity),
+        [&](int64_t chunk_begin, int64_t chunk_end, T acc) {
+            return reduce(first + chunk_begin, first + chunk_end, std::move(acc));
+        }, combine, order, grain);
+}
+
+
+// =================================================================== //
+// ==================== PARALLEL TRANSFORM REDUCE ==================== //
+// =================================================================== //
+
+// Like std::transform_reduce: reduce(init, transform(begin), ..., transform(end - 1)) in unspecified
+// order, with every index transformed via transform(idx). The reduce has to be associative.
+template <class T, class Reduce, class Transform>
+T parallel_transform_reduce(ThreadPool& pool, int64_t begin, int64_t end, T init, Reduce&& reduce, Transform&& transform,
+                            ReduceOrder order = ReduceOrder::Any, int64_t grain = details::kDefaultReduceGrain)
+{
+    auto chunk_fn = [&](int64_t chunk_begin, int64_t chunk_end) -> T {
+        T acc = transform(chunk_begin);
+        for (int64_t idx = chunk_begin + 1; idx < chunk_end; ++idx) {
+            acc = reduce(std::move(acc), transform(idx));
+        }
+        return acc;
+    };
+    std::optional<T> result = details::reduceChunks<T>(pool, begin, end, chunk_fn, reduce, order, grain);
+    return result ? reduce(std::move(init), std::move(*result)) : std::move(init);
+}
+
+// The same over random access iterators, with every element transformed via transform(*it).
+template <class Iterator, class T, class Reduce, class Transform, details::EnableIfIterator<Iterator> = 0>
+T parallel_transform_reduce(ThreadPool& pool, Iterator first, Iterator last, T init, Reduce&& reduce, Transform&& transform,
+                            ReduceOrder order = ReduceOrder::Any, int64_t grain = details::kDefaultReduceGrain)
+{
+    return parallel_transform_reduce(pool, int64_t(0), static_cast<int64_t>(std::distance(first, last)), std::move(init),
+        reduce, [&](int64_t idx) -> T { return transform(first[idx]); }, order, grain);
+}
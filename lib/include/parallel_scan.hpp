@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../private/scan_kernel.hpp"
+#include "thread_pool.hpp"
+#include "parallel_for.hpp"
+
+
+namespace details {
+
+// Smaller ranges are scanned in one pass by the calling thread
+constexpr int64_t kScanBlockSize = 1 << 14;
+
+// Sums of arithmetic types over contiguous memory go through the vector kernels
+template <class T, class InIt, class OutIt, class Op>
+constexpr bool useSimdScan() {
+    return Lanes<T>::kSupported && isPlus<T, Op>() && isContiguous<InIt>() && isContiguous<OutIt>()
+        && std::is_same_v<typename std::iterator_traits<InIt>::value_type, T>
+        && std::is_same_v<typename std::iterator_traits<OutIt>::value_type, T>;
+}
+
+// Folds a non-empty block from left to right.
+template <class T, class InIt, class Op>
+T reduceBlock(InIt first, InIt last, Op& op) {
+    if constexpr (useSimdScan<T, InIt, T*, Op>()) {
+        return reducePlus<T>(&*first, last - first, T(0));
+    } else {
+        T acc = *first;
+        for (++first; first != last; ++first) {
+            acc = op(std::move(acc), *first);
+        }
+        return acc;
+    }
+}
+
+// Scans a block starting from the carry, which is the fold of everything to the left.
+// Only an inclusive scan of the first block has no carry.
+template <class T, class InIt, class OutIt, class Op>
+void scanBlock(InIt first, InIt last, OutIt out, std::optional<T> carry, Op& op, bool inclusive) {
+    if (first == last) {
+        return;
+    }
+    if constexpr (useSimdScan<T, InIt, OutIt, Op>()) {
+        scanPlus<T>(&*first, &*out, last - first, carry.value_or(T(0)), inclusive);
+    } else {
+        if (!carry) {
+            carry.emplace(*first);
+            *out = *carry;
+            ++first;
+            ++out;
+        }
+        T acc = std::move(*carry);
+        for (; first != last; ++first, ++out) {
+            // The output may alias the input
+            T value = *first;
+            if (inclusive) {
+                acc = op(std::move(acc), std::move(value));
+                *out = acc;
+            } else {
+                *out = acc;
+                acc = op(std::move(acc), std::move(value));
+            }
+        }
+    }
+}
+
+// Two passes over blocks: the first one folds every block but the last, then the carries are
+// scanned sequentially, and the second pass scans every block from its carry.
+template <class T, class InIt, class OutIt, class Op>
+OutIt blockedScan(ThreadPool& pool, InIt first, InIt last, OutIt out, Op& op, std::optional<T> init, bool inclusive) {
+    const int64_t size = last - first;
+    const int64_t num_blocks = std::clamp<int64_t>(size / kScanBlockSize, 1, 4 * std::max(pool.size(), 1));
+    if (num_blocks == 1) {
+        scanBlock<T>(first, last, out, std::move(init), op, inclusive);
+        return out + size;
+    }
+    auto block_begin = [size, num_blocks](int64_t block) { return size * block / num_blocks; };
+
+    std::vector<std::optional<T> > carries(num_blocks);
+    parallel_for(pool, 1, num_blocks, [&](int64_t block) {
+        carries[block].emplace(reduceBlock<T>(first + block_begin(block - 1), first + block_begin(block), op));
+    });
+    carries[0] = std::move(init);
+    for (int64_t block = 1; block < num_blocks; ++block) {
+        if (carries[block - 1]) {
+            carries[block] = op(*carries[block - 1], std::move(*carries[block]));
+        }
+    }
+
+    parallel_for(pool, 0, num_blocks, [&](int64_t block) {
+        scanBlock<T>(first + block_begin(block), first + block_begin(block + 1), out + block_begin(block),
+                     std::move(carries[block]), op, inclusive);
+    });
+    return out + size;
+}
+
+}  // namespace details
+
+
+// ======================================================= //
+// ==================== PARALLEL SCAN ==================== //
+// ======================================================= //
+
+// Like std::inclusive_scan: out[idx] = op(first[0], ..., first[idx]) over random access iterators.
+// The op has to be associative, but not commutative. Returns the end of the output.
+// out may be equal to first, and sums of arithmetic types use SSE2 within blocks,
+// so floating-point results may differ from a sequential scan by rounding.
+template <class InIt, class OutIt, class Op = std::plus<> >
+OutIt parallel_inclusive_scan(ThreadPool& pool, InIt first, InIt last, OutIt out, Op op = Op()) {
+    using T = typename std::iterator_traits<InIt>::value_type;
+    return details::blockedScan<T>(pool, first, last, out, op, std::optional<T>(), true);
+}
+
+// The same, with init as the leftmost operand.
+template <class InIt, class OutIt, class Op, class T>
+OutIt parallel_inclusive_scan(ThreadPool& pool, InIt first, InIt last, OutIt out, Op op, T init) {
+    return details::blockedScan<T>(pool, first, last, out, op, std::optional<T>(std::move(init)), true);
+}
+
+// Like std::exclusive_scan: out[idx] = op(init, first[0], ..., first[idx - 1]).
+template <class InIt, class OutIt, class T, class Op = std::plus<> >
+OutIt parallel_exclusive_scan(ThreadPool& pool, InIt first, InIt last, OutIt out, T init, Op op = Op()) {
+    return details::blockedScan<T>(pool, first, last, out, op, std::optional<T>(std::move(init)), false);
+}
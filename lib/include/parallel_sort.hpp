@@ -0,0 +1,295 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.hpp"
+#include "fork_join.hpp"
+#include "parallel_for.hpp"
+
+
+namespace details {
+
+// Ranges up to this size are sorted sequentially
+constexpr int64_t kSortCutoff = 1 << 14;
+// Sample elements per splitter
+constexpr int64_t kOversampling = 16;
+// Enough buckets to get near the cutoff in one pass for most inputs
+constexpr int64_t kMaxSplitters = 1024;
+// Sample sort recursion is bounded, std::sort takes over below
+constexpr int kMaxSampleSortDepth = 4;
+
+// A few blocks per worker, but none smaller than the cutoff
+inline int64_t numSortBlocks(ThreadPool& pool, int64_t size) {
+    return std::clamp<int64_t>(size / kSortCutoff, 1, 4 * std::max(pool.size(), 1));
+}
+
+// Moves [first, last) to out in parallel.
+template <class InIt, class OutIt>
+void parallelMove(ThreadPool& pool, InIt first, InIt last, OutIt out) {
+    parallel_for(pool, 0, last - first, [&](int64_t begin, int64_t end) {
+        std::move(first + begin, first + end, out + begin);
+    }, AutoPartitioner(kSortCutoff));
+}
+
+
+// ===================================================== //
+// ==================== SAMPLE SORT ==================== //
+// ===================================================== //
+
+// Elements are classified by a sorted sample of splitters into range buckets, which lie
+// between adjacent splitters, and equality buckets, which hold the elements equal to a splitter
+// and need no sorting. So heavy duplicates do not produce huge buckets.
+// Every block of the input is classified and scattered into the buffer in parallel.
+template <class Iterator, class Compare>
+void sampleSort(ThreadPool& pool, Iterator first, Iterator last, Compare& comp, int depth) {
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    const int64_t size = last - first;
+    if (size <= kSortCutoff || depth == 0) {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    // Choose the splitters from an evenly spaced sample
+    const int64_t num_blocks = numSortBlocks(pool, size);
+    const int64_t num_samples = std::clamp<int64_t>(size / kSortCutoff, 1, kMaxSplitters) * kOversampling;
+    std::vector<T> splitters;
+    splitters.reserve(num_samples);
+    for (int64_t idx = 0; idx < num_samples; ++idx) {
+        splitters.push_back(first[(2 * idx + 1) * size / (2 * num_samples)]);
+    }
+    std::sort(splitters.begin(), splitters.end(), comp);
+    int64_t num_splitters = 0;
+    for (int64_t idx = kOversampling / 2; idx < num_samples; idx += kOversampling) {
+        // Equal splitters are merged
+        if (num_splitters == 0 || comp(splitters[num_splitters - 1], splitters[idx])) {
+            splitters[num_splitters++] = std::move(splitters[idx]);
+        }
+    }
+    splitters.resize(num_splitters);
+    const int64_t num_buckets = 2 * num_splitters + 1;
+
+    // Bucket 2k lies below splitter k, bucket 2k + 1 is equal to it
+    auto bucket_of = [&splitters, &comp](const T& value) -> uint16_t {
+        auto iter = std::lower_bound(splitters.begin(), splitters.end(), value, comp);
+        int64_t idx = iter - splitters.begin();
+        bool equal = iter != splitters.end() && !comp(value, *iter);
+        return static_cast<uint16_t>(2 * idx + (equal ? 1 : 0));
+    };
+    auto block_begin = [size, num_blocks](int64_t block) { return size * block / num_blocks; };
+
+    std::vector<uint16_t> buckets(size);
+    std::vector<int64_t> offsets(num_blocks * num_buckets, 0);
+    parallel_for(pool, 0, num_blocks, [&](int64_t block) {
+        int64_t* counts = &offsets[block * num_buckets];
+        for (int64_t idx = block_begin(block); idx < block_begin(block + 1); ++idx) {
+            buckets[idx] = bucket_of(first[idx]);
+            ++counts[buckets[idx]];
+        }
+    });
+    // Bucket by bucket, block by block
+    std::vector<int64_t> bucket_begin(num_buckets + 1, 0);
+    int64_t offset = 0;
+    for (int64_t bucket = 0; bucket < num_buckets; ++bucket) {
+        bucket_begin[bucket] = offset;
+        for (int64_t block = 0; block < num_blocks; ++block) {
+            int64_t count = offsets[block * num_buckets + bucket];
+            offsets[block * num_buckets + bucket] = offset;
+            offset += count;
+        }
+    }
+    bucket_begin[num_buckets] = offset;
+
+    std::vector<T> buffer(size);
+    parallel_for(pool, 0, num_blocks, [&](int64_t block) {
+        int64_t* positions = &offsets[block * num_buckets];
+        for (int64_t idx = block_begin(block); idx < block_begin(block + 1); ++idx) {
+            buffer[positions[buckets[idx]]++] = std::move(first[idx]);
+        }
+    });
+
+    parallel_for(pool, 0, num_buckets, [&](int64_t bucket) {
+        auto bucket_first = buffer.begin() + bucket_begin[bucket];
+        auto bucket_last = buffer.begin() + bucket_begin[bucket + 1];
+        Iterator out = first + bucket_begin[bucket];
+        std::move(bucket_first, bucket_last, out);
+        if (bucket % 2 == 0) {
+            sampleSort(pool, out, out + (bucket_last - bucket_first), comp, depth - 1);
+        }
+    });
+}
+
+
+// ==================================================== //
+// ==================== MERGE SORT ==================== //
+// ==================================================== //
+
+// Stable: elements of the first range precede the equal elements of the second one.
+template <class InIt, class OutIt, class Compare>
+void parallelMerge(ThreadPool& pool, InIt first1, InIt last1, InIt first2, InIt last2, OutIt out, Compare& comp) {
+    const int64_t size1 = last1 - first1;
+    const int64_t size2 = last2 - first2;
+    if (size1 + size2 <= kSortCutoff) {
+        std::merge(std::make_move_iterator(first1), std::make_move_iterator(last1),
+                   std::make_move_iterator(first2), std::make_move_iterator(last2), out, comp);
+        return;
+    }
+    // Split the larger range in halves, and the other one around its middle element
+    InIt mid1, mid2;
+    if (size1 >= size2) {
+        mid1 = first1 + size1 / 2;
+        mid2 = std::lower_bound(first2, last2, *mid1, comp);
+    } else {
+        mid2 = first2 + size2 / 2;
+        mid1 = std::upper_bound(first1, last1, *mid2, comp);
+    }
+    OutIt out_mid = out + (mid1 - first1) + (mid2 - first2);
+    invoke_parallel(pool,
+        [&]() { parallelMerge(pool, first1, mid1, first2, mid2, out, comp); },
+        [&]() { parallelMerge(pool, mid1, last1, mid2, last2, out_mid, comp); });
+}
+
+// Sorts [first, last) and leaves the result either in place or in the buffer.
+template <class Iterator, class BufIt, class Compare>
+void mergeSort(ThreadPool& pool, Iterator first, Iterator last, BufIt buffer, Compare& comp, bool in_place) {
+    const int64_t size = last - first;
+    if (size <= kSortCutoff) {
+        std::stable_sort(first, last, comp);
+        if (!in_place) {
+            std::move(first, last, buffer);
+        }
+        return;
+    }
+    const int64_t half = size / 2;
+    // The halves go to the other place, so that they are merged into the requested one
+    invoke_parallel(pool,
+        [&]() { mergeSort(pool, first, first + half, buffer, comp, !in_place); },
+        [&]() { mergeSort(pool, first + half, last, buffer + half, comp, !in_place); });
+    if (in_place) {
+        parallelMerge(pool, buffer, buffer + half, buffer + half, buffer + size, first, comp);
+    } else {
+        parallelMerge(pool, first, first + half, first + half, last, buffer, comp);
+    }
+}
+
+
+// ==================================================== //
+// ==================== RADIX SORT ==================== //
+// ==================================================== //
+
+// Least significant digit first, one byte per pass. Every pass counts the digits of each block,
+// then scatters the blocks to their offsets in parallel, which keeps the passes stable.
+// Passes, where all keys share the digit, are skipped.
+template <class Iterator>
+void radixSort(ThreadPool& pool, Iterator first, Iterator last) {
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    using Key = std::make_unsigned_t<T>;
+    constexpr int kDigitBits = 8;
+    constexpr int64_t kNumDigits = 1 << kDigitBits;
+    constexpr int kNumPasses = sizeof(T);
+
+    const int64_t size = last - first;
+    const int64_t num_blocks = numSortBlocks(pool, size);
+    auto block_begin = [size, num_blocks](int64_t block) { return size * block / num_blocks; };
+    auto digit_of = [](T value, int shift) -> int64_t {
+        Key key = static_cast<Key>(value);
+        if constexpr (std::is_signed_v<T>) {
+            // Negative numbers go first
+            key ^= Key(1) << (std::numeric_limits<Key>::digits - 1);
+        }
+        return (key >> shift) & (kNumDigits - 1);
+    };
+
+    std::vector<T> buffer(size);
+    std::vector<int64_t> offsets(num_blocks * kNumDigits);
+    auto run_pass = [&](auto src, auto dst, int shift) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        parallel_for(pool, 0, num_blocks, [&](int64_t block) {
+            int64_t* counts = &offsets[block * kNumDigits];
+            for (int64_t idx = block_begin(block); idx < block_begin(block + 1); ++idx) {
+                ++counts[digit_of(src[idx], shift)];
+            }
+        });
+        // All keys share the digit iff every one of them has the digit of the first key
+        const int64_t first_digit = digit_of(src[0], shift);
+        int64_t first_digit_total = 0;
+        for (int64_t block = 0; block < num_blocks; ++block) {
+            first_digit_total += offsets[block * kNumDigits + first_digit];
+        }
+        if (first_digit_total == size) {
+            return false;
+        }
+        int64_t offset = 0;
+        for (int64_t digit = 0; digit < kNumDigits; ++digit) {
+            for (int64_t block = 0; block < num_blocks; ++block) {
+                int64_t count = offsets[block * kNumDigits + digit];
+                offsets[block * kNumDigits + digit] = offset;
+                offset += count;
+            }
+        }
+        parallel_for(pool, 0, num_blocks, [&](int64_t block) {
+            int64_t* positions = &offsets[block * kNumDigits];
+            for (int64_t idx = block_begin(block); idx < block_begin(block + 1); ++idx) {
+                dst[positions[digit_of(src[idx], shift)]++] = src[idx];
+            }
+        });
+        return true;
+    };
+
+    bool in_buffer = false;
+    for (int pass = 0; pass < kNumPasses; ++pass) {
+        int shift = pass * kDigitBits;
+        bool moved = in_buffer ? run_pass(buffer.begin(), first, shift) : run_pass(first, buffer.begin(), shift);
+        in_buffer = in_buffer != moved;
+    }
+    if (in_buffer) {
+        parallelMove(pool, buffer.begin(), buffer.end(), first);
+    }
+}
+
+}  // namespace details
+
+
+// ======================================================= //
+// ==================== PARALLEL SORT ==================== //
+// ======================================================= //
+
+// Parallel sample sort over random access iterators. Falls back to std::sort for small ranges.
+// Elements must be default constructible, since a buffer of the same size is used.
+template <class Iterator, class Compare>
+void parallel_sort(ThreadPool& pool, Iterator first, Iterator last, Compare comp) {
+    details::sampleSort(pool, first, last, comp, details::kMaxSampleSortDepth);
+}
+
+// Integers are sorted by a parallel LSD radix sort, anything else as above via operator<.
+template <class Iterator>
+void parallel_sort(ThreadPool& pool, Iterator first, Iterator last) {
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool>) {
+        if (last - first > details::kSortCutoff) {
+            details::radixSort(pool, first, last);
+        } else {
+            std::sort(first, last);
+        }
+    } else {
+        parallel_sort(pool, first, last, std::less<T>());
+    }
+}
+
+// Parallel merge sort, that keeps equal elements in their original order.
+template <class Iterator, class Compare = std::less<> >
+void parallel_stable_sort(ThreadPool& pool, Iterator first, Iterator last, Compare comp = Compare()) {
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    if (last - first <= details::kSortCutoff) {
+        std::stable_sort(first, last, comp);
+        return;
+    }
+    std::vector<T> buffer(last - first);
+    details::mergeSort(pool, first, last, buffer.begin(), comp, true);
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "../private/type_traits.hpp"
+#include "async_result.hpp"
+#include "contract.hpp"
+#include "executor.hpp"
+
+
+enum class StageMode {
+    // Any number of items at once, in any order
+    Parallel,
+    // One item at a time, in the order produced by the source
+    SerialInOrder,
+    // One item at a time, in any order
+    SerialOutOfOrder,
+};
+
+// Lets the source of a pipeline signal the end of input.
+class FlowControl {
+public:
+    void stop() { stopped_ = true; }
+    bool stopped() const { return stopped_; }
+
+private:
+    bool stopped_ = false;
+};
+
+struct StageStats {
+    StageMode mode;
+    uint64_t items;
+    // Total time spent in the stage callable
+    std::chrono::nanoseconds busy;
+    // Total time items spent waiting for the stage: either for a worker or for their turn in a serial stage
+    std::chrono::nanoseconds queued;
+};
+
+struct PipelineStats {
+    // The source goes first
+    std::vector<StageStats> stages;
+    std::chrono::nanoseconds elapsed;
+};
+
+
+namespace details {
+
+struct PipelineItemBase {
+    virtual ~PipelineItemBase() = default;
+};
+
+template <class T>
+struct PipelineItem : PipelineItemBase {
+    explicit PipelineItem(T value) : value(std::move(value)) {   }
+    T value;
+};
+
+struct PipelineToken {
+    // Position of the item in the source output
+    uint64_t seq;
+    std::unique_ptr<PipelineItemBase> item;
+    // When the token became ready for its current stage
+    std::chrono::steady_clock::time_point ready_at;
+};
+
+struct StageCounters {
+    StageStats snapshot(StageMode mode) const;
+
+    std::atomic<uint64_t> items { 0 };
+    std::atomic<int64_t> busy_ns { 0 };
+    std::atomic<int64_t> queued_ns { 0 };
+};
+
+class PipelineSource {
+public:
+    virtual ~PipelineSource() = default;
+    // Returns nullptr once the input is over
+    virtual std::unique_ptr<PipelineItemBase> produce(FlowControl& flow) = 0;
+
+    StageCounters counters;
+};
+
+class PipelineStage {
+public:
+    explicit PipelineStage(StageMode mode) : mode(mode) {   }
+    virtual ~PipelineStage() = default;
+    // Replaces the item of the token with the output of the stage
+    virtual void apply(PipelineToken& token) = 0;
+
+    const StageMode mode;
+    StageCounters counters;
+
+    // Serial stages only
+    std::mutex mtx;
+    // Whether some token is in the stage
+    bool busy = false;
+    // The next token to enter an in-order stage
+    uint64_t next_seq = 0;
+    // Tokens waiting for their turn, ordered by seq
+    std::map<uint64_t, PipelineToken> parked;
+};
+
+template <class T>
+class SourceStage : public PipelineSource {
+public:
+    explicit SourceStage(FunctionType<T, FlowControl&> func) : func_(std::move(func)) {   }
+
+    std::unique_ptr<PipelineItemBase> produce(FlowControl& flow) override {
+        T value = func_(flow);
+        if (flow.stopped()) {
+            return nullptr;
+        }
+        return std::make_unique<PipelineItem<T> >(std::move(value));
+    }
+
+private:
+    FunctionType<T, FlowControl&> func_;
+};
+
+template <class In, class Out>
+class TransformStage : public PipelineStage {
+public:
+    TransformStage(StageMode mode, FunctionType<Out, In> func)
+        : PipelineStage(mode)
+        , func_(std::move(func))
+    {   }
+
+    void apply(PipelineToken& token) override {
+        auto& input = static_cast<PipelineItem<PhysicalType<In> >&>(*token.item);
+        if constexpr (std::is_same_v<Out, void>) {
+            call(input);
+            token.item = std::make_unique<PipelineItem<Void> >(Void{});
+        } else if constexpr (std::is_same_v<In, Out> && std::is_move_assignable_v<Out>) {
+            // Reuse the item
+            input.value = call(input);
+        } else {
+            token.item = std::make_unique<PipelineItem<Out> >(call(input));
+        }
+    }
+
+private:
+    decltype(auto) call(PipelineItem<PhysicalType<In> >& input) {
+        if constexpr (std::is_same_v<In, void>) {
+            return func_();
+        } else {
+            return func_(std::move(input.value));
+        }
+    }
+
+private:
+    FunctionType<Out, In> func_;
+};
+
+// Runs the pipeline on the executor and resolves the promise once it is over
+void startPipeline(Executor executor,
+                   std::unique_ptr<PipelineSource> source,
+                   std::vector<std::unique_ptr<PipelineStage> > stages,
+                   size_t max_tokens,
+                   Promise<PipelineStats> promise);
+
+}  // namespace details
+
+
+// ================================================== //
+// ==================== PIPELINE ==================== //
+// ================================================== //
+
+// Staged processing of a stream of items, produced by a serial source.
+// Each item is carried through the stages by a token: a parallel stage runs the item
+// on the worker that brought it there, so an item tends to stay in the cache of one worker,
+// and a serial stage admits one token at a time, parking the rest. At most max_tokens items
+// are in flight, so a slow stage holds back the source instead of accumulating a backlog.
+// Built by make_pipeline(...).stage<...>(...)...run(max_tokens).
+template <class T>
+class Pipeline {
+
+template <class U> friend class Pipeline;
+template <class U> friend Pipeline<U> make_pipeline(Executor executor, FunctionType<U, FlowControl&> source);
+
+private:
+    Pipeline(Executor executor,
+             std::unique_ptr<details::PipelineSource> source,
+             std::vector<std::unique_ptr<details::PipelineStage> > stages)
+        : executor_(executor)
+        , source_(std::move(source))
+        , stages_(std::move(stages))
+    {   }
+
+public:
+    // Appends a stage, that converts T into Ret.
+    // Invalidates the object.
+    template <class Ret>
+    Pipeline<Ret> stage(StageMode mode, FunctionType<Ret, T> func) {
+        stages_.push_back(std::make_unique<details::TransformStage<T, Ret> >(mode, std::move(func)));
+        return Pipeline<Ret>{executor_, std::move(source_), std::move(stages_)};
+    }
+
+    // Runs the pipeline until the source stops, or one of the stages throws.
+    // The executor must outlive the run. If it drops the tasks of the pipeline, e.g. a pool
+    // that stops meanwhile, the run fails with CancelledError.
+    // Invalidates the object.
+    AsyncResult<PipelineStats> run(size_t max_tokens) {
+        if (max_tokens == 0) {
+            throw std::invalid_argument("Pipeline requires a positive number of tokens");
+        }
+        auto [promise, future] = contract<PipelineStats>();
+        details::startPipeline(executor_, std::move(source_), std::move(stages_), max_tokens, std::move(promise));
+        return details::AsyncResultAccess::make(executor_, std::move(future));
+    }
+
+private:
+    Executor executor_;
+    std::unique_ptr<details::PipelineSource> source_;
+    std::vector<std::unique_ptr<details::PipelineStage> > stages_;
+};
+
+// The source is called serially until it calls FlowControl::stop, and its return value is ignored then.
+template <class T>
+Pipeline<T> make_pipeline(Executor executor, FunctionType<T, FlowControl&> source) {
+    static_assert(!std::is_same_v<T, void>, "Pipeline source must produce values");
+    return Pipeline<T>{executor, std::make_unique<details::SourceStage<T> >(std::move(source)), {}};
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+
+#include "../private/broadcast_state.hpp"
+#include "../private/async_task.hpp"
+#include "../private/type_traits.hpp"
+#include "async_result.hpp"
+#include "thread_pool.hpp"
+
+
+template <class T>
+class SharedAsyncResult {
+
+template <class U> friend class AsyncResult;
+
+using StateType = details::BroadcastState<PhysicalType<T> >;
+
+private:
+    SharedAsyncResult(Executor executor, std::shared_ptr<StateType> state)
+        : state_(std::move(state))
+        , executor_(executor)
+    {    }
+
+public:
+    SharedAsyncResult() : state_(), executor_() { }
+    SharedAsyncResult(const SharedAsyncResult&) = default;
+    SharedAsyncResult(SharedAsyncResult&&) = default;
+    SharedAsyncResult& operator=(const SharedAsyncResult&) = default;
+    SharedAsyncResult& operator=(SharedAsyncResult&&) = default;
+
+    // Synchronously wait for the result to be produced.
+    void wait() const;
+
+    // Synchronously get the result. The value is owned by the shared state,
+    // so the reference is valid for as long as any copy of the handle is alive.
+    ConstRefType<T> get() const;
+
+    // Continue task execution in the parent executor. The continuation
+    // receives the shared value by const reference.
+    // Does not invalidate the object, so any number of continuations is allowed.
+    template <class Ret>
+    AsyncResult<Ret> then(FunctionType<Ret, ConstRefType<T> > func, ThenPolicy policy = ThenPolicy::Lazy) const;
+
+    // Schedules subsequent execution to another executor.
+    SharedAsyncResult<T> in(Executor executor) const;
+
+private:
+    std::shared_ptr<StateType> state_;
+    Executor executor_;
+};
+
+
+// =============================================== //
+// ==================== SHARE ==================== //
+// =============================================== //
+
+template <class T>
+class ShareSubscription : public ISubscription<PhysicalType<T> > {
+using StateType = details::BroadcastState<PhysicalType<T> >;
+
+public:
+    explicit ShareSubscription(std::shared_ptr<StateType> state)
+        : state_(std::move(state)) {   }
+
+    void resolveValue(PhysicalType<T> value, ResolvedBy by) override {
+        StateType::produceValue(state_, std::move(value), by);
+    }
+
+    void resolveError(std::exception_ptr err, ResolvedBy by) override {
+        StateType::produceError(state_, std::move(err), by);
+    }
+
+private:
+    std::shared_ptr<StateType> state_;
+};
+
+template <class T>
+template <class U>
+SharedAsyncResult<U> AsyncResult<T>::share() {
+    static_assert(std::is_same_v<T, U>, "Cannot call share with non-default template argument");
+    auto state = std::make_shared<details::BroadcastState<PhysicalType<T> > >();
+    launch();
+    fut_.subscribe(std::make_unique<ShareSubscription<T> >(state));
+    return SharedAsyncResult<T>{executor_, std::move(state)};
+}
+
+
+// ==================================================== //
+// ==================== WAIT & GET ==================== //
+// ==================================================== //
+
+template <class T>
+void SharedAsyncResult<T>::wait() const {
+    if (!state_) {
+        throw std::runtime_error("Trying to wait for spoiled state");
+    }
+    state_->wait();
+}
+
+template <class T>
+ConstRefType<T> SharedAsyncResult<T>::get() const {
+    wait();
+    if (state_->error()) {
+        std::rethrow_exception(state_->error());
+    }
+    if constexpr (!std::is_same_v<T, void>) {
+        assert(state_->value().has_value());
+        return *state_->value();
+    }
+}
+
+
+// ============================================ //
+// ==================== IN ==================== //
+// ============================================ //
+
+template <class T>
+SharedAsyncResult<T> SharedAsyncResult<T>::in(Executor executor) const {
+    return SharedAsyncResult<T>{executor, state_};
+}
+
+
+// ============================================== //
+// ==================== THEN ==================== //
+// ============================================== //
+
+template <class Ret, class Arg>
+class SharedThenSubscription : public details::IBroadcastSubscription<PhysicalType<Arg> > {
+using StateType = details::BroadcastState<PhysicalType<Arg> >;
+
+public:
+    SharedThenSubscription(FunctionType<Ret, ConstRefType<Arg> > func,
+                           Promise<Ret> promise,
+                           Executor continuation_executor,
+                           ThenPolicy policy
+    )
+        : func_(std::move(func))
+        , promise_(std::move(promise))
+        , continuation_executor_(continuation_executor)
+        , execution_policy_(policy)
+    {   }
+
+    void resolve(const std::shared_ptr<StateType>& state, ResolvedBy by) override {
+        if (state->error()) {
+            promise_.setError(state->error());
+            return;
+        }
+        ThreadPool::Task pool_task = nullptr;
+        if constexpr (std::is_same_v<Arg, void>) {
+            pool_task = details::make_async_task<Ret>(std::move(func_), std::move(promise_));
+        } else {
+            // The task shares ownership of the state to keep the value alive
+            FunctionType<Ret, void> bound = [func = std::move(func_), state]() {
+                return func(*state->value());
+            };
+            pool_task = details::make_async_task<Ret>(std::move(bound), std::move(promise_));
+        }
+        details::dispatchContinuation(std::move(pool_task), continuation_executor_, execution_policy_, by);
+    }
+
+private:
+    FunctionType<Ret, ConstRefType<Arg> > func_;
+    Promise<Ret> promise_;
+    Executor continuation_executor_;
+    ThenPolicy execution_policy_;
+};
+
+template <class T>
+template <class Ret>
+AsyncResult<Ret> SharedAsyncResult<T>::then(FunctionType<Ret, ConstRefType<T> > func, ThenPolicy policy) const {
+    if (!state_) {
+        throw std::runtime_error("Trying to subscribe to spoiled state");
+    }
+    auto [promise, future] = contract<Ret>();
+    StateType::subscribe(state_, std::make_unique<SharedThenSubscription<Ret, T> >(
+        std::move(func), std::move(promise), executor_, policy));
+    return details::AsyncResultAccess::make(executor_, std::move(future));
+}
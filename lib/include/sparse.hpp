@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.hpp"
+#include "parallel_for.hpp"
+#include "parallel_reduce.hpp"
+
+
+template <class T>
+struct SparseEntry {
+    int64_t row;
+    int64_t col;
+    T value;
+};
+
+
+// ==================================================== //
+// ==================== CSR MATRIX ==================== //
+// ==================================================== //
+
+// Compressed sparse rows: the entries of row idx are [row_offsets[idx], row_offsets[idx + 1])
+// of col_indices and values. Column indices are 32-bit to save memory bandwidth in SpMV.
+template <class T>
+class CsrMatrix {
+public:
+    CsrMatrix(int64_t rows, int64_t cols, std::vector<int64_t> row_offsets,
+              std::vector<int32_t> col_indices, std::vector<T> values)
+        : rows_(rows)
+        , cols_(cols)
+        , row_offsets_(std::move(row_offsets))
+        , col_indices_(std::move(col_indices))
+        , values_(std::move(values))
+    {
+        if (rows < 0 || cols < 0 || cols > std::numeric_limits<int32_t>::max()) {
+            throw std::invalid_argument("Invalid sparse matrix dimensions");
+        }
+        if (static_cast<int64_t>(row_offsets_.size()) != rows + 1 || row_offsets_.front() != 0
+            || row_offsets_.back() != static_cast<int64_t>(col_indices_.size())
+            || col_indices_.size() != values_.size())
+        {
+            throw std::invalid_argument("Inconsistent CSR arrays");
+        }
+        for (int64_t row = 0; row < rows; ++row) {
+            if (row_offsets_[row] > row_offsets_[row + 1]) {
+                throw std::invalid_argument("Row offsets must not decrease");
+            }
+        }
+        for (int32_t col : col_indices_) {
+            if (col < 0 || col >= cols) {
+                throw std::invalid_argument("Column index exceeds matrix size");
+            }
+        }
+    }
+
+    // Entries may come in any order, duplicates are summed up.
+    static CsrMatrix fromEntries(int64_t rows, int64_t cols, std::vector<SparseEntry<T> > entries) {
+        std::sort(entries.begin(), entries.end(), [](const SparseEntry<T>& lhs, const SparseEntry<T>& rhs) {
+            return lhs.row != rhs.row ? lhs.row < rhs.row : lhs.col < rhs.col;
+        });
+        std::vector<int64_t> row_offsets(rows + 1, 0);
+        std::vector<int32_t> col_indices;
+        std::vector<T> values;
+        for (size_t idx = 0; idx < entries.size(); ++idx) {
+            const SparseEntry<T>& entry = entries[idx];
+            if (entry.row < 0 || entry.row >= rows) {
+                throw std::invalid_argument("Row index exceeds matrix size");
+            }
+            if (entry.col < 0 || entry.col >= cols) {
+                throw std::invalid_argument("Column index exceeds matrix size");
+            }
+            if (idx > 0 && entry.row == entries[idx - 1].row && entry.col == entries[idx - 1].col) {
+                values.back() += entry.value;
+                continue;
+            }
+            ++row_offsets[entry.row + 1];
+            col_indices.push_back(static_cast<int32_t>(entry.col));
+            values.push_back(entry.value);
+        }
+        for (int64_t row = 0; row < rows; ++row) {
+            row_offsets[row + 1] += row_offsets[row];
+        }
+        return CsrMatrix(rows, cols, std::move(row_offsets), std::move(col_indices), std::move(values));
+    }
+
+    int64_t rows() const { return rows_; }
+    int64_t cols() const { return cols_; }
+    int64_t nonZeros() const { return static_cast<int64_t>(values_.size()); }
+
+    const std::vector<int64_t>& rowOffsets() const { return row_offsets_; }
+    const std::vector<int32_t>& colIndices() const { return col_indices_; }
+    const std::vector<T>& values() const { return values_; }
+
+private:
+    int64_t rows_;
+    int64_t cols_;
+    std::vector<int64_t> row_offsets_;
+    std::vector<int32_t> col_indices_;
+    std::vector<T> values_;
+};
+
+
+namespace details {
+
+// A few blocks per worker and at least this many nonzeros per block
+constexpr int64_t kSpmvMinBlockNonZeros = 1 << 14;
+
+// Splits the rows into blocks with about the same number of nonzeros, so a few dense rows
+// do not leave a single worker behind. Returns the first row of every block and the end.
+inline std::vector<int64_t> balancedRowBlocks(ThreadPool& pool, const std::vector<int64_t>& row_offsets) {
+    const int64_t rows = static_cast<int64_t>(row_offsets.size()) - 1;
+    const int64_t non_zeros = row_offsets.back();
+    const int64_t num_blocks = std::clamp<int64_t>(non_zeros / kSpmvMinBlockNonZeros, 1, 4 * std::max(pool.size(), 1));
+    std::vector<int64_t> bounds = {0};
+    for (int64_t block = 1; block < num_blocks; ++block) {
+        int64_t target = non_zeros * block / num_blocks;
+        int64_t row = std::lower_bound(row_offsets.begin(), row_offsets.end(), target) - row_offsets.begin();
+        if (row > bounds.back() && row < rows) {
+            bounds.push_back(row);
+        }
+    }
+    bounds.push_back(rows);
+    return bounds;
+}
+
+}  // namespace details
+
+
+// ==================================================== //
+// ==================== SPARSE OPS ==================== //
+// ==================================================== //
+
+// y = mtx * x, where x has mtx.cols() and y mtx.rows() elements. Blocks of rows are balanced
+// by the number of nonzeros and multiplied in parallel.
+template <class T>
+void parallel_spmv(ThreadPool& pool, const CsrMatrix<T>& mtx, const T* x, T* y) {
+    const int64_t* row_offsets = mtx.rowOffsets().data();
+    const int32_t* col_indices = mtx.colIndices().data();
+    const T* values = mtx.values().data();
+    std::vector<int64_t> bounds = details::balancedRowBlocks(pool, mtx.rowOffsets());
+    parallel_for(pool, 0, static_cast<int64_t>(bounds.size()) - 1, [&](int64_t block) {
+        for (int64_t row = bounds[block]; row < bounds[block + 1]; ++row) {
+            T acc = T(0);
+            for (int64_t idx = row_offsets[row]; idx < row_offsets[row + 1]; ++idx) {
+                acc += values[idx] * x[col_indices[idx]];
+            }
+            y[row] = acc;
+        }
+    });
+}
+
+struct CgResult {
+    int64_t iterations;
+    // ||rhs - mtx * x|| / ||rhs|| as tracked by the iterations
+    double relative_residual;
+    bool converged;
+};
+
+// Solves mtx * x = rhs for a symmetric positive definite mtx by conjugate gradients, starting
+// from x. Stops once the relative residual is below the tolerance, or after max_iterations.
+// Dot products are deterministic, so the iterations do not depend on the number of workers.
+template <class T>
+CgResult conjugate_gradient(ThreadPool& pool, const CsrMatrix<T>& mtx, const std::vector<T>& rhs, std::vector<T>& x,
+                            double tolerance, int64_t max_iterations)
+{
+    const int64_t size = mtx.rows();
+    if (mtx.cols() != size) {
+        throw std::invalid_argument("Non-square matrices are not supported");
+    }
+    if (static_cast<int64_t>(rhs.size()) != size || static_cast<int64_t>(x.size()) != size) {
+        throw std::invalid_argument("Mismatching matrix and vector sizes");
+    }
+    auto dot = [&pool, size](const std::vector<T>& lhs_vec, const std::vector<T>& rhs_vec) {
+        return parallel_transform_reduce(pool, 0, size, T(0), std::plus<T>(),
+            [&lhs_vec, &rhs_vec](int64_t idx) { return lhs_vec[idx] * rhs_vec[idx]; }, ReduceOrder::Deterministic);
+    };
+
+    // r = rhs - mtx * x, p = r
+    std::vector<T> r(size), p(size), q(size);
+    parallel_spmv(pool, mtx, x.data(), q.data());
+    parallel_for(pool, 0, size, [&](int64_t idx) {
+        r[idx] = rhs[idx] - q[idx];
+        p[idx] = r[idx];
+    });
+    const double rhs_norm = std::sqrt(static_cast<double>(dot(rhs, rhs)));
+    if (rhs_norm == 0) {
+        std::fill(x.begin(), x.end(), T(0));
+        return {0, 0.0, true};
+    }
+    T rr = dot(r, r);
+
+    int64_t iter = 0;
+    for (; iter < max_iterations; ++iter) {
+        if (std::sqrt(static_cast<double>(rr)) <= tolerance * rhs_norm) {
+            break;
+        }
+        parallel_spmv(pool, mtx, p.data(), q.data());
+        T pq = dot(p, q);
+        if (pq <= T(0)) {
+            throw std::runtime_error("Matrix is not positive definite");
+        }
+        const T alpha = rr / pq;
+        // Updates x and r and computes the new r * r in a single pass
+        T next_rr = parallel_reduce(pool, 0, size, T(0), [&](int64_t begin, int64_t end, T acc) {
+            for (int64_t idx = begin; idx < end; ++idx) {
+                x[idx] += alpha * p[idx];
+                r[idx] -= alpha * q[idx];
+                acc += r[idx] * r[idx];
+            }
+            return acc;
+        }, std::plus<T>(), ReduceOrder::Deterministic);
+        const T beta = next_rr / rr;
+        rr = next_rr;
+        parallel_for(pool, 0, size, [&](int64_t begin, int64_t end) {
+            for (int64_t idx = begin; idx < end; ++idx) {
+                p[idx] = r[idx] + beta * p[idx];
+            }
+        }, AutoPartitioner(details::kDefaultReduceGrain));
+    }
+    double residual = std::sqrt(static_cast<double>(rr)) / rhs_norm;
+    return {iter, residual, residual <= tolerance};
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <stdexcept>
+
+
+// Thrown by cancelled tasks and delivered to their consumers instead of a value.
+class CancelledError : public std::runtime_error {
+public:
+    CancelledError() : std::runtime_error("Task was cancelled") {   }
+};
+
+
+namespace details {
+
+// A stop flag, optionally chained to the flag of a parent source.
+// Polling is lock-free and requires no more than one load per chain link.
+struct StopState {
+    explicit StopState(std::shared_ptr<StopState> parent)
+        : parent(std::move(parent))
+        , requested(false)
+    {   }
+
+    bool stopRequested() const {
+        for (const StopState* state = this; state != nullptr; state = state->parent.get()) {
+            if (state->requested.load(std::memory_order_acquire)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const std::shared_ptr<StopState> parent;
+    std::atomic<bool> requested;
+};
+
+class CurrentStopTokenScope;
+
+}  // namespace details
+
+
+class StopToken {
+
+friend class StopSource;
+
+private:
+    explicit StopToken(std::shared_ptr<details::StopState> state) : state_(std::move(state)) {   }
+
+public:
+    // An empty token can never be stopped.
+    StopToken() = default;
+
+    bool stopRequested() const { return state_ && state_->stopRequested(); }
+    bool stopPossible() const { return state_ != nullptr; }
+
+    // Convenient for polling inside long-running callables.
+    void throwIfStopped() const {
+        if (stopRequested()) {
+            throw CancelledError();
+        }
+    }
+
+    // Token of the task currently executed by this thread.
+    // Empty if the thread does not execute a task.
+    static const StopToken& current() {
+        static const StopToken empty_token;
+        const StopToken* token = currentPtr();
+        return token ? *token : empty_token;
+    }
+
+private:
+    static const StopToken*& currentPtr() {
+        static thread_local const StopToken* current_token = nullptr;
+        return current_token;
+    }
+
+private:
+    std::shared_ptr<details::StopState> state_;
+
+friend class details::CurrentStopTokenScope;
+};
+
+
+class StopSource {
+public:
+    StopSource() : state_(std::make_shared<details::StopState>(nullptr)) {   }
+    // The source is stopped whenever the parent one is.
+    explicit StopSource(const StopToken& parent) : state_(std::make_shared<details::StopState>(parent.state_)) {   }
+
+    StopToken token() const { return StopToken(state_); }
+
+    // Returns true if this call has made the request.
+    bool requestStop() { return !state_->requested.exchange(true, std::memory_order_acq_rel); }
+    bool stopRequested() const { return state_->stopRequested(); }
+
+private:
+    std::shared_ptr<details::StopState> state_;
+};
+
+
+namespace details {
+
+// Exposes the token of a running task via StopToken::current.
+class CurrentStopTokenScope {
+public:
+    explicit CurrentStopTokenScope(const StopToken& token) : saved_(StopToken::currentPtr()) {
+        StopToken::currentPtr() = &token;
+    }
+
+    ~CurrentStopTokenScope() { StopToken::currentPtr() = saved_; }
+
+    CurrentStopTokenScope(const CurrentStopTokenScope&) = delete;
+    CurrentStopTokenScope& operator=(const CurrentStopTokenScope&) = delete;
+
+private:
+    const StopToken* saved_;
+};
+
+}  // namespace details
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+#include <queue>
+#include <mutex>
+
+#include "thread_pool_task_base.hpp"
+#include "thread_pool.hpp"
+
+
+namespace details {
+
+struct StrandState {
+    explicit StrandState(ThreadPool& pool) : pool(pool), active(false) {   }
+
+    ThreadPool& pool;
+    std::mutex mtx;
+    std::queue<std::unique_ptr<ITaskBase> > tasks;
+    // Whether a drain task is either queued in the pool or running
+    bool active;
+};
+
+}  // namespace details
+
+
+// Runs the submitted tasks one at a time in order of submission on top of a ThreadPool,
+// so that they may share state without locks. An idle strand occupies no worker:
+// a busy one is represented by a single pool task, which drains the queue in batches.
+// Like any executor, the Strand must outlive every Executor made from it, e.g. the ones kept
+// by continuations scheduled via then(..., strand). Tasks queued once the pool has stopped are cancelled.
+class Strand {
+public:
+    using Task = std::unique_ptr<ITaskBase>;
+
+    // The maximal number of tasks run in one worker turn, so that the rest of
+    // the pool tasks do not starve behind a busy strand
+    static constexpr int kMaxBatch = 64;
+
+    explicit Strand(ThreadPool& pool) : state_(std::make_shared<details::StrandState>(pool)) {   }
+
+    Strand(const Strand&) = delete;
+    Strand& operator=(const Strand&) = delete;
+
+    void submit(Task task);
+
+    ThreadPool& pool() { return state_->pool; }
+
+private:
+    std::shared_ptr<details::StrandState> state_;
+};
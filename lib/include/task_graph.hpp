@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <condition_variable>
+#include <mutex>
+
+#include "thread_pool.hpp"
+
+
+class TaskGraph;
+
+
+namespace details {
+
+// A node is offered to the workers of the pool as a StackTask, so running a graph does not
+// allocate. The dependency counter is reset to the number of predecessors before every run.
+class GraphNode : public StackTask {
+public:
+    enum class Kind { Task, Condition, Subgraph };
+
+    GraphNode(TaskGraph& graph, Kind kind, size_t index) : graph_(graph), kind_(kind), index_(index) {   }
+
+    void run() override;
+
+private:
+    TaskGraph& graph_;
+    const Kind kind_;
+    const size_t index_;
+    std::function<void()> work_;
+    // Index of the successor to run
+    std::function<size_t()> condition_;
+    TaskGraph* subgraph_ = nullptr;
+
+    std::vector<GraphNode*> successors_;
+    int num_predecessors_ = 0;
+    std::atomic<int> pending_predecessors_ { 0 };
+
+friend class ::TaskGraph;
+};
+
+}  // namespace details
+
+
+// ==================================================== //
+// ==================== TASK GRAPH ==================== //
+// ==================================================== //
+
+// A DAG of tasks, declared once and run any number of times. A node runs once all of its
+// predecessors have run. The thread that completes a node goes on with one of the successors
+// it has made ready, and offers the rest to the workers of the pool. Repeated runs of the same
+// graph do not allocate.
+//
+// A condition node returns the index of the successor to run, among its successors in the order
+// of the edges. The other successors are skipped, and so is every node that depends on a skipped one.
+// A subgraph node runs another graph to completion. A graph may not run twice at the same time,
+// and may not be changed while it runs.
+class TaskGraph {
+public:
+    using NodeId = size_t;
+
+    TaskGraph() = default;
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    template <class Fun>
+    NodeId addTask(Fun&& fun) {
+        details::GraphNode& node = addNode(details::GraphNode::Kind::Task);
+        node.work_ = std::forward<Fun>(fun);
+        return nodes_.size() - 1;
+    }
+
+    // The callable returns size_t: the index of the successor to run. An index past the last
+    // successor fails the run with std::out_of_range.
+    template <class Fun>
+    NodeId addCondition(Fun&& fun) {
+        details::GraphNode& node = addNode(details::GraphNode::Kind::Condition);
+        node.condition_ = std::forward<Fun>(fun);
+        return nodes_.size() - 1;
+    }
+
+    // The subgraph must outlive this graph and may not contain it
+    NodeId addSubgraph(TaskGraph& subgraph);
+
+    // The node "to" runs after the node "from"
+    void addEdge(NodeId from, NodeId to);
+
+    size_t size() const { return nodes_.size(); }
+
+    // Runs the graph and returns once it has completed. If nodes throw, no more nodes are
+    // started and the first error is rethrown. Throws std::invalid_argument for a cyclic graph.
+    // Workers of the pool help with other tasks meanwhile, other threads run offered nodes.
+    void run(ThreadPool& pool);
+
+private:
+    details::GraphNode& addNode(details::GraphNode::Kind kind);
+    // Counts the predecessors, finds the roots and checks for cycles, once after every change
+    void prepare();
+
+    // Runs the node and then the chain of successors, that it makes ready
+    void execute(details::GraphNode* node);
+    void fork(details::GraphNode* node);
+    void fail(std::exception_ptr error);
+    void wakeCaller();
+
+private:
+    // Stable addresses: nodes point to their successors
+    std::deque<details::GraphNode> nodes_;
+    std::vector<details::GraphNode*> roots_;
+    bool prepared_ = false;
+    std::atomic<bool> running_ { false };
+
+    // State of the current run
+    ThreadPool* pool_ = nullptr;
+    // Nodes, that are ready or running. The run is complete once it drops to zero.
+    std::atomic<size_t> num_active_ { 0 };
+    // Forked nodes in order, to be joined by the caller
+    std::unique_ptr<std::atomic<details::GraphNode*>[]> forked_;
+    std::atomic<size_t> num_forked_ { 0 };
+    std::atomic<bool> failed_ { false };
+    std::exception_ptr error_;
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::atomic<bool> caller_waiting_ { false };
+
+friend class details::GraphNode;
+};
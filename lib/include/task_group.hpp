@@ -6,10 +6,12 @@
 #include <deque>
 #include <optional>
 #include <exception>
+#include <stdexcept>
 
 #include "../private/shared_state.hpp"
 #include "../private/type_traits.hpp"
 #include "async_result.hpp"
+#include "stop_token.hpp"
 
 
 // =============================================== //
@@ -26,51 +28,89 @@ using GroupAllType = typename std::conditional_t<
 template <class T>
 using GroupFirstType = T;
 
+template <class T>
+using GroupAtLeastType = GroupAllType<T>;
+
+// Whether to stop the group token once the merged result is produced.
+enum class CancelPolicy { KeepRest, CancelRest };
+
 
 namespace details {
 
 
+// Result of a single group member. Successful results are additionally linked
+// into an intrusive list in order of their registration.
+template <class T>
+struct GroupResult : Result<T> {
+    GroupResult* next_value = nullptr;
+};
+
+
 template <class T>
 class GroupState {
 public:
-    enum Type { kPending = 0, kReadyAll = 1, kReadyFirst = 2, kProduced = 3 };
+    enum Type { kPending = 0, kReadyAll = 1, kReadyFirst = 2, kReadyAtLeast = 3, kProduced = 4 };
 
-    explicit GroupState()
+    explicit GroupState(const StopToken& parent_token)
         : num_pending_(0)
+        , num_values_(0)
+        , num_errors_(0)
         , first_value_(nullptr)
         , first_error_(nullptr)
         , last_error_(nullptr)
+        , value_list_(nullptr)
         , results_()
+        , quorum_(0)
+        , num_members_(0)
         , group_type_(kPending)
         , promise_all_(std::nullopt)
         , promise_first_(std::nullopt)
+        , promise_at_least_(std::nullopt)
+        , stop_source_(parent_token)
+        , cancel_policy_(CancelPolicy::KeepRest)
     {   }
 
-    Result<T>* attach();
+    GroupResult<T>* attach();
     void detach();
 
-    void registerValue(Result<T>*);
-    void registerError(Result<T>*);
+    void registerValue(GroupResult<T>*);
+    void registerError(GroupResult<T>*);
+
+    Future<GroupAllType<T> > subscribeToAll(CancelPolicy policy);
+    Future<GroupFirstType<T> > subscribeToFirst(CancelPolicy policy);
+    Future<GroupAtLeastType<T> > subscribeToAtLeast(int64_t quorum, CancelPolicy policy);
 
-    Future<GroupAllType<T> > subscribeToAll();
-    Future<GroupFirstType<T> > subscribeToFirst();
+    StopToken stopToken() const { return stop_source_.token(); }
 
 private:
     void produceAll();
     void produceFirst();
+    void produceAtLeast();
+    void cancelRest();
 
 private:
     // Counters and last / first result
     std::atomic<int64_t> num_pending_;
-    std::atomic<Result<T>* > first_value_;
-    std::atomic<Result<T>* > first_error_;
-    std::atomic<Result<T>* > last_error_;
+    std::atomic<int64_t> num_values_;
+    std::atomic<int64_t> num_errors_;
+    std::atomic<GroupResult<T>* > first_value_;
+    std::atomic<GroupResult<T>* > first_error_;
+    std::atomic<GroupResult<T>* > last_error_;
+    // Head of the intrusive list of successful results; the latest one goes first
+    std::atomic<GroupResult<T>* > value_list_;
     // An array of all results
-    std::deque<Result<T> > results_;
+    std::deque<GroupResult<T> > results_;
+    // Fixed by subscribeToAtLeast before the group type is published
+    int64_t quorum_;
+    int64_t num_members_;
     // Group state and promises
     std::atomic<int> group_type_;
     std::optional<Promise<GroupAllType<T> > > promise_all_;
     std::optional<Promise<GroupFirstType<T> > > promise_first_;
+    std::optional<Promise<GroupAtLeastType<T> > > promise_at_least_;
+    // Members that are no longer needed can be cancelled via the group token
+    StopSource stop_source_;
+    CancelPolicy cancel_policy_;
 };
 
 
@@ -80,7 +120,7 @@ template <class T>
 void GroupState<T>::produceAll() {
     assert(promise_all_.has_value());
     // Check for errors
-    Result<T>* fst_err_result = first_error_.load(std::memory_order_relaxed);
+    GroupResult<T>* fst_err_result = first_error_.load(std::memory_order_relaxed);
     if (fst_err_result) {
         promise_all_->setError(std::move(fst_err_result->err));
         return;
@@ -102,7 +142,7 @@ void GroupState<T>::produceAll() {
 template <>
 void GroupState<void>::produceAll() {
     assert(promise_all_.has_value());
-    Result<void>* fst_err_result = first_error_.load(std::memory_order_relaxed);
+    GroupResult<void>* fst_err_result = first_error_.load(std::memory_order_relaxed);
     if (fst_err_result) {
         promise_all_->setError(std::move(fst_err_result->err));
     } else {
@@ -114,7 +154,7 @@ template <class T>
 void GroupState<T>::produceFirst() {
     assert(promise_first_.has_value());
     // Try to get first value
-    Result<T>* first_val_result = first_value_.load(std::memory_order_relaxed);
+    GroupResult<T>* first_val_result = first_value_.load(std::memory_order_relaxed);
     if (first_val_result) {
         if constexpr (std::is_same_v<T, void>) {
             promise_first_->setValue(Void{});
@@ -125,30 +165,78 @@ void GroupState<T>::produceFirst() {
         return;
     }
     // Check for errors
-    Result<T>* last_err_result = last_error_.load(std::memory_order_relaxed);
+    GroupResult<T>* last_err_result = last_error_.load(std::memory_order_relaxed);
     assert(last_err_result);
     promise_first_->setError(std::move(last_err_result->err));
 }
 
+template <class T>
+void GroupState<T>::produceAtLeast() {
+    assert(promise_at_least_.has_value());
+    if (num_values_.load(std::memory_order_acquire) < quorum_) {
+        GroupResult<T>* last_err_result = last_error_.load(std::memory_order_acquire);
+        if (last_err_result) {
+            promise_at_least_->setError(std::move(last_err_result->err));
+        } else {
+            promise_at_least_->setError(std::make_exception_ptr(
+                std::runtime_error("TaskGroup has too few members to reach the quorum")));
+        }
+        return;
+    }
+    if constexpr (std::is_same_v<T, void>) {
+        promise_at_least_->setValue(Void{});
+    } else {
+        // The list may contain more than quorum_ values, since some members could have
+        // succeeded concurrently. The earliest ones reside in the tail of the list.
+        std::vector<GroupResult<T>*> succeeded;
+        for (auto* node = value_list_.load(std::memory_order_acquire); node; node = node->next_value) {
+            succeeded.push_back(node);
+        }
+        assert(static_cast<int64_t>(succeeded.size()) >= quorum_);
+        std::vector<T> values;
+        values.reserve(quorum_);
+        for (auto iter = succeeded.rbegin(); iter != succeeded.rbegin() + quorum_; ++iter) {
+            assert((*iter)->val);
+            values.push_back(std::move(*(*iter)->val));
+        }
+        promise_at_least_->setValue(std::move(values));
+    }
+}
+
+template <class T>
+void GroupState<T>::cancelRest() {
+    if (cancel_policy_ == CancelPolicy::CancelRest) {
+        stop_source_.requestStop();
+    }
+}
+
 
 // ==================== REGISTRTORS ==================== //
 
 template <class T>
-void GroupState<T>::registerValue(Result<T>* result) {
+void GroupState<T>::registerValue(GroupResult<T>* result) {
     if (first_value_.load(std::memory_order_relaxed) == nullptr) {
-        details::Result<T>* expected = nullptr;
+        details::GroupResult<T>* expected = nullptr;
         first_value_.compare_exchange_strong(expected, result, std::memory_order_acq_rel);
     }
+    // Link the result before counting it, so that whoever observes
+    // num_values_ >= quorum_ can find at least quorum_ values in the list.
+    result->next_value = value_list_.load(std::memory_order_relaxed);
+    while (!value_list_.compare_exchange_weak(result->next_value, result,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+    num_values_.fetch_add(1, std::memory_order_acq_rel);
     num_pending_.fetch_add(-1, std::memory_order_acq_rel);
 }
 
 template <class T>
-void GroupState<T>::registerError(Result<T>* result) {
+void GroupState<T>::registerError(GroupResult<T>* result) {
     if (first_error_.load(std::memory_order_relaxed) == nullptr) {
-        details::Result<T>* expected = nullptr;
+        details::GroupResult<T>* expected = nullptr;
         first_error_.compare_exchange_strong(expected, result, std::memory_order_acq_rel);
     }
     last_error_.store(result, std::memory_order_release);
+    num_errors_.fetch_add(1, std::memory_order_acq_rel);
     num_pending_.fetch_add(-1, std::memory_order_acq_rel);
 }
 
@@ -156,28 +244,42 @@ void GroupState<T>::registerError(Result<T>* result) {
 // ==================== SUBSCRIPTION ==================== //
 
 template <class T>
-Future<GroupAllType<T> > GroupState<T>::subscribeToAll() {
+Future<GroupAllType<T> > GroupState<T>::subscribeToAll(CancelPolicy policy) {
     assert(group_type_.load(std::memory_order_relaxed) == kPending);
     auto [promise, future] = contract<GroupAllType<T> >();
     promise_all_.emplace(std::move(promise));
+    cancel_policy_ = policy;
     group_type_.store(kReadyAll, std::memory_order_release);
     return std::move(future);
 }
 
 template <class T>
-Future<GroupFirstType<T> > GroupState<T>::subscribeToFirst() {
+Future<GroupFirstType<T> > GroupState<T>::subscribeToFirst(CancelPolicy policy) {
     assert(group_type_.load(std::memory_order_relaxed) == kPending);
     auto [promise, future] = contract<GroupFirstType<T> >();
     promise_first_.emplace(std::move(promise));
+    cancel_policy_ = policy;
     group_type_.store(kReadyFirst, std::memory_order_release);
     return std::move(future);
 }
 
+template <class T>
+Future<GroupAtLeastType<T> > GroupState<T>::subscribeToAtLeast(int64_t quorum, CancelPolicy policy) {
+    assert(group_type_.load(std::memory_order_relaxed) == kPending);
+    auto [promise, future] = contract<GroupAtLeastType<T> >();
+    promise_at_least_.emplace(std::move(promise));
+    cancel_policy_ = policy;
+    quorum_ = quorum;
+    num_members_ = static_cast<int64_t>(results_.size());
+    group_type_.store(kReadyAtLeast, std::memory_order_release);
+    return std::move(future);
+}
+
 
 // ==================== ATTACH / DETACH ==================== //
 
 template <class T>
-Result<T>* GroupState<T>::attach() {
+GroupResult<T>* GroupState<T>::attach() {
     results_.emplace_back();
     num_pending_.fetch_add(1, std::memory_order_acq_rel);
     return &(results_.back());
@@ -189,19 +291,33 @@ void GroupState<T>::detach() {
     auto group_type = group_type_.load(std::memory_order_acquire);
     // subscribeToAll already executed
     if (group_type == kReadyAll) {
-        Result<T>* fst_error = first_error_.load(std::memory_order_acquire);
+        GroupResult<T>* fst_error = first_error_.load(std::memory_order_acquire);
         if (num_pending == 0 || fst_error != nullptr) {
             if (group_type_.exchange(kProduced, std::memory_order_acq_rel) != kProduced) {
                 produceAll();
+                cancelRest();
             }
         }
     }
     // subscribeToFirst already executed
     if (group_type == kReadyFirst) {
-        Result<T>* fst_value = first_value_.load(std::memory_order_acquire);
+        GroupResult<T>* fst_value = first_value_.load(std::memory_order_acquire);
         if (num_pending == 0 || fst_value != nullptr) {
             if (group_type_.exchange(kProduced, std::memory_order_acq_rel) != kProduced) {
                 produceFirst();
+                cancelRest();
+            }
+        }
+    }
+    // subscribeToAtLeast already executed
+    if (group_type == kReadyAtLeast) {
+        auto num_values = num_values_.load(std::memory_order_acquire);
+        auto num_errors = num_errors_.load(std::memory_order_acquire);
+        // Fail fast as soon as the quorum is unreachable
+        if (num_values >= quorum_ || num_errors > num_members_ - quorum_) {
+            if (group_type_.exchange(kProduced, std::memory_order_acq_rel) != kProduced) {
+                produceAtLeast();
+                cancelRest();
             }
         }
     }
@@ -220,17 +336,29 @@ class TaskGroup {
 template <class U> friend class JoinSubscription;
 
 public:
-    TaskGroup() {
+    // Group tokens are stopped whenever the parent token is.
+    explicit TaskGroup(StopToken parent_token = StopToken())
+        : parent_token_(std::move(parent_token))
+    {
         auto [promise, future] = contract<GroupAllType<T> >();
-        state_ = std::make_shared<details::GroupState<T> >();
+        state_ = std::make_shared<details::GroupState<T> >(parent_token_);
     }
 
     void join(AsyncResult<T> result);
 
-    AsyncResult<GroupAllType<T>> all();
-    AsyncResult<GroupFirstType<T> > first();
+    // Token to be passed to the members of the current group. With CancelPolicy::CancelRest
+    // it is stopped as soon as the merged result is produced, so that pending members are skipped.
+    StopToken token() const { return state_->stopToken(); }
+
+    AsyncResult<GroupAllType<T>> all(CancelPolicy policy = CancelPolicy::KeepRest);
+    AsyncResult<GroupFirstType<T> > first(CancelPolicy policy = CancelPolicy::KeepRest);
+    // Resolves with the values of the first `quorum` members to succeed in order
+    // of their completion. Fails as soon as the quorum becomes unreachable.
+    // A zero quorum resolves at once with no values. Throws std::invalid_argument for a negative one.
+    AsyncResult<GroupAtLeastType<T> > atLeast(int64_t quorum, CancelPolicy policy = CancelPolicy::KeepRest);
 
 private:
+    StopToken parent_token_;
     std::shared_ptr<details::GroupState<T> > state_;
 };
 
@@ -266,12 +394,12 @@ public:
 
 private:
     std::shared_ptr<details::GroupState<T> > state_;
-    details::Result<T>* local_result_;
+    details::GroupResult<T>* local_result_;
 };
 
 template <class T>
 void TaskGroup<T>::join(AsyncResult<T> res) {
-    res.fut_.subscribe(std::make_unique<JoinSubscription<T>>(state_));
+    details::AsyncResultAccess::takeFuture(res).subscribe(std::make_unique<JoinSubscription<T>>(state_));
 }
 
 
@@ -280,23 +408,37 @@ void TaskGroup<T>::join(AsyncResult<T> res) {
 // =============================================== //
 
 template <class T>
-AsyncResult<GroupAllType<T> > TaskGroup<T>::all() {
+AsyncResult<GroupAllType<T> > TaskGroup<T>::all(CancelPolicy policy) {
     if (!state_) {
         throw std::runtime_error("Trying to merge all TaskGroup twice");
     }
-    auto future = state_->subscribeToAll();
+    auto future = state_->subscribeToAll(policy);
     state_->detach();
-    state_ = std::make_shared<details::GroupState<T> >();
-    return {nullptr, std::move(future)};
+    state_ = std::make_shared<details::GroupState<T> >(parent_token_);
+    return details::AsyncResultAccess::make(Executor(), std::move(future));
 }
 
 template <class T>
-AsyncResult<GroupFirstType<T> > TaskGroup<T>::first() {
+AsyncResult<GroupFirstType<T> > TaskGroup<T>::first(CancelPolicy policy) {
     if (!state_) {
         throw std::runtime_error("Trying to merge first TaskGroup twice");
     }
-    auto future = state_->subscribeToFirst();
+    auto future = state_->subscribeToFirst(policy);
+    state_->detach();
+    state_ = std::make_shared<details::GroupState<T> >(parent_token_);
+    return details::AsyncResultAccess::make(Executor(), std::move(future));
+}
+
+template <class T>
+AsyncResult<GroupAtLeastType<T> > TaskGroup<T>::atLeast(int64_t quorum, CancelPolicy policy) {
+    if (quorum < 0) {
+        throw std::invalid_argument("TaskGroup quorum must not be negative");
+    }
+    if (!state_) {
+        throw std::runtime_error("Trying to merge TaskGroup twice");
+    }
+    auto future = state_->subscribeToAtLeast(quorum, policy);
     state_->detach();
-    state_ = std::make_shared<details::GroupState<T> >();
-    return {nullptr, std::move(future)};
+    state_ = std::make_shared<details::GroupState<T> >(parent_token_);
+    return details::AsyncResultAccess::make(Executor(), std::move(future));
 }
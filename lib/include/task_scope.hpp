@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <utility>
+#include <type_traits>
+
+#include "thread_pool_task_base.hpp"
+#include "async_result.hpp"
+#include "executor.hpp"
+#include "stop_token.hpp"
+#include "contract.hpp"
+
+
+// Forward declare
+class TaskScope;
+
+namespace details {
+
+// Tracks the unfinished tasks of a scope with a single counter. The scope itself
+// holds one extra reference until it is joined, so that it cannot complete earlier.
+class ScopeState {
+public:
+    ScopeState(Executor executor, const StopToken& parent_token, Promise<void> promise);
+
+    // Registers a new task. Throws if the scope has already completed.
+    void acquire();
+    // Unregisters a finished task, completing the scope if it was the last one.
+    void release();
+    // Only the first error is kept; the rest of the tasks are cancelled.
+    void fail(std::exception_ptr error);
+
+    Executor executor() const { return executor_; }
+    StopToken token() const { return stop_source_.token(); }
+
+private:
+    Executor executor_;
+    StopSource stop_source_;
+    std::atomic<int64_t> num_pending_;
+    std::atomic<bool> failed_;
+    std::exception_ptr first_error_;
+    Promise<void> promise_;
+
+    // Taken by the join
+    Future<void> future_;
+    std::atomic<bool> joined_;
+
+friend class ::TaskScope;
+};
+
+
+template <class Fun>
+class ScopeTask : public ITaskBase {
+public:
+    ScopeTask(Fun&& fun, std::shared_ptr<ScopeState> state)
+        : fun_(std::move(fun))
+        , state_(std::move(state))
+        , token_(state_->token())
+    {   }
+
+    bool cancelled() const override {
+        return token_.stopRequested();
+    }
+
+    void cancel() override {
+        state_->fail(std::make_exception_ptr(CancelledError()));
+        state_->release();
+    }
+
+    void run() override {
+        {
+            details::CurrentStopTokenScope token_scope(token_);
+            try {
+                fun_();
+            } catch (...) {
+                state_->fail(std::current_exception());
+            }
+        }
+        state_->release();
+    }
+
+private:
+    Fun fun_;
+    std::shared_ptr<ScopeState> state_;
+    StopToken token_;
+};
+
+}  // namespace details
+
+
+// Structured concurrency for dynamic task trees. Tasks may be spawned from anywhere,
+// including the tasks of the scope themselves, and join resolves once all of them
+// have finished. No results are stored, only the number of unfinished tasks.
+// The first error is propagated to the join, and the tasks, that have not started yet,
+// are skipped after it. TaskScope is a cheap handle, so copies may be captured by tasks.
+class TaskScope {
+public:
+    explicit TaskScope(Executor executor, const StopToken& parent_token = StopToken());
+
+    // Throws std::logic_error if the scope has already completed.
+    template <class Fun>
+    void spawn(Fun&& fun);
+
+    // Can only be called once. Tasks may still be spawned until all of them have finished.
+    AsyncResult<void> join();
+
+    // Stopped on the first error, or whenever the parent token is.
+    StopToken token() const { return state_->token(); }
+
+private:
+    std::shared_ptr<details::ScopeState> state_;
+};
+
+
+template <class Fun>
+void TaskScope::spawn(Fun&& fun) {
+    // Built before it is counted, so that a throwing copy of fun does not keep the scope pending
+    auto task = std::make_unique<details::ScopeTask<std::decay_t<Fun> > >(
+        std::decay_t<Fun>(std::forward<Fun>(fun)), state_);
+    state_->acquire();
+    state_->executor().submit(std::move(task));
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include <condition_variable>
+#include <mutex>
+
+#include "../private/cache_aligned.hpp"
+#include "stop_token.hpp"
+#include "thread_pool_task_base.hpp"
+#include "thread_pool.hpp"
+
+
+namespace details {
+
+// Thrown out of barrier() once another member has failed, to unwind the rest of the team.
+// Not an std::exception, so that bodies catching those do not swallow it by accident.
+struct TeamAborted {   };
+
+// Sense-reversing barrier for a fixed number of threads, reusable right away. The last one to
+// arrive flips the shared sense, which the others wait for. Waiters spin briefly, then yield,
+// then block: cheap when members run on their own cores, and fair to the members that share one.
+class TeamBarrier {
+public:
+    explicit TeamBarrier(int size) : size_(size) {
+        pending_.value.store(size, std::memory_order_relaxed);
+        sense_.value.store(false, std::memory_order_relaxed);
+    }
+
+    // Returns once all the members have arrived. The local sense is kept by each member
+    // between the calls. Throws TeamAborted if the barrier is broken.
+    void arriveAndWait(bool& local_sense);
+    // Releases the waiting members with TeamAborted, now and in the following calls
+    void breakBarrier();
+
+private:
+    // Sequentially consistent, as the sleeper count: a member that goes to sleep increments it,
+    // then reads these, while the last member or a failing one stores these, then reads it.
+    bool released(bool local_sense) const {
+        return sense_.value.load(std::memory_order_seq_cst) == local_sense
+            || broken_.load(std::memory_order_seq_cst);
+    }
+    void wake();
+
+private:
+    const int size_;
+    CacheAligned<std::atomic<int> > pending_;
+    CacheAligned<std::atomic<bool> > sense_;
+    std::atomic<bool> broken_ { false };
+    // Members blocked on the condition variable
+    std::atomic<int> sleepers_ { 0 };
+    std::mutex mtx_;
+    std::condition_variable cv_;
+};
+
+// Shared by the members for the duration of run_team
+class TeamState {
+public:
+    explicit TeamState(int size) : barrier(size), running_(size - 1) {   }
+
+    // Keeps the first error and breaks the barrier
+    void fail(std::exception_ptr error);
+    // Called by every member but the first one, which runs on the caller
+    void finishMember();
+    // Waits for the other members, then rethrows the first error
+    void join();
+
+    TeamBarrier barrier;
+
+private:
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    int running_;
+    std::exception_ptr error_;
+};
+
+}  // namespace details
+
+
+// ===================================================== //
+// ==================== TEAM MEMBER ==================== //
+// ===================================================== //
+
+// A member of a team, passed to the body. Only the member itself may use it.
+class TeamMember {
+public:
+    TeamMember(details::TeamState& state, int rank, int size) : state_(state), rank_(rank), size_(size) {   }
+
+    int rank() const { return rank_; }
+    int size() const { return size_; }
+
+    // Waits for all the members of the team. Writes before it are visible to every member after it.
+    void barrier() { state_.barrier.arriveAndWait(sense_); }
+
+    // The share of [begin, end) of this member in a static partition. It is the same in every call,
+    // so the data of a member stays in its caches from one iteration to the next.
+    std::pair<int64_t, int64_t> range(int64_t begin, int64_t end) const {
+        const int64_t count = std::max<int64_t>(end - begin, 0);
+        return {begin + count * rank_ / size_, begin + count * (rank_ + 1) / size_};
+    }
+
+private:
+    details::TeamState& state_;
+    const int rank_;
+    const int size_;
+    bool sense_ = true;
+};
+
+
+namespace details {
+
+template <class Body>
+void runTeamMember(TeamState& state, Body& body, int rank, int size) {
+    TeamMember member(state, rank, size);
+    try {
+        body(member);
+    } catch (const TeamAborted&) {
+        // Another member has failed
+    } catch (...) {
+        state.fail(std::current_exception());
+    }
+}
+
+template <class Body>
+class TeamMemberTask : public ITaskBase {
+public:
+    TeamMemberTask(TeamState& state, Body& body, int rank, int size)
+        : state_(state), body_(body), rank_(rank), size_(size) {   }
+
+    void run() override {
+        runTeamMember(state_, body_, rank_, size_);
+        state_.finishMember();
+    }
+
+    // The pool is stopped, so the member never runs: the others must not wait for it
+    void cancel() override {
+        state_.fail(std::make_exception_ptr(CancelledError()));
+        state_.finishMember();
+    }
+
+private:
+    TeamState& state_;
+    Body& body_;
+    const int rank_;
+    const int size_;
+};
+
+}  // namespace details
+
+
+// ============================================== //
+// ==================== TEAM ==================== //
+// ============================================== //
+
+// Runs body(TeamMember&) once on each of num_members threads at the same time: the caller is
+// the first member, the others are tasks on the workers of the pool, and all of them stay for
+// the whole call. Bulk-synchronous iterations go inside the body, separated by barrier(), so
+// nothing is scheduled or allocated per iteration. Returns once every member has returned.
+// If a member throws, the others are released from the barrier and the first error is rethrown.
+// If the pool stops before a member starts, the team is aborted the same way with CancelledError.
+//
+// Members wait for each other, so they need a worker each: num_members may not exceed the number
+// of workers, plus one if the caller is not a worker itself. A team started from a task must not
+// wait for workers that are busy with the same kind of tasks, e.g. teams may not be nested.
+template <class Body>
+void run_team(ThreadPool& pool, int num_members, Body&& body) {
+    const int max_members = pool.size() + (pool.currentWorker() < 0 ? 1 : 0);
+    if (num_members < 1 || num_members > max_members) {
+        throw std::invalid_argument("Team size must be between one and the number of available workers");
+    }
+    details::TeamState state(num_members);
+    for (int rank = 1; rank < num_members; ++rank) {
+        pool.submit(std::make_unique<details::TeamMemberTask<std::remove_reference_t<Body> > >(
+            state, body, rank, num_members));
+    }
+    details::runTeamMember(state, body, 0, num_members);
+    state.join();
+}
+
+// A team with a member per available worker
+template <class Body>
+void run_team(ThreadPool& pool, Body&& body) {
+    run_team(pool, pool.size() + (pool.currentWorker() < 0 ? 1 : 0), std::forward<Body>(body));
+}
@@ -1,38 +1,149 @@
 #pragma once
 
+#include <atomic>
 #include <utility>
 #include <memory>
 #include <vector>
 #include <queue>
+#include <chrono>
+#include <thread>
+#include <type_traits>
 
 #include <condition_variable>
 #include <mutex>
 
+#include "../private/timer_wheel.hpp"
 #include "thread_pool_task_base.hpp"
+#include "stop_token.hpp"
 #include "contract.hpp"
 
 
+// Forward declare
+template <class T> class AsyncResult;
+class ThreadPool;
+
+namespace details {
+class PeriodicTask;
+template <class T> struct TimeoutState;
+
+// A task that lives on the stack of its owner. Forking offers it to the workers of a pool
+// without any allocation; joining either takes it back and runs it inline, or, if it was
+// stolen meanwhile, waits for the thief. The owner must join before the task goes out of scope.
+class StackTask : public ITaskBase {
+public:
+    void fork(ThreadPool& pool);
+    void join();
+
+    // Whether a worker has taken the task since the fork. May be polled without blocking.
+    bool stolen() const { return stolen_.load(std::memory_order_relaxed); }
+
+private:
+    ThreadPool* pool_ = nullptr;
+    std::atomic<bool> stolen_ { false };
+    // Intrusive list of offered tasks, guarded by the pool mutex
+    StackTask* newer_ = nullptr;
+    StackTask* older_ = nullptr;
+    bool offered_ = false;
+    bool done_ = false;
+    bool awaited_ = false;
+
+friend class ::ThreadPool;
+};
+
+}  // namespace details
+
+
 class ThreadPool {
 public:
     using Task = std::unique_ptr<ITaskBase>;
+    using Clock = std::chrono::steady_clock;
 
-    ThreadPool() : stopped_(false) {    }
+    ThreadPool() : stopped_(false), timer_stopped_(false), timer_wakeup_(Clock::time_point::max()) {    }
     explicit ThreadPool(int num_workers) : ThreadPool() { start(num_workers); }
     ~ThreadPool() { stop(); }
 
     void start(int num_threads);
     void stop();
 
+    // Tasks submitted to a stopped pool, or left in its queue once it stops, are cancelled.
     void submit(Task task);
 
+    int size() const { return static_cast<int>(workers_.size()); }
+    // Index of the calling thread among the workers of the pool, or -1 if it is not one of them.
+    int currentWorker() const;
+
+    // Deadlines are tracked by a timer wheel, driven by a single thread that is started
+    // on demand. Expired callables are run by workers. A stopped token makes the timer
+    // skip the callable and resolve its result with CancelledError.
+    // Require async_function.hpp.
+
+    template <class Fun>
+    AsyncResult<std::invoke_result_t<Fun> > submitAt(Clock::time_point deadline, Fun&& fun, StopToken token = StopToken());
+
+    template <class Rep, class Period, class Fun>
+    AsyncResult<std::invoke_result_t<Fun> > submitAfter(const std::chrono::duration<Rep, Period>& delay,
+                                                         Fun&& fun, StopToken token = StopToken());
+
+    // Runs the callable every period, starting one period from now, until the token is stopped
+    // or the callable throws. The result is then resolved with CancelledError or the error.
+    // Missed periods are skipped rather than run in a burst.
+    template <class Rep, class Period, class Fun>
+    AsyncResult<void> schedulePeriodic(const std::chrono::duration<Rep, Period>& period,
+                                       Fun&& fun, StopToken token = StopToken());
+
+    // Number of timers in the wheel, including the retired ones, that have not been dropped yet
+    size_t numTimers();
+
+private:
+    // Run the task once the deadline has passed. Inline tasks are run by the timer thread itself,
+    // which is only meant for short library tasks that must not wait for a free worker, e.g. timeouts.
+    void addTimer(Clock::time_point deadline, Task task, bool run_inline);
+    void fireAt(Clock::time_point deadline, Task task) { addTimer(deadline, std::move(task), true); }
+    // Called once a timer has been cancelled ahead of its deadline. Cancelled timers are dropped
+    // whenever the wheel reaches them, and all at once when they make up half of the wheel.
+    void retireTimer();
+    void stopTimer();
+
+    // The mutex must be held
+    bool hasWork() const { return !tasks_.empty() || oldest_offered_ != nullptr; }
+    // Runs a queued task or steals the oldest offered one, releasing the lock meanwhile.
+    // Returns false if there was nothing to run. The mutex must be held.
+    bool runOne(std::unique_lock<std::mutex>& guard);
+
+    // Fork-join support, see details::StackTask
+    void offer(details::StackTask* task);
+    // Returns false if the task has been stolen. The mutex must be held.
+    bool retract(details::StackTask* task);
+    // Workers of the pool help with other tasks meanwhile, other threads just block
+    void waitStolen(details::StackTask* task);
+
 private:
     std::vector<std::thread> workers_;
     std::mutex mtx_;
     std::condition_variable queue_cv_;
+    // Threads outside of the pool, waiting for their stolen tasks
+    std::condition_variable stolen_cv_;
     std::queue<Task> tasks_;
+    details::StackTask* newest_offered_ = nullptr;
+    details::StackTask* oldest_offered_ = nullptr;
     bool stopped_;
 
-friend void runWorkerLoop(ThreadPool*);
+    std::thread timer_thread_;
+    std::mutex timer_mtx_;
+    std::condition_variable timer_cv_;
+    details::TimerWheel timers_;
+    bool timer_stopped_;
+    // The moment the timer thread is going to wake up at
+    Clock::time_point timer_wakeup_;
+    // Retired since the last purge of the wheel
+    size_t num_retired_timers_ = 0;
+
+friend void runWorkerLoop(ThreadPool*, int);
+friend void runTimerLoop(ThreadPool*);
+friend class details::PeriodicTask;
+template <class T>
+friend struct details::TimeoutState;
+friend class details::StackTask;
 template <class T>
 friend class AsyncResult;
 };
@@ -4,4 +4,8 @@ class ITaskBase {
 public:
     virtual ~ITaskBase() = default;
     virtual void run() = 0;
+
+    // A cancelled task is resolved via cancel() instead of being run.
+    virtual bool cancelled() const { return false; }
+    virtual void cancel() {   }
 };
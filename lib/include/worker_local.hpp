@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <mutex>
+
+#include "../private/cache_aligned.hpp"
+#include "thread_pool.hpp"
+
+
+// ====================================================== //
+// ==================== WORKER LOCAL ==================== //
+// ====================================================== //
+
+// An instance of T per worker of the pool, constructed by the factory on the first local() call
+// of that worker: e.g. scratch buffers, that tasks reuse instead of allocating their own. Workers
+// reach their instance by index, without locks, and instances sit on separate cache lines.
+// Threads outside the pool, like the callers of parallel_for, which run a part of the loop
+// themselves, get an instance each as well, found under a mutex.
+template <class T>
+class WorkerLocal {
+public:
+    explicit WorkerLocal(ThreadPool& pool) : WorkerLocal(pool, []() { return T(); }) {   }
+
+    template <class Factory>
+    WorkerLocal(ThreadPool& pool, Factory&& factory)
+        : pool_(pool)
+        , factory_(std::forward<Factory>(factory))
+        , slots_(pool.size())
+    {   }
+
+    WorkerLocal(const WorkerLocal&) = delete;
+    WorkerLocal& operator=(const WorkerLocal&) = delete;
+
+    // The instance of the calling thread. Do not hold the reference across a call, that runs other
+    // tasks while it waits: a fork-join call like parallel_for or invoke_parallel runs parts of its
+    // work, or tasks stolen from others, on the calling worker, and so does any other call, that
+    // blocks the worker by helping, e.g. a ManualExecutor loop. Those tasks get the same instance.
+    // Take the reference again after such a call instead.
+    T& local() {
+        int worker = pool_.currentWorker();
+        if (worker >= 0 && worker < static_cast<int>(slots_.size())) {
+            std::optional<T>& slot = slots_[worker].value;
+            if (!slot) {
+                slot.emplace(factory_());
+            }
+            return *slot;
+        }
+        return otherLocal();
+    }
+
+    // Calls fun(T&) for every instance constructed so far: those of the workers in their order,
+    // then those of other threads. Must not run concurrently with local().
+    template <class Fun>
+    void forEach(Fun&& fun) {
+        for (auto& slot : slots_) {
+            if (slot.value) {
+                fun(*slot.value);
+            }
+        }
+        for (auto& [thread, value] : others_) {
+            fun(value);
+        }
+    }
+
+    template <class Fun>
+    void forEach(Fun&& fun) const {
+        for (const auto& slot : slots_) {
+            if (slot.value) {
+                fun(*slot.value);
+            }
+        }
+        for (const auto& [thread, value] : others_) {
+            fun(value);
+        }
+    }
+
+    // Number of instances constructed so far
+    size_t size() const {
+        size_t count = others_.size();
+        for (const auto& slot : slots_) {
+            count += slot.value ? 1 : 0;
+        }
+        return count;
+    }
+
+    // Destroys every instance. Must not run concurrently with local().
+    void clear() {
+        for (auto& slot : slots_) {
+            slot.value.reset();
+        }
+        others_.clear();
+    }
+
+private:
+    T& otherLocal() {
+        std::lock_guard guard(mtx_);
+        const std::thread::id id = std::this_thread::get_id();
+        for (auto& [thread, value] : others_) {
+            if (thread == id) {
+                return value;
+            }
+        }
+        others_.emplace_back(id, factory_());
+        return others_.back().second;
+    }
+
+private:
+    ThreadPool& pool_;
+    std::function<T()> factory_;
+    std::vector<details::CacheAligned<std::optional<T> > > slots_;
+    std::mutex mtx_;
+    // Stable references: threads keep using their instance while others are added
+    std::deque<std::pair<std::thread::id, T> > others_;
+};
+
+
+// ==================================================== //
+// ==================== COMBINABLE ==================== //
+// ==================================================== //
+
+// An accumulator per worker, that starts at the identity and is updated without contention,
+// and merged on demand. The merge op must be associative and commutative, since the
+// instances are not tied to any particular part of the work.
+template <class T>
+class Combinable {
+public:
+    explicit Combinable(ThreadPool& pool, T identity = T())
+        : identity_(identity)
+        , locals_(pool, [identity]() { return identity; })
+    {   }
+
+    T& local() { return locals_.local(); }
+
+    // Folds every local value into the identity. Must not run concurrently with local().
+    template <class Op>
+    T combine(Op&& op) const {
+        T acc = identity_;
+        locals_.forEach([&acc, &op](const T& value) { acc = op(acc, value); });
+        return acc;
+    }
+
+    // Calls fun(const T&) for every local value. Must not run concurrently with local().
+    template <class Fun>
+    void combineEach(Fun&& fun) const {
+        locals_.forEach(std::forward<Fun>(fun));
+    }
+
+    // Number of local values so far
+    size_t size() const { return locals_.size(); }
+
+    // Drops every local value, so that the next local() starts from the identity again
+    void clear() { locals_.clear(); }
+
+private:
+    T identity_;
+    WorkerLocal<T> locals_;
+};
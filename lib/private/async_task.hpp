@@ -4,6 +4,7 @@
 
 #include "type_traits.hpp"
 #include "thread_pool_task_base.hpp"
+#include "stop_token.hpp"
 #include "contract.hpp"
 
 
@@ -12,12 +13,22 @@ namespace details {
 template <class Ret>
 class AsyncTask : public ITaskBase {
 public:
-    AsyncTask(FunctionType<Ret, void>&& func, Promise<Ret>&& promise)
+    AsyncTask(FunctionType<Ret, void>&& func, Promise<Ret>&& promise, StopToken token = StopToken())
         : func_(std::move(func))
         , promise_(std::move(promise))
+        , token_(std::move(token))
     {   }
 
+    bool cancelled() const override {
+        return token_.stopRequested();
+    }
+
+    void cancel() override {
+        promise_.setError(std::make_exception_ptr(CancelledError()));
+    }
+
     void run() override {
+        details::CurrentStopTokenScope token_scope(token_);
         try {
             if constexpr (std::is_same_v<Ret, void>) {
                 func_();
@@ -34,13 +45,14 @@ public:
 private:
     FunctionType<Ret, void> func_;
     Promise<Ret> promise_;
+    StopToken token_;
 };
 
 template <class Ret>
 inline std::unique_ptr<AsyncTask<Ret> >
-make_async_task(FunctionType<Ret, void>&& func, Promise<Ret>&& promise)
+make_async_task(FunctionType<Ret, void>&& func, Promise<Ret>&& promise, StopToken token = StopToken())
 {
-    return std::make_unique<AsyncTask<Ret> >(std::move(func), std::move(promise));
+    return std::make_unique<AsyncTask<Ret> >(std::move(func), std::move(promise), std::move(token));
 }
 
 
@@ -51,13 +63,24 @@ static_assert(!std::is_same_v<Arg, void>, "BoundAsyncTask is only needed for non
 public:
     BoundAsyncTask(FunctionType<Ret, Arg>&& func,
                    Promise<Ret>&& promise,
-                   Arg&& arg)
+                   Arg&& arg,
+                   StopToken token = StopToken())
         : func_(std::move(func))
         , promise_(std::move(promise))
         , arg_(std::move(arg))
+        , token_(std::move(token))
     {   }
 
+    bool cancelled() const override {
+        return token_.stopRequested();
+    }
+
+    void cancel() override {
+        promise_.setError(std::make_exception_ptr(CancelledError()));
+    }
+
     void run() override {
+        details::CurrentStopTokenScope token_scope(token_);
         try {
             if constexpr (std::is_same_v<Ret, void>) {
                 func_(std::move(arg_));
@@ -75,13 +98,14 @@ private:
     FunctionType<Ret, Arg> func_;
     Promise<Ret> promise_;
     Arg arg_;
+    StopToken token_;
 };
 
 template <class Ret, class Arg>
 inline std::unique_ptr<BoundAsyncTask<Ret, Arg> >
-make_bound_async_task(FunctionType<Ret, Arg>&& func, Promise<Ret>&& promise, Arg&& arg)
+make_bound_async_task(FunctionType<Ret, Arg>&& func, Promise<Ret>&& promise, Arg&& arg, StopToken token = StopToken())
 {
-    return std::make_unique<BoundAsyncTask<Ret, Arg> >(std::move(func), std::move(promise), std::move(arg));
+    return std::make_unique<BoundAsyncTask<Ret, Arg> >(std::move(func), std::move(promise), std::move(arg), std::move(token));
 }
 
 
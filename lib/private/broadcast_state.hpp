@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cassert>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <exception>
+
+#include <mutex>
+#include <condition_variable>
+
+#include "subscription.hpp"
+
+
+namespace details {
+
+
+// Forward declare
+template <class T> class BroadcastState;
+
+
+// ================================================================ //
+// ==================== BROADCAST SUBSCRIPTION ==================== //
+// ================================================================ //
+
+// A node of the intrusive list of BroadcastState subscribers.
+// Receives a reference to the state in order to keep the value alive
+// for as long as the subscriber needs it.
+template <class T>
+class IBroadcastSubscription {
+template <class U> friend class BroadcastState;
+
+public:
+    virtual void resolve(const std::shared_ptr<BroadcastState<T> >& state, ResolvedBy by) = 0;
+
+    virtual ~IBroadcastSubscription() = default;
+
+private:
+    IBroadcastSubscription* next_ = nullptr;
+};
+
+template <class T>
+using BroadcastSubscriptionPtr = std::unique_ptr< IBroadcastSubscription<T> >;
+
+
+// ========================================================= //
+// ==================== BROADCAST STATE ==================== //
+// ========================================================= //
+
+// A write-once state with any number of subscribers and blocking waiters.
+// Subscribers are kept in a lock-free intrusive stack, which is closed
+// by the producer. The mutex is only touched by blocking waiters and once
+// by the producer to wake them up.
+template <class T>
+class BroadcastState {
+public:
+    BroadcastState() : subscribers_(nullptr), ready_(false) {   }
+
+    ~BroadcastState();
+
+    // Must be called exactly once.
+    static void produceValue(const std::shared_ptr<BroadcastState>& self, T value, ResolvedBy by);
+    static void produceError(const std::shared_ptr<BroadcastState>& self, std::exception_ptr err, ResolvedBy by);
+
+    // Resolves the subscription instantly if the state has already been produced.
+    static void subscribe(const std::shared_ptr<BroadcastState>& self, BroadcastSubscriptionPtr<T> subscription);
+
+    void wait();
+    bool produced() const { return subscribers_.load(std::memory_order_acquire) == closedTag(); }
+
+    // Must only be accessed after the state has been produced.
+    const std::optional<T>& value() const { return value_; }
+    const std::exception_ptr& error() const { return error_; }
+
+private:
+    static void publish(const std::shared_ptr<BroadcastState>& self, ResolvedBy by);
+
+    IBroadcastSubscription<T>* closedTag() const {
+        // The address of the state itself can never be a subscriber address
+        return reinterpret_cast<IBroadcastSubscription<T>*>(const_cast<BroadcastState*>(this));
+    }
+
+private:
+    std::optional<T> value_ = std::nullopt;
+    std::exception_ptr error_ = nullptr;
+
+    std::atomic<IBroadcastSubscription<T>*> subscribers_;
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool ready_;
+};
+
+
+// ======================================================== //
+// ==================== IMPLEMENTATION ==================== //
+// ======================================================== //
+
+template <class T>
+BroadcastState<T>::~BroadcastState() {
+    // Subscribers of a never produced state are just dropped
+    auto* node = subscribers_.load(std::memory_order_acquire);
+    while (node != nullptr && node != closedTag()) {
+        BroadcastSubscriptionPtr<T> owned(node);
+        node = node->next_;
+    }
+}
+
+template <class T>
+void BroadcastState<T>::produceValue(const std::shared_ptr<BroadcastState>& self, T value, ResolvedBy by) {
+    self->value_.emplace(std::move(value));
+    publish(self, by);
+}
+
+template <class T>
+void BroadcastState<T>::produceError(const std::shared_ptr<BroadcastState>& self, std::exception_ptr err, ResolvedBy by) {
+    self->error_ = std::move(err);
+    publish(self, by);
+}
+
+template <class T>
+void BroadcastState<T>::publish(const std::shared_ptr<BroadcastState>& self, ResolvedBy by) {
+    // Close the list: any later subscriber will be resolved by itself
+    auto* node = self->subscribers_.exchange(self->closedTag(), std::memory_order_acq_rel);
+    assert(node != self->closedTag());
+    {
+        std::lock_guard guard(self->mtx_);
+        self->ready_ = true;
+    }
+    self->cv_.notify_all();
+    // The stack holds the latest subscriber on top: reverse it to keep subscription order
+    IBroadcastSubscription<T>* ordered = nullptr;
+    while (node != nullptr) {
+        auto* next = node->next_;
+        node->next_ = ordered;
+        ordered = node;
+        node = next;
+    }
+    while (ordered != nullptr) {
+        BroadcastSubscriptionPtr<T> subscription(ordered);
+        ordered = ordered->next_;
+        subscription->resolve(self, by);
+    }
+}
+
+template <class T>
+void BroadcastState<T>::subscribe(const std::shared_ptr<BroadcastState>& self, BroadcastSubscriptionPtr<T> subscription) {
+    auto* node = subscription.get();
+    node->next_ = self->subscribers_.load(std::memory_order_acquire);
+    while (node->next_ != self->closedTag()) {
+        if (self->subscribers_.compare_exchange_weak(node->next_, node,
+                                                     std::memory_order_release,
+                                                     std::memory_order_acquire)) {
+            // The state owns the subscription from now on
+            subscription.release();
+            return;
+        }
+    }
+    node->next_ = nullptr;
+    subscription->resolve(self, ResolvedBy::kConsumer);
+}
+
+template <class T>
+void BroadcastState<T>::wait() {
+    if (produced()) {
+        return;
+    }
+    std::unique_lock guard(mtx_);
+    while (!ready_) {
+        cv_.wait(guard);
+    }
+}
+
+
+}  // namespace details
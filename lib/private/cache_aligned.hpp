@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+
+namespace details {
+
+// Not std::hardware_destructive_interference_size, which GCC warns about in headers.
+constexpr size_t kCacheLineSize = 64;
+
+// Keeps values, that are written by different threads, on separate cache lines.
+template <class T>
+struct alignas(kCacheLineSize) CacheAligned {
+    T value;
+};
+
+}  // namespace details
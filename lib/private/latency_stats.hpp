@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <optional>
+
+
+namespace details {
+
+// Keeps a sliding window of the most recent latencies of a callable.
+class LatencyStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t kWindowSize = 256;
+    // Percentiles are not reported until the window holds enough samples
+    static constexpr size_t kMinSamples = 16;
+
+    void record(std::chrono::nanoseconds latency) {
+        std::lock_guard guard(mtx_);
+        samples_[num_recorded_ % kWindowSize] = latency;
+        ++num_recorded_;
+    }
+
+    // `quantile` is given in percents, e.g. 95 for p95
+    std::optional<std::chrono::nanoseconds> percentile(double quantile) const {
+        std::array<std::chrono::nanoseconds, kWindowSize> window;
+        size_t size = 0;
+        {
+            std::lock_guard guard(mtx_);
+            size = std::min<size_t>(num_recorded_, kWindowSize);
+            std::copy(samples_.begin(), samples_.begin() + size, window.begin());
+        }
+        if (size < kMinSamples) {
+            return std::nullopt;
+        }
+        quantile = std::clamp(quantile, 0.0, 100.0);
+        size_t rank = std::min(size - 1, static_cast<size_t>(quantile / 100 * size));
+        std::nth_element(window.begin(), window.begin() + rank, window.begin() + size);
+        return window[rank];
+    }
+
+private:
+    mutable std::mutex mtx_;
+    std::array<std::chrono::nanoseconds, kWindowSize> samples_;
+    uint64_t num_recorded_ = 0;
+};
+
+// Records the lifetime of the scope, including the exceptional exit.
+class LatencyRecorder {
+public:
+    explicit LatencyRecorder(LatencyStats& stats) : stats_(stats), start_(LatencyStats::Clock::now()) {   }
+    ~LatencyRecorder() { stats_.record(LatencyStats::Clock::now() - start_); }
+
+    LatencyRecorder(const LatencyRecorder&) = delete;
+    LatencyRecorder& operator=(const LatencyRecorder&) = delete;
+
+private:
+    LatencyStats& stats_;
+    LatencyStats::Clock::time_point start_;
+};
+
+}  // namespace details
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace details {
+
+template <class Iterator>
+constexpr bool isContiguous() {
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    return std::is_pointer_v<Iterator>
+        || std::is_same_v<Iterator, typename std::vector<T>::iterator>
+        || std::is_same_v<Iterator, typename std::vector<T>::const_iterator>;
+}
+
+template <class T, class Op>
+constexpr bool isPlus() {
+    return std::is_same_v<Op, std::plus<T> > || std::is_same_v<Op, std::plus<> >;
+}
+
+
+// ==================================================== //
+// ==================== SSE2 LANES ==================== //
+// ==================================================== //
+
+// Lanes<T>::kSupported tells whether sums of T have a vector kernel.
+template <class T, class = void>
+struct Lanes {
+    static constexpr bool kSupported = false;
+};
+
+#ifdef __SSE2__
+
+// 32 and 64 bit integers, the sums wrap around
+template <class T>
+struct Lanes<T, std::enable_if_t<std::is_integral_v<T> && (sizeof(T) == 4 || sizeof(T) == 8)> > {
+    static constexpr bool kSupported = true;
+    static constexpr int kNumLanes = 16 / sizeof(T);
+    using Vec = __m128i;
+
+    static Vec set1(T value) {
+        if constexpr (sizeof(T) == 4) {
+            return _mm_set1_epi32(static_cast<int32_t>(value));
+        } else {
+            return _mm_set1_epi64x(static_cast<int64_t>(value));
+        }
+    }
+    static Vec load(const T* ptr) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)); }
+    static void store(T* ptr, Vec vec) { _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), vec); }
+    static Vec add(Vec lhs, Vec rhs) {
+        if constexpr (sizeof(T) == 4) {
+            return _mm_add_epi32(lhs, rhs);
+        } else {
+            return _mm_add_epi64(lhs, rhs);
+        }
+    }
+    template <int kShift>
+    static Vec shift(Vec vec) { return _mm_slli_si128(vec, kShift * sizeof(T)); }
+    static Vec broadcastLast(Vec vec) {
+        if constexpr (sizeof(T) == 4) {
+            return _mm_shuffle_epi32(vec, _MM_SHUFFLE(3, 3, 3, 3));
+        } else {
+            return _mm_shuffle_epi32(vec, _MM_SHUFFLE(3, 2, 3, 2));
+        }
+    }
+};
+
+template <>
+struct Lanes<float> {
+    static constexpr bool kSupported = true;
+    static constexpr int kNumLanes = 4;
+    using Vec = __m128;
+
+    static Vec set1(float value) { return _mm_set1_ps(value); }
+    static Vec load(const float* ptr) { return _mm_loadu_ps(ptr); }
+    static void store(float* ptr, Vec vec) { _mm_storeu_ps(ptr, vec); }
+    static Vec add(Vec lhs, Vec rhs) { return _mm_add_ps(lhs, rhs); }
+    template <int kShift>
+    static Vec shift(Vec vec) { return _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(vec), kShift * 4)); }
+    static Vec broadcastLast(Vec vec) { return _mm_shuffle_ps(vec, vec, _MM_SHUFFLE(3, 3, 3, 3)); }
+};
+
+template <>
+struct Lanes<double> {
+    static constexpr bool kSupported = true;
+    static constexpr int kNumLanes = 2;
+    using Vec = __m128d;
+
+    static Vec set1(double value) { return _mm_set1_pd(value); }
+    static Vec load(const double* ptr) { return _mm_loadu_pd(ptr); }
+    static void store(double* ptr, Vec vec) { _mm_storeu_pd(ptr, vec); }
+    static Vec add(Vec lhs, Vec rhs) { return _mm_add_pd(lhs, rhs); }
+    template <int kShift>
+    static Vec shift(Vec vec) { return _mm_castsi128_pd(_mm_slli_si128(_mm_castpd_si128(vec), kShift * 8)); }
+    static Vec broadcastLast(Vec vec) { return _mm_unpackhi_pd(vec, vec); }
+};
+
+#endif
+
+
+// ===================================================== //
+// ==================== SUM KERNELS ==================== //
+// ===================================================== //
+
+// Prefix sums within the vector, in log2(lanes) shifted additions
+template <class L>
+typename L::Vec prefixLanes(typename L::Vec vec) {
+    vec = L::add(vec, L::template shift<1>(vec));
+    if constexpr (L::kNumLanes == 4) {
+        vec = L::add(vec, L::template shift<2>(vec));
+    }
+    return vec;
+}
+
+template <class L, class T>
+T lastLane(typename L::Vec vec) {
+    T lanes[L::kNumLanes];
+    L::store(lanes, vec);
+    return lanes[L::kNumLanes - 1];
+}
+
+// carry + in[0] + ... + in[size - 1]
+template <class T>
+T reducePlus(const T* in, int64_t size, T carry) {
+    using L = Lanes<T>;
+    typename L::Vec acc = L::set1(T(0));
+    int64_t idx = 0;
+    for (; idx + L::kNumLanes <= size; idx += L::kNumLanes) {
+        acc = L::add(acc, L::load(in + idx));
+    }
+    carry += lastLane<L, T>(prefixLanes<L>(acc));
+    for (; idx < size; ++idx) {
+        carry += in[idx];
+    }
+    return carry;
+}
+
+// out[idx] = carry + in[0] + ... + in[idx], without in[idx] unless inclusive. May run in place.
+// The loop-carried dependency is a single vector addition per vector of inputs.
+template <class T>
+void scanPlus(const T* in, T* out, int64_t size, T carry, bool inclusive) {
+    using L = Lanes<T>;
+    typename L::Vec acc = L::set1(carry);
+    int64_t idx = 0;
+    for (; idx + L::kNumLanes <= size; idx += L::kNumLanes) {
+        typename L::Vec sums = prefixLanes<L>(L::load(in + idx));
+        L::store(out + idx, L::add(inclusive ? sums : L::template shift<1>(sums), acc));
+        acc = L::add(acc, L::broadcastLast(sums));
+    }
+    carry = lastLane<L, T>(acc);
+    for (; idx < size; ++idx) {
+        T value = in[idx];
+        out[idx] = inclusive ? carry + value : carry;
+        carry += value;
+    }
+}
+
+}  // namespace details
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <optional>
+
+#include "thread_pool_task_base.hpp"
+
+
+namespace details {
+
+struct TimerNode {
+    uint64_t expire_tick;
+    std::unique_ptr<ITaskBase> task;
+    bool run_inline;
+    TimerNode* next;
+};
+
+
+// An owning intrusive FIFO list of timers.
+class TimerList {
+public:
+    TimerList() = default;
+    TimerList(TimerList&& other) noexcept : head_(other.head_), tail_(other.tail_) {
+        other.head_ = other.tail_ = nullptr;
+    }
+    TimerList(const TimerList&) = delete;
+    TimerList& operator=(const TimerList&) = delete;
+    TimerList& operator=(TimerList&&) = delete;
+    ~TimerList() { clear(); }
+
+    bool empty() const { return head_ == nullptr; }
+
+    void push(TimerNode* node) {
+        node->next = nullptr;
+        if (tail_) {
+            tail_->next = node;
+        } else {
+            head_ = node;
+        }
+        tail_ = node;
+    }
+
+    TimerNode* popNode() {
+        TimerNode* node = head_;
+        if (node) {
+            head_ = node->next;
+            if (!head_) {
+                tail_ = nullptr;
+            }
+            node->next = nullptr;
+        }
+        return node;
+    }
+
+    std::unique_ptr<TimerNode> pop() { return std::unique_ptr<TimerNode>(popNode()); }
+
+    void clear() {
+        while (TimerNode* node = popNode()) {
+            delete node;
+        }
+    }
+
+private:
+    TimerNode* head_ = nullptr;
+    TimerNode* tail_ = nullptr;
+};
+
+
+// Hierarchical timer wheel with millisecond ticks. Level L has 256 slots,
+// each covering 256^L ticks; timers are moved to the lower level when the
+// wheel reaches their slot. Insertion is O(1), and stopped timers are dropped
+// whenever they are touched, so cancellation costs a single flag store.
+// Not thread safe.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Task = std::unique_ptr<ITaskBase>;
+
+    static constexpr int kBits = 8;
+    static constexpr int kLevels = 4;
+    static constexpr uint64_t kSlots = uint64_t(1) << kBits;
+    static constexpr uint64_t kMask = kSlots - 1;
+    static constexpr Clock::duration kTick = std::chrono::milliseconds(1);
+
+    TimerWheel() : origin_(Clock::now()), current_tick_(0), size_(0) {   }
+
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+
+    void add(Clock::time_point deadline, Task task, bool run_inline);
+
+    // Extracts the timers due by `now`, along with the cancelled ones met on the way.
+    TimerList advance(Clock::time_point now);
+
+    // Extracts the cancelled timers from every slot.
+    TimerList purge();
+
+    // The moment the wheel has to be advanced at; empty if there are no timers.
+    std::optional<Clock::time_point> nextWakeup() const;
+
+    // Extracts every timer, e.g. to cancel them once the wheel is no longer advanced.
+    TimerList drain();
+
+private:
+    uint64_t floorTick(Clock::time_point time) const;
+    uint64_t ceilTick(Clock::time_point time) const;
+    Clock::time_point tickTime(uint64_t tick) const { return origin_ + tick * kTick; }
+
+    void place(TimerNode* node);
+    void cascade(int level, uint64_t slot, TimerList& expired);
+
+private:
+    const Clock::time_point origin_;
+    // All the ticks up to current_tick_ have been processed
+    uint64_t current_tick_;
+    size_t size_;
+    std::array<std::array<TimerList, kSlots>, kLevels> slots_;
+};
+
+}  // namespace details
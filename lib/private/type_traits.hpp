@@ -34,6 +34,24 @@ template <class Ret, class Arg>
 using FunctionType = typename Function<Ret, Arg>::type;
 
 
+// ============================================================== //
+// ==================== const T& or just void ==================== //
+// ============================================================== //
+
+template <class T>
+struct ConstRef {
+    using type = const T&;
+};
+
+template <>
+struct ConstRef<void> {
+    using type = void;
+};
+
+template <class T>
+using ConstRefType = typename ConstRef<T>::type;
+
+
 // =============================================================== //
 // ==================== Check for AsyncResult ==================== //
 // =============================================================== //
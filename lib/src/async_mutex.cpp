@@ -0,0 +1,76 @@
+#include <stdexcept>
+
+#include "async_mutex.hpp"
+
+
+namespace details {
+
+PermitGuard& PermitGuard::operator=(PermitGuard&& other) {
+    if (this != &other) {
+        release();
+        permits_ = std::exchange(other.permits_, nullptr);
+    }
+    return *this;
+}
+
+void PermitGuard::release() {
+    if (permits_ != nullptr) {
+        std::exchange(permits_, nullptr)->release();
+    }
+}
+
+
+AsyncPermits::AsyncPermits(int64_t permits) : count_(permits), handoffs_(0) {
+    if (permits <= 0) {
+        throw std::invalid_argument("Number of permits must be positive");
+    }
+}
+
+AsyncResult<PermitGuard> AsyncPermits::acquire(Executor executor) {
+    if (count_.fetch_sub(1, std::memory_order_acq_rel) > 0) {
+        return AsyncResultAccess::make(executor, Future<PermitGuard>::instantValue(PermitGuard(this)));
+    }
+    auto [promise, future] = contract<PermitGuard>();
+    {
+        std::lock_guard guard(mtx_);
+        if (handoffs_ == 0) {
+            waiters_.push(std::move(promise));
+            return AsyncResultAccess::make(executor, std::move(future));
+        }
+        --handoffs_;
+    }
+    return AsyncResultAccess::make(executor, Future<PermitGuard>::instantValue(PermitGuard(this)));
+}
+
+std::optional<PermitGuard> AsyncPermits::tryAcquire() {
+    int64_t count = count_.load(std::memory_order_relaxed);
+    while (count > 0) {
+        if (count_.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel)) {
+            return PermitGuard(this);
+        }
+    }
+    return std::nullopt;
+}
+
+void AsyncPermits::release() {
+    if (count_.fetch_add(1, std::memory_order_acq_rel) >= 0) {
+        return;
+    }
+    std::optional<Promise<PermitGuard> > waiter;
+    {
+        std::lock_guard guard(mtx_);
+        if (waiters_.empty()) {
+            ++handoffs_;
+            return;
+        }
+        waiter.emplace(std::move(waiters_.front()));
+        waiters_.pop();
+    }
+    // Continuations are dispatched to the waiter's executor outside of the lock
+    waiter->setValue(PermitGuard(this));
+}
+
+}  // namespace details
+
+
+AsyncSemaphore::AsyncSemaphore(int64_t permits) : permits_(permits) {   }
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "gemm.hpp"
+#include "parallel_for.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEMM_X86_KERNELS
+#endif
+
+
+namespace details {
+
+// A tile of c, computed by a single task, is kGemmMC x kGemmNC, and kGemmKC is the depth
+// of the packed panels: the panel of a is kept in L2, a sliver of b in L1.
+constexpr int64_t kGemmMC = 96;
+constexpr int64_t kGemmNC = 256;
+constexpr int64_t kGemmKC = 256;
+// The largest microkernel tile, for the edges
+constexpr int kGemmMaxTile = 6 * 32;
+
+enum class GemmIsa {
+    Portable,
+    Avx2,
+    Avx512,
+};
+
+GemmIsa detectGemmIsa() {
+#ifdef GEMM_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) {
+        return GemmIsa::Avx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return GemmIsa::Avx2;
+    }
+#endif
+    return GemmIsa::Portable;
+}
+
+GemmIsa gemmIsa() {
+    static const GemmIsa isa = detectGemmIsa();
+    return isa;
+}
+
+
+// ====================================================== //
+// ==================== MICROKERNELS ==================== //
+// ====================================================== //
+
+// c[kMR x kNR] += a * b, where the sliver of a holds kMR values and the one of b kNR values per step
+template <class T>
+struct GemmKernel {
+    int mr;
+    int nr;
+    void (*run)(int64_t kc, const T* a, const T* b, T* c, int64_t ldc);
+};
+
+template <class T, int kMR, int kNR>
+void portableKernel(int64_t kc, const T* a, const T* b, T* c, int64_t ldc) {
+    T acc[kMR][kNR] = {};
+    for (int64_t step = 0; step < kc; ++step) {
+        for (int row = 0; row < kMR; ++row) {
+            for (int col = 0; col < kNR; ++col) {
+                acc[row][col] += a[row] * b[col];
+            }
+        }
+        a += kMR;
+        b += kNR;
+    }
+    for (int row = 0; row < kMR; ++row) {
+        for (int col = 0; col < kNR; ++col) {
+            c[row * ldc + col] += acc[row][col];
+        }
+    }
+}
+
+#ifdef GEMM_X86_KERNELS
+
+// kMR rows of kNumVecs vectors are accumulated in registers. The body is compiled for the
+// instruction set of the caller, so that multiply-adds become FMA or vpmullq.
+template <class T, int kMR, int kLanes, int kNumVecs>
+__attribute__((always_inline)) inline void vectorKernel(int64_t kc, const T* a, const T* b, T* c, int64_t ldc) {
+    typedef T Vec __attribute__((vector_size(sizeof(T) * kLanes)));
+    constexpr int kNR = kLanes * kNumVecs;
+    Vec acc[kMR][kNumVecs] = {};
+    for (int64_t step = 0; step < kc; ++step) {
+        Vec b_vecs[kNumVecs];
+        for (int vec = 0; vec < kNumVecs; ++vec) {
+            std::memcpy(&b_vecs[vec], b + vec * kLanes, sizeof(Vec));
+        }
+        for (int row = 0; row < kMR; ++row) {
+            for (int vec = 0; vec < kNumVecs; ++vec) {
+                acc[row][vec] += a[row] * b_vecs[vec];
+            }
+        }
+        a += kMR;
+        b += kNR;
+    }
+    for (int row = 0; row < kMR; ++row) {
+        for (int vec = 0; vec < kNumVecs; ++vec) {
+            Vec out;
+            std::memcpy(&out, c + row * ldc + vec * kLanes, sizeof(Vec));
+            out += acc[row][vec];
+            std::memcpy(c + row * ldc + vec * kLanes, &out, sizeof(Vec));
+        }
+    }
+}
+
+template <class T, int kMR, int kLanes, int kNumVecs>
+__attribute__((target("avx2,fma")))
+void avx2Kernel(int64_t kc, const T* a, const T* b, T* c, int64_t ldc) {
+    vectorKernel<T, kMR, kLanes, kNumVecs>(kc, a, b, c, ldc);
+}
+
+template <class T, int kMR, int kLanes, int kNumVecs>
+__attribute__((target("avx512f,avx512dq")))
+void avx512Kernel(int64_t kc, const T* a, const T* b, T* c, int64_t ldc) {
+    vectorKernel<T, kMR, kLanes, kNumVecs>(kc, a, b, c, ldc);
+}
+
+#endif
+
+template <class T>
+GemmKernel<T> selectKernel() {
+#ifdef GEMM_X86_KERNELS
+    constexpr int kAvx2Lanes = 32 / sizeof(T);
+    constexpr int kAvx512Lanes = 64 / sizeof(T);
+    switch (gemmIsa()) {
+        case GemmIsa::Avx512:
+            return {6, 2 * kAvx512Lanes, &avx512Kernel<T, 6, kAvx512Lanes, 2>};
+        case GemmIsa::Avx2:
+            return {6, 2 * kAvx2Lanes, &avx2Kernel<T, 6, kAvx2Lanes, 2>};
+        case GemmIsa::Portable:
+            break;
+    }
+#endif
+    return {4, 8, &portableKernel<T, 4, 8>};
+}
+
+
+// =========================================================== //
+// ==================== PACKING AND TILES ==================== //
+// =========================================================== //
+
+// Rows of a go to slivers of mr rows, each stored step by step. Missing rows are zeros.
+template <class T>
+void packA(const T* a, int64_t lda, int64_t mc, int64_t kc, int mr, T* pack) {
+    for (int64_t first_row = 0; first_row < mc; first_row += mr) {
+        for (int64_t step = 0; step < kc; ++step) {
+            for (int64_t row = first_row; row < first_row + mr; ++row) {
+                *pack++ = row < mc ? a[row * lda + step] : T(0);
+            }
+        }
+    }
+}
+
+// Columns of b go to slivers of nr columns, each stored step by step. Missing columns are zeros.
+template <class T>
+void packB(const T* b, int64_t ldb, int64_t kc, int64_t nc, int nr, T* pack) {
+    for (int64_t first_col = 0; first_col < nc; first_col += nr) {
+        for (int64_t step = 0; step < kc; ++step) {
+            const T* b_row = b + step * ldb;
+            for (int64_t col = first_col; col < first_col + nr; ++col) {
+                *pack++ = col < nc ? b_row[col] : T(0);
+            }
+        }
+    }
+}
+
+template <class T>
+struct GemmArgs {
+    int64_t m, n, k;
+    const T* a;
+    int64_t lda;
+    const T* b;
+    int64_t ldb;
+    T* c;
+    int64_t ldc;
+};
+
+int64_t roundUp(int64_t value, int64_t step) {
+    return (value + step - 1) / step * step;
+}
+
+template <class T>
+void computeTile(const GemmKernel<T>& kernel, const GemmArgs<T>& args, int64_t first_row, int64_t first_col) {
+    const int64_t mc = std::min(kGemmMC, args.m - first_row);
+    const int64_t nc = std::min(kGemmNC, args.n - first_col);
+    T* c = args.c + first_row * args.ldc + first_col;
+    for (int64_t row = 0; row < mc; ++row) {
+        std::fill(c + row * args.ldc, c + row * args.ldc + nc, T(0));
+    }
+
+    // Tiles are computed one at a time by each thread
+    static thread_local std::vector<T> a_pack;
+    static thread_local std::vector<T> b_pack;
+    a_pack.resize(roundUp(mc, kernel.mr) * kGemmKC);
+    b_pack.resize(roundUp(nc, kernel.nr) * kGemmKC);
+
+    for (int64_t depth = 0; depth < args.k; depth += kGemmKC) {
+        const int64_t kc = std::min(kGemmKC, args.k - depth);
+        packA(args.a + first_row * args.lda + depth, args.lda, mc, kc, kernel.mr, a_pack.data());
+        packB(args.b + depth * args.ldb + first_col, args.ldb, kc, nc, kernel.nr, b_pack.data());
+        for (int64_t col = 0; col < nc; col += kernel.nr) {
+            for (int64_t row = 0; row < mc; row += kernel.mr) {
+                const T* a_sliver = a_pack.data() + row * kc;
+                const T* b_sliver = b_pack.data() + col * kc;
+                T* c_tile = c + row * args.ldc + col;
+                if (row + kernel.mr <= mc && col + kernel.nr <= nc) {
+                    kernel.run(kc, a_sliver, b_sliver, c_tile, args.ldc);
+                    continue;
+                }
+                // Edges go through a full tile on the stack
+                T edge[kGemmMaxTile] = {};
+                kernel.run(kc, a_sliver, b_sliver, edge, kernel.nr);
+                for (int64_t tile_row = 0; tile_row < std::min<int64_t>(kernel.mr, mc - row); ++tile_row) {
+                    for (int64_t tile_col = 0; tile_col < std::min<int64_t>(kernel.nr, nc - col); ++tile_col) {
+                        c_tile[tile_row * args.ldc + tile_col] += edge[tile_row * kernel.nr + tile_col];
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <class T>
+void gemm(ThreadPool& pool, const GemmArgs<T>& args) {
+    if (args.m < 0 || args.n < 0 || args.k < 0) {
+        throw std::invalid_argument("Matrix dimensions must be non-negative");
+    }
+    if (args.lda < args.k || args.ldb < args.n || args.ldc < args.n) {
+        throw std::invalid_argument("Leading dimension is shorter than a row");
+    }
+    static const GemmKernel<T> kernel = selectKernel<T>();
+    const int64_t row_tiles = (args.m + kGemmMC - 1) / kGemmMC;
+    const int64_t col_tiles = (args.n + kGemmNC - 1) / kGemmNC;
+    parallel_for(pool, 0, row_tiles * col_tiles, [&](int64_t tile) {
+        computeTile(kernel, args, tile / col_tiles * kGemmMC, tile % col_tiles * kGemmNC);
+    });
+}
+
+}  // namespace details
+
+
+void parallel_gemm(ThreadPool& pool, int64_t m, int64_t n, int64_t k,
+                   const float* a, int64_t lda, const float* b, int64_t ldb, float* c, int64_t ldc)
+{
+    details::gemm<float>(pool, {m, n, k, a, lda, b, ldb, c, ldc});
+}
+
+void parallel_gemm(ThreadPool& pool, int64_t m, int64_t n, int64_t k,
+                   const double* a, int64_t lda, const double* b, int64_t ldb, double* c, int64_t ldc)
+{
+    details::gemm<double>(pool, {m, n, k, a, lda, b, ldb, c, ldc});
+}
+
+void parallel_gemm(ThreadPool& pool, int64_t m, int64_t n, int64_t k,
+                   const int64_t* a, int64_t lda, const int64_t* b, int64_t ldb, int64_t* c, int64_t ldc)
+{
+    details::gemm<int64_t>(pool, {m, n, k, a, lda, b, ldb, c, ldc});
+}
+
+const char* gemm_isa() {
+    switch (details::gemmIsa()) {
+        case details::GemmIsa::Avx512:
+            return "avx512";
+        case details::GemmIsa::Avx2:
+            return "avx2";
+        case details::GemmIsa::Portable:
+            break;
+    }
+    return "portable";
+}
@@ -0,0 +1,278 @@
+#include <optional>
+
+#include "pipeline.hpp"
+
+
+namespace details {
+
+using PipelineClock = std::chrono::steady_clock;
+
+StageStats StageCounters::snapshot(StageMode mode) const {
+    return StageStats{
+        mode,
+        items.load(std::memory_order_relaxed),
+        std::chrono::nanoseconds(busy_ns.load(std::memory_order_relaxed)),
+        std::chrono::nanoseconds(queued_ns.load(std::memory_order_relaxed)),
+    };
+}
+
+
+class PipelineState : public std::enable_shared_from_this<PipelineState> {
+public:
+    PipelineState(Executor executor,
+                  std::unique_ptr<PipelineSource> source,
+                  std::vector<std::unique_ptr<PipelineStage> > stages,
+                  size_t max_tokens,
+                  Promise<PipelineStats> promise)
+        : executor_(executor)
+        , source_(std::move(source))
+        , stages_(std::move(stages))
+        , max_tokens_(max_tokens)
+        , promise_(std::move(promise))
+        , started_at_(PipelineClock::now())
+    {   }
+
+    void start();
+
+    // Runs the source until max_tokens are in flight. Only one thread feeds at a time.
+    void feed();
+
+    // Carries the token through the stages starting from stage_idx.
+    // If owns_stage is set, the token has already been admitted to that stage.
+    void advance(PipelineToken token, size_t stage_idx, bool owns_stage);
+
+    // Keeps the first error. The source is not called anymore, and the tokens in flight
+    // pass the rest of the stages without work.
+    void fail(std::exception_ptr err);
+
+private:
+    void runStage(PipelineStage& stage, PipelineToken& token);
+    // Lets the next parked token into a serial stage
+    void releaseStage(size_t stage_idx);
+    void finishToken();
+    void completeIfDone(std::unique_lock<std::mutex>& guard);
+
+private:
+    const Executor executor_;
+    const std::unique_ptr<PipelineSource> source_;
+    const std::vector<std::unique_ptr<PipelineStage> > stages_;
+    const size_t max_tokens_;
+    Promise<PipelineStats> promise_;
+    const PipelineClock::time_point started_at_;
+
+    std::atomic<bool> failed_ { false };
+
+    std::mutex mtx_;
+    size_t in_flight_ = 0;
+    uint64_t next_seq_ = 0;
+    bool feeding_ = false;
+    bool source_done_ = false;
+    bool completed_ = false;
+    std::exception_ptr error_ = nullptr;
+};
+
+
+class PipelineTask : public ITaskBase {
+public:
+    // Feeds the pipeline
+    explicit PipelineTask(std::shared_ptr<PipelineState> state) : state_(std::move(state)) {   }
+
+    // Advances the token
+    PipelineTask(std::shared_ptr<PipelineState> state, PipelineToken token, size_t stage_idx, bool owns_stage)
+        : state_(std::move(state))
+        , token_(std::move(token))
+        , stage_idx_(stage_idx)
+        , owns_stage_(owns_stage)
+    {   }
+
+    void run() override {
+        if (token_.has_value()) {
+            state_->advance(std::move(*token_), stage_idx_, owns_stage_);
+        } else {
+            state_->feed();
+        }
+    }
+
+    // The executor drops the task, e.g. its pool is stopped. The pipeline fails, and the task
+    // is run anyway to complete it: the feed stops the source, the token passes without work.
+    void cancel() override {
+        state_->fail(std::make_exception_ptr(CancelledError()));
+        run();
+    }
+
+private:
+    std::shared_ptr<PipelineState> state_;
+    std::optional<PipelineToken> token_;
+    size_t stage_idx_ = 0;
+    bool owns_stage_ = false;
+};
+
+
+// ============================================== //
+// ==================== FEED ==================== //
+// ============================================== //
+
+void PipelineState::start() {
+    executor_.submit(std::make_unique<PipelineTask>(shared_from_this()));
+}
+
+void PipelineState::feed() {
+    std::unique_lock guard(mtx_);
+    if (feeding_ || source_done_) {
+        return;
+    }
+    feeding_ = true;
+    while (!source_done_ && in_flight_ < max_tokens_) {
+        guard.unlock();
+        std::unique_ptr<PipelineItemBase> item = nullptr;
+        auto start = PipelineClock::now();
+        if (!failed_.load(std::memory_order_acquire)) {
+            try {
+                FlowControl flow;
+                item = source_->produce(flow);
+            } catch (...) {
+                fail(std::current_exception());
+            }
+        }
+        auto end = PipelineClock::now();
+        guard.lock();
+        if (item == nullptr) {
+            source_done_ = true;
+            break;
+        }
+        source_->counters.items.fetch_add(1, std::memory_order_relaxed);
+        source_->counters.busy_ns.fetch_add((end - start).count(), std::memory_order_relaxed);
+        ++in_flight_;
+        uint64_t seq = next_seq_++;
+        guard.unlock();
+        executor_.submit(std::make_unique<PipelineTask>(
+            shared_from_this(), PipelineToken{seq, std::move(item), end}, 0, false));
+        guard.lock();
+    }
+    feeding_ = false;
+    completeIfDone(guard);
+}
+
+
+// ================================================= //
+// ==================== ADVANCE ==================== //
+// ================================================= //
+
+void PipelineState::advance(PipelineToken token, size_t stage_idx, bool owns_stage) {
+    for (; stage_idx < stages_.size(); ++stage_idx, owns_stage = false) {
+        PipelineStage& stage = *stages_[stage_idx];
+        if (stage.mode == StageMode::Parallel) {
+            runStage(stage, token);
+            continue;
+        }
+        if (!owns_stage) {
+            std::lock_guard guard(stage.mtx);
+            bool out_of_turn = stage.mode == StageMode::SerialInOrder && token.seq != stage.next_seq;
+            if (stage.busy || out_of_turn) {
+                // Resumed by the token, that releases the stage
+                uint64_t seq = token.seq;
+                stage.parked.emplace(seq, std::move(token));
+                return;
+            }
+            stage.busy = true;
+        }
+        runStage(stage, token);
+        releaseStage(stage_idx);
+    }
+    finishToken();
+}
+
+void PipelineState::runStage(PipelineStage& stage, PipelineToken& token) {
+    auto start = PipelineClock::now();
+    // After a failure tokens pass through without work, so that serial stages keep their order
+    if (!failed_.load(std::memory_order_acquire)) {
+        try {
+            stage.apply(token);
+        } catch (...) {
+            fail(std::current_exception());
+        }
+    }
+    auto end = PipelineClock::now();
+    stage.counters.items.fetch_add(1, std::memory_order_relaxed);
+    stage.counters.busy_ns.fetch_add((end - start).count(), std::memory_order_relaxed);
+    stage.counters.queued_ns.fetch_add((start - token.ready_at).count(), std::memory_order_relaxed);
+    token.ready_at = end;
+}
+
+void PipelineState::releaseStage(size_t stage_idx) {
+    PipelineStage& stage = *stages_[stage_idx];
+    std::optional<PipelineToken> next;
+    {
+        std::lock_guard guard(stage.mtx);
+        ++stage.next_seq;
+        auto next_it = stage.mode == StageMode::SerialInOrder
+            ? stage.parked.find(stage.next_seq)
+            : stage.parked.begin();
+        if (next_it == stage.parked.end()) {
+            stage.busy = false;
+            return;
+        }
+        next.emplace(std::move(next_it->second));
+        stage.parked.erase(next_it);
+    }
+    // The stage stays busy on behalf of the next token
+    executor_.submit(std::make_unique<PipelineTask>(shared_from_this(), std::move(*next), stage_idx, true));
+}
+
+
+// ================================================== //
+// ==================== COMPLETE ==================== //
+// ================================================== //
+
+void PipelineState::finishToken() {
+    std::unique_lock guard(mtx_);
+    --in_flight_;
+    if (!source_done_ && !feeding_) {
+        guard.unlock();
+        feed();
+        return;
+    }
+    completeIfDone(guard);
+}
+
+void PipelineState::fail(std::exception_ptr err) {
+    std::lock_guard guard(mtx_);
+    if (error_ == nullptr) {
+        error_ = std::move(err);
+    }
+    failed_.store(true, std::memory_order_release);
+}
+
+void PipelineState::completeIfDone(std::unique_lock<std::mutex>& guard) {
+    if (!source_done_ || in_flight_ != 0 || completed_) {
+        return;
+    }
+    completed_ = true;
+    std::exception_ptr err = error_;
+    guard.unlock();
+    if (err != nullptr) {
+        promise_.setError(std::move(err));
+        return;
+    }
+    PipelineStats stats;
+    stats.stages.push_back(source_->counters.snapshot(StageMode::SerialInOrder));
+    for (const auto& stage : stages_) {
+        stats.stages.push_back(stage->counters.snapshot(stage->mode));
+    }
+    stats.elapsed = PipelineClock::now() - started_at_;
+    promise_.setValue(std::move(stats));
+}
+
+
+void startPipeline(Executor executor,
+                   std::unique_ptr<PipelineSource> source,
+                   std::vector<std::unique_ptr<PipelineStage> > stages,
+                   size_t max_tokens,
+                   Promise<PipelineStats> promise)
+{
+    auto state = std::make_shared<PipelineState>(
+        executor, std::move(source), std::move(stages), max_tokens, std::move(promise));
+    state->start();
+}
+
+}  // namespace details
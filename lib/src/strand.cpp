@@ -0,0 +1,69 @@
+#include <queue>
+#include <vector>
+
+#include "strand.hpp"
+
+
+namespace details {
+
+class StrandDrainTask : public ITaskBase {
+public:
+    explicit StrandDrainTask(std::shared_ptr<StrandState> state) : state_(std::move(state)) {   }
+
+    void run() override {
+        std::vector<std::unique_ptr<ITaskBase> > batch;
+        batch.reserve(Strand::kMaxBatch);
+        {
+            std::unique_lock guard(state_->mtx);
+            while (!state_->tasks.empty() && batch.size() < static_cast<size_t>(Strand::kMaxBatch)) {
+                batch.push_back(std::move(state_->tasks.front()));
+                state_->tasks.pop();
+            }
+        }
+        for (auto& task : batch) {
+            if (task->cancelled()) {
+                task->cancel();
+            } else {
+                task->run();
+            }
+        }
+        std::unique_lock guard(state_->mtx);
+        if (state_->tasks.empty()) {
+            state_->active = false;
+            return;
+        }
+        guard.unlock();
+        // Yield the worker and continue in the tail of the pool queue
+        state_->pool.submit(std::make_unique<StrandDrainTask>(std::move(state_)));
+    }
+
+    // The pool has stopped, so the queue is never going to be drained
+    void cancel() override {
+        std::queue<std::unique_ptr<ITaskBase> > tasks;
+        {
+            std::unique_lock guard(state_->mtx);
+            std::swap(tasks, state_->tasks);
+            state_->active = false;
+        }
+        for (; !tasks.empty(); tasks.pop()) {
+            tasks.front()->cancel();
+        }
+    }
+
+private:
+    std::shared_ptr<StrandState> state_;
+};
+
+}  // namespace details
+
+
+void Strand::submit(Strand::Task task) {
+    std::unique_lock guard(state_->mtx);
+    state_->tasks.push(std::move(task));
+    if (state_->active) {
+        return;
+    }
+    state_->active = true;
+    guard.unlock();
+    state_->pool.submit(std::make_unique<details::StrandDrainTask>(state_));
+}
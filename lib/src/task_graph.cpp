@@ -0,0 +1,218 @@
+#include <stdexcept>
+#include <thread>
+
+#include "task_graph.hpp"
+
+
+namespace details {
+
+void GraphNode::run() {
+    graph_.execute(this);
+}
+
+}  // namespace details
+
+
+details::GraphNode& TaskGraph::addNode(details::GraphNode::Kind kind) {
+    if (running_.load(std::memory_order_acquire)) {
+        throw std::logic_error("Changing a running TaskGraph");
+    }
+    prepared_ = false;
+    return nodes_.emplace_back(*this, kind, nodes_.size());
+}
+
+TaskGraph::NodeId TaskGraph::addSubgraph(TaskGraph& subgraph) {
+    if (&subgraph == this) {
+        throw std::invalid_argument("TaskGraph cannot be its own subgraph");
+    }
+    details::GraphNode& node = addNode(details::GraphNode::Kind::Subgraph);
+    node.subgraph_ = &subgraph;
+    return nodes_.size() - 1;
+}
+
+void TaskGraph::addEdge(NodeId from, NodeId to) {
+    if (from >= nodes_.size() || to >= nodes_.size()) {
+        throw std::invalid_argument("Unknown TaskGraph node");
+    }
+    if (from == to) {
+        throw std::invalid_argument("TaskGraph node cannot depend on itself");
+    }
+    if (running_.load(std::memory_order_acquire)) {
+        throw std::logic_error("Changing a running TaskGraph");
+    }
+    prepared_ = false;
+    nodes_[from].successors_.push_back(&nodes_[to]);
+}
+
+void TaskGraph::prepare() {
+    if (prepared_) {
+        return;
+    }
+    for (details::GraphNode& node : nodes_) {
+        node.num_predecessors_ = 0;
+    }
+    for (details::GraphNode& node : nodes_) {
+        for (details::GraphNode* successor : node.successors_) {
+            ++successor->num_predecessors_;
+        }
+    }
+    roots_.clear();
+    for (details::GraphNode& node : nodes_) {
+        if (node.num_predecessors_ == 0) {
+            roots_.push_back(&node);
+        }
+    }
+
+    // Kahn's algorithm visits every node unless there is a cycle
+    std::vector<int> pending(nodes_.size());
+    for (size_t idx = 0; idx < nodes_.size(); ++idx) {
+        pending[idx] = nodes_[idx].num_predecessors_;
+    }
+    std::vector<details::GraphNode*> queue = roots_;
+    for (size_t head = 0; head < queue.size(); ++head) {
+        for (details::GraphNode* successor : queue[head]->successors_) {
+            if (--pending[successor->index_] == 0) {
+                queue.push_back(successor);
+            }
+        }
+    }
+    if (queue.size() != nodes_.size()) {
+        throw std::invalid_argument("TaskGraph has a cycle");
+    }
+
+    forked_ = std::make_unique<std::atomic<details::GraphNode*>[]>(nodes_.size());
+    prepared_ = true;
+}
+
+void TaskGraph::run(ThreadPool& pool) {
+    if (running_.exchange(true, std::memory_order_acq_rel)) {
+        throw std::logic_error("TaskGraph is already running");
+    }
+    struct RunningGuard {
+        std::atomic<bool>& running;
+        ~RunningGuard() { running.store(false, std::memory_order_release); }
+    } running_guard{running_};
+
+    prepare();
+    if (roots_.empty()) {
+        return;
+    }
+    for (details::GraphNode& node : nodes_) {
+        node.pending_predecessors_.store(node.num_predecessors_, std::memory_order_relaxed);
+    }
+    pool_ = &pool;
+    num_forked_.store(0, std::memory_order_relaxed);
+    failed_.store(false, std::memory_order_relaxed);
+    error_ = nullptr;
+    num_active_.store(roots_.size());
+
+    for (size_t idx = 1; idx < roots_.size(); ++idx) {
+        fork(roots_[idx]);
+    }
+    execute(roots_.front());
+
+    // Every forked node is joined: the ones still offered are run here, and the stolen ones
+    // are waited for, so that no worker touches the graph after the return.
+    size_t num_joined = 0;
+    for (;;) {
+        if (num_joined < num_forked_.load()) {
+            details::GraphNode* node;
+            // The slot is reserved before the node is forked and filled right after
+            while ((node = forked_[num_joined].load(std::memory_order_acquire)) == nullptr) {
+                std::this_thread::yield();
+            }
+            node->join();
+            ++num_joined;
+            continue;
+        }
+        std::unique_lock guard(mtx_);
+        caller_waiting_.store(true);
+        cv_.wait(guard, [this, num_joined]() { return num_active_.load() == 0 || num_forked_.load() > num_joined; });
+        caller_waiting_.store(false, std::memory_order_relaxed);
+        if (num_active_.load() == 0 && num_forked_.load() == num_joined) {
+            break;
+        }
+    }
+    for (size_t idx = 0; idx < num_joined; ++idx) {
+        forked_[idx].store(nullptr, std::memory_order_relaxed);
+    }
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+void TaskGraph::execute(details::GraphNode* node) {
+    while (node != nullptr) {
+        details::GraphNode* next = nullptr;
+        // Successors to release: all of them, or the one chosen by a condition
+        size_t first = 0;
+        size_t last = node->successors_.size();
+        if (!failed_.load(std::memory_order_relaxed)) {
+            try {
+                switch (node->kind_) {
+                    case details::GraphNode::Kind::Task:
+                        node->work_();
+                        break;
+                    case details::GraphNode::Kind::Condition:
+                        first = node->condition_();
+                        if (first >= last) {
+                            throw std::out_of_range("Condition node chose a successor it does not have");
+                        }
+                        last = first + 1;
+                        break;
+                    case details::GraphNode::Kind::Subgraph:
+                        node->subgraph_->run(*pool_);
+                        break;
+                }
+            } catch (...) {
+                fail(std::current_exception());
+            }
+        }
+        if (!failed_.load(std::memory_order_relaxed)) {
+            for (size_t idx = first; idx < last; ++idx) {
+                details::GraphNode* successor = node->successors_[idx];
+                if (successor->pending_predecessors_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                    continue;
+                }
+                num_active_.fetch_add(1);
+                if (next == nullptr) {
+                    next = successor;
+                } else {
+                    fork(successor);
+                }
+            }
+        }
+        // Successors are counted before the node is done, so the run cannot complete in between
+        if (num_active_.fetch_sub(1) == 1) {
+            wakeCaller();
+        }
+        node = next;
+    }
+}
+
+void TaskGraph::fork(details::GraphNode* node) {
+    // The slot is reserved while the forking node is still active, so the caller cannot see
+    // the run complete without it; and filled after the fork, so it never joins a node that
+    // has not been offered yet.
+    size_t slot = num_forked_.fetch_add(1);
+    node->fork(*pool_);
+    forked_[slot].store(node, std::memory_order_release);
+    wakeCaller();
+}
+
+void TaskGraph::fail(std::exception_ptr error) {
+    std::lock_guard guard(mtx_);
+    if (!failed_.load(std::memory_order_relaxed)) {
+        error_ = std::move(error);
+        failed_.store(true, std::memory_order_relaxed);
+    }
+}
+
+void TaskGraph::wakeCaller() {
+    // The caller publishes that it waits before checking the counters, and the counters are
+    // changed before this check, so either the caller sees the change or it is woken up
+    if (caller_waiting_.load()) {
+        std::lock_guard guard(mtx_);
+        cv_.notify_all();
+    }
+}
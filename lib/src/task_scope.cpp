@@ -0,0 +1,63 @@
+#include <stdexcept>
+
+#include "task_scope.hpp"
+
+
+namespace details {
+
+ScopeState::ScopeState(Executor executor, const StopToken& parent_token, Promise<void> promise)
+    : executor_(executor)
+    , stop_source_(parent_token)
+    , num_pending_(1)
+    , failed_(false)
+    , first_error_(nullptr)
+    , promise_(std::move(promise))
+    , future_()
+    , joined_(false)
+{   }
+
+void ScopeState::acquire() {
+    int64_t pending = num_pending_.load(std::memory_order_relaxed);
+    do {
+        if (pending == 0) {
+            throw std::logic_error("Spawning into a completed TaskScope");
+        }
+    } while (!num_pending_.compare_exchange_weak(pending, pending + 1, std::memory_order_relaxed));
+}
+
+void ScopeState::release() {
+    if (num_pending_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    if (failed_.load(std::memory_order_acquire)) {
+        promise_.setError(first_error_);
+    } else {
+        promise_.setValue(Void{});
+    }
+}
+
+void ScopeState::fail(std::exception_ptr error) {
+    if (!failed_.exchange(true, std::memory_order_acq_rel)) {
+        first_error_ = std::move(error);
+        stop_source_.requestStop();
+    }
+}
+
+}  // namespace details
+
+
+TaskScope::TaskScope(Executor executor, const StopToken& parent_token) {
+    auto [promise, future] = contract<void>();
+    state_ = std::make_shared<details::ScopeState>(executor, parent_token, std::move(promise));
+    state_->future_ = std::move(future);
+}
+
+AsyncResult<void> TaskScope::join() {
+    if (state_->joined_.exchange(true, std::memory_order_acq_rel)) {
+        throw std::logic_error("TaskScope is joined twice");
+    }
+    auto result = details::AsyncResultAccess::make(state_->executor(), std::move(state_->future_));
+    // Drop the reference of the scope itself
+    state_->release();
+    return result;
+}
@@ -0,0 +1,87 @@
+#include <thread>
+
+#include "team.hpp"
+
+
+namespace details {
+
+// Checks of the shared sense before yielding, and yields before blocking. Spinning is enough
+// when every member has a core; yielding lets members that share one take their turn.
+constexpr int kBarrierSpins = 1 << 10;
+constexpr int kBarrierYields = 1 << 6;
+
+void TeamBarrier::arriveAndWait(bool& local_sense) {
+    if (broken_.load(std::memory_order_acquire)) {
+        throw TeamAborted();
+    }
+    if (pending_.value.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        // Nobody arrives again before the sense is flipped
+        pending_.value.store(size_, std::memory_order_relaxed);
+        sense_.value.store(local_sense, std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_seq_cst) > 0) {
+            wake();
+        }
+        local_sense = !local_sense;
+        return;
+    }
+
+    bool done = false;
+    for (int spin = 0; spin < kBarrierSpins && !done; ++spin) {
+        done = released(local_sense);
+    }
+    for (int yield = 0; yield < kBarrierYields && !done; ++yield) {
+        std::this_thread::yield();
+        done = released(local_sense);
+    }
+    if (!done) {
+        // The sleeper count is published before the sense is checked again, and the sense before
+        // the count is read by the last member, all of it seq_cst, so either of them sees the other.
+        std::unique_lock guard(mtx_);
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        cv_.wait(guard, [this, local_sense]() { return released(local_sense); });
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    if (sense_.value.load(std::memory_order_acquire) != local_sense) {
+        throw TeamAborted();
+    }
+    local_sense = !local_sense;
+}
+
+void TeamBarrier::breakBarrier() {
+    broken_.store(true, std::memory_order_seq_cst);
+    wake();
+}
+
+void TeamBarrier::wake() {
+    // Under the mutex, so that a member between its check and its wait does not miss it
+    std::lock_guard guard(mtx_);
+    cv_.notify_all();
+}
+
+
+void TeamState::fail(std::exception_ptr error) {
+    {
+        std::lock_guard guard(mtx_);
+        if (!error_) {
+            error_ = std::move(error);
+        }
+    }
+    barrier.breakBarrier();
+}
+
+void TeamState::finishMember() {
+    std::lock_guard guard(mtx_);
+    if (--running_ == 0) {
+        cv_.notify_all();
+    }
+}
+
+void TeamState::join() {
+    std::unique_lock guard(mtx_);
+    cv_.wait(guard, [this]() { return running_ == 0; });
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+}  // namespace details
@@ -2,25 +2,62 @@
 #include "thread_pool.hpp"
 
 
-void runWorkerLoop(ThreadPool *pool) {
+namespace {
+// The pool, whose worker is the current thread, and the index of the worker in it
+thread_local ThreadPool* current_pool = nullptr;
+thread_local int current_worker = -1;
+
+// A purge walks every slot of the wheel, so it waits for enough retired timers to pay off
+constexpr size_t kMinTimersToPurge = 1024;
+}
+
+void runWorkerLoop(ThreadPool *pool, int index) {
+    current_pool = pool;
+    current_worker = index;
+    std::unique_lock guard(pool->mtx_);
     for (;;) {
-        ThreadPool::Task task = nullptr;
-        {
-            std::unique_lock guard(pool->mtx_);
-            pool->queue_cv_.wait(guard, [pool]() {
-                return !pool->tasks_.empty() || pool->stopped_;
-            });
-            if (pool->stopped_) {
-                break;
-            }
-            task = std::move(pool->tasks_.front());
-            pool->tasks_.pop();
+        pool->queue_cv_.wait(guard, [pool]() {
+            return pool->hasWork() || pool->stopped_;
+        });
+        if (pool->stopped_) {
+            break;
         }
-        if (!task) {
-            LOG_ERR << "Empty task was returned from task queue";
+        pool->runOne(guard);
+    }
+}
+
+void runTimerLoop(ThreadPool *pool) {
+    std::unique_lock guard(pool->timer_mtx_);
+    for (;;) {
+        if (pool->timer_stopped_) {
+            break;
+        }
+        auto wakeup = pool->timers_.nextWakeup();
+        pool->timer_wakeup_ = wakeup.value_or(ThreadPool::Clock::time_point::max());
+        if (!wakeup) {
+            pool->timer_cv_.wait(guard);
+            continue;
+        }
+        auto now = ThreadPool::Clock::now();
+        if (now < *wakeup) {
+            pool->timer_cv_.wait_until(guard, *wakeup);
             continue;
         }
-        task->run();
+        details::TimerList expired = pool->timers_.advance(now);
+        guard.unlock();
+        while (auto node = expired.pop()) {
+            ThreadPool::Task task = std::move(node->task);
+            if (task->cancelled()) {
+                // Do not occupy a worker with a task that would be skipped anyway
+                task->cancel();
+            } else if (node->run_inline) {
+                task->run();
+            } else {
+                // Expired tasks are executed by workers, so that user code never blocks the timer
+                pool->submit(std::move(task));
+            }
+        }
+        guard.lock();
     }
 }
 
@@ -31,23 +68,54 @@ void ThreadPool::start(int num_threads) {
     }
     LOG_INFO << "Starting a thread pool with " << num_threads << " workers";
     for (int i_thread = 0; i_thread < num_threads; ++i_thread) {
-        workers_.push_back(std::thread(runWorkerLoop, this));
+        workers_.push_back(std::thread(runWorkerLoop, this, i_thread));
     }
 }
 
 void ThreadPool::stop() {
+    // Stop the timer first, since it submits to the pool
+    stopTimer();
+    std::queue<Task> leftover;
     {
         std::unique_lock guard(mtx_);
         stopped_ = true;
+        std::swap(leftover, tasks_);
         // notify workers in worker loop that pool was stopped
         queue_cv_.notify_all();
     }
+    // Nobody is going to run the tasks left in the queue, but their results must still be resolved.
+    // Before the join, since a running task may wait for one of them, e.g. a member of its team.
+    for (; !leftover.empty(); leftover.pop()) {
+        leftover.front()->cancel();
+    }
     for (auto &worker : workers_) {
         worker.join();
     }
     workers_.clear();
 }
 
+void ThreadPool::stopTimer() {
+    {
+        std::unique_lock guard(timer_mtx_);
+        timer_stopped_ = true;
+        timer_cv_.notify_all();
+    }
+    if (timer_thread_.joinable()) {
+        timer_thread_.join();
+    }
+    std::unique_lock guard(timer_mtx_);
+    details::TimerList pending = timers_.drain();
+    guard.unlock();
+    // Nobody is going to run them, but their results must still be resolved
+    while (auto node = pending.pop()) {
+        node->task->cancel();
+    }
+}
+
+int ThreadPool::currentWorker() const {
+    return current_pool == this ? current_worker : -1;
+}
+
 void ThreadPool::submit(ThreadPool::Task task) {
     std::unique_lock guard(mtx_);
     if (!stopped_) {
@@ -55,6 +123,155 @@ void ThreadPool::submit(ThreadPool::Task task) {
         guard.unlock();
         queue_cv_.notify_one();
     } else {
+        guard.unlock();
         LOG_ERR << "Attempting to submit to stopped pool";
+        task->cancel();
+    }
+}
+
+bool ThreadPool::runOne(std::unique_lock<std::mutex>& guard) {
+    if (!tasks_.empty()) {
+        Task task = std::move(tasks_.front());
+        tasks_.pop();
+        guard.unlock();
+        if (!task) {
+            LOG_ERR << "Empty task was returned from task queue";
+        } else if (task->cancelled()) {
+            // Nobody needs the result anymore: skip the task, but still resolve it
+            task->cancel();
+        } else {
+            task->run();
+        }
+        task.reset();
+        guard.lock();
+        return true;
+    }
+    if (oldest_offered_ != nullptr) {
+        // The oldest task is the biggest piece of work of its owner
+        details::StackTask* stolen = oldest_offered_;
+        retract(stolen);
+        stolen->stolen_.store(true, std::memory_order_relaxed);
+        guard.unlock();
+        stolen->run();
+        guard.lock();
+        // The owner may leave the scope of the task as soon as the lock is released
+        stolen->done_ = true;
+        if (stolen->awaited_) {
+            queue_cv_.notify_all();
+            stolen_cv_.notify_all();
+        }
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::offer(details::StackTask* task) {
+    std::unique_lock guard(mtx_);
+    task->offered_ = true;
+    task->older_ = newest_offered_;
+    if (newest_offered_ != nullptr) {
+        newest_offered_->newer_ = task;
+    } else {
+        oldest_offered_ = task;
+    }
+    newest_offered_ = task;
+    guard.unlock();
+    queue_cv_.notify_one();
+}
+
+bool ThreadPool::retract(details::StackTask* task) {
+    if (!task->offered_) {
+        return false;
     }
+    (task->newer_ != nullptr ? task->newer_->older_ : newest_offered_) = task->older_;
+    (task->older_ != nullptr ? task->older_->newer_ : oldest_offered_) = task->newer_;
+    task->newer_ = task->older_ = nullptr;
+    task->offered_ = false;
+    return true;
 }
+
+void ThreadPool::waitStolen(details::StackTask* task) {
+    std::unique_lock guard(mtx_);
+    task->awaited_ = true;
+    if (current_pool != this) {
+        // Must not consume wakeups, that are meant for workers
+        stolen_cv_.wait(guard, [task]() { return task->done_; });
+        return;
+    }
+    while (!task->done_) {
+        if (!runOne(guard)) {
+            queue_cv_.wait(guard);
+        }
+    }
+}
+
+void ThreadPool::addTimer(Clock::time_point deadline, ThreadPool::Task task, bool run_inline) {
+    std::unique_lock guard(timer_mtx_);
+    if (timer_stopped_) {
+        guard.unlock();
+        LOG_ERR << "Attempting to submit timer to stopped pool";
+        // E.g. a periodic task, that reschedules itself while the pool stops
+        task->cancel();
+        return;
+    }
+    if (!timer_thread_.joinable()) {
+        timer_thread_ = std::thread(runTimerLoop, this);
+    }
+    timers_.add(deadline, std::move(task), run_inline);
+    // The timer thread only needs to wake up if the new deadline is earlier than its wakeup
+    bool earlier = deadline < timer_wakeup_;
+    if (earlier) {
+        timer_wakeup_ = deadline;
+    }
+    guard.unlock();
+    if (earlier) {
+        timer_cv_.notify_one();
+    }
+}
+
+size_t ThreadPool::numTimers() {
+    std::lock_guard guard(timer_mtx_);
+    return timers_.size();
+}
+
+void ThreadPool::retireTimer() {
+    std::unique_lock guard(timer_mtx_);
+    ++num_retired_timers_;
+    if (num_retired_timers_ < kMinTimersToPurge || 2 * num_retired_timers_ < timers_.size()) {
+        return;
+    }
+    num_retired_timers_ = 0;
+    details::TimerList purged = timers_.purge();
+    guard.unlock();
+    while (auto node = purged.pop()) {
+        node->task->cancel();
+    }
+}
+
+
+// ==================================================== //
+// ==================== STACK TASK ==================== //
+// ==================================================== //
+
+namespace details {
+
+void StackTask::fork(ThreadPool& pool) {
+    pool_ = &pool;
+    done_ = false;
+    stolen_.store(false, std::memory_order_relaxed);
+    pool.offer(this);
+}
+
+void StackTask::join() {
+    {
+        std::unique_lock guard(pool_->mtx_);
+        if (!pool_->retract(this)) {
+            guard.unlock();
+            pool_->waitStolen(this);
+            return;
+        }
+    }
+    run();
+}
+
+}  // namespace details
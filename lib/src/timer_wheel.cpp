@@ -0,0 +1,131 @@
+#include <algorithm>
+
+#include "timer_wheel.hpp"
+
+
+namespace details {
+
+// Far enough to never be reached, yet safe from overflows
+static constexpr uint64_t kMaxTick = uint64_t(1) << 62;
+
+uint64_t TimerWheel::floorTick(Clock::time_point time) const {
+    if (time <= origin_) {
+        return 0;
+    }
+    auto ticks = (time - origin_) / kTick;
+    return std::min<uint64_t>(static_cast<uint64_t>(ticks), kMaxTick);
+}
+
+uint64_t TimerWheel::ceilTick(Clock::time_point time) const {
+    uint64_t tick = floorTick(time);
+    return (tick < kMaxTick && tickTime(tick) < time) ? tick + 1 : tick;
+}
+
+void TimerWheel::add(Clock::time_point deadline, Task task, bool run_inline) {
+    if (size_ == 0) {
+        // Nothing to process in between, so an idle wheel jumps right to the present
+        current_tick_ = std::max(current_tick_, floorTick(Clock::now()));
+    }
+    // The current tick has already been processed
+    uint64_t expire_tick = std::max(ceilTick(deadline), current_tick_ + 1);
+    place(new TimerNode{expire_tick, std::move(task), run_inline, nullptr});
+    ++size_;
+}
+
+void TimerWheel::place(TimerNode* node) {
+    uint64_t delta = node->expire_tick - current_tick_;
+    for (int level = 0; level < kLevels; ++level) {
+        if (delta < (uint64_t(1) << (kBits * (level + 1)))) {
+            slots_[level][(node->expire_tick >> (kBits * level)) & kMask].push(node);
+            return;
+        }
+    }
+    // Beyond the horizon: park in the farthest slot and place again once it is reached
+    uint64_t farthest = current_tick_ + (uint64_t(1) << (kBits * kLevels)) - 1;
+    slots_[kLevels - 1][(farthest >> (kBits * (kLevels - 1))) & kMask].push(node);
+}
+
+void TimerWheel::cascade(int level, uint64_t slot, TimerList& expired) {
+    TimerList nodes(std::move(slots_[level][slot]));
+    while (TimerNode* node = nodes.popNode()) {
+        if (node->task->cancelled()) {
+            --size_;
+            expired.push(node);
+        } else {
+            place(node);
+        }
+    }
+}
+
+TimerList TimerWheel::advance(Clock::time_point now) {
+    TimerList expired;
+    uint64_t target = floorTick(now);
+    if (size_ == 0) {
+        current_tick_ = std::max(current_tick_, target);
+        return expired;
+    }
+    while (current_tick_ < target && size_ > 0) {
+        uint64_t tick = ++current_tick_;
+        // Refill the lower levels as soon as the wheel enters the slot of an upper one
+        for (int level = 1; level < kLevels; ++level) {
+            if (((tick >> (kBits * (level - 1))) & kMask) != 0) {
+                break;
+            }
+            cascade(level, (tick >> (kBits * level)) & kMask, expired);
+        }
+        TimerList& due = slots_[0][tick & kMask];
+        while (TimerNode* node = due.popNode()) {
+            --size_;
+            expired.push(node);
+        }
+    }
+    current_tick_ = std::max(current_tick_, target);
+    return expired;
+}
+
+TimerList TimerWheel::purge() {
+    TimerList purged;
+    for (auto& level : slots_) {
+        for (auto& slot : level) {
+            TimerList nodes(std::move(slot));
+            while (TimerNode* node = nodes.popNode()) {
+                if (node->task->cancelled()) {
+                    --size_;
+                    purged.push(node);
+                } else {
+                    slot.push(node);
+                }
+            }
+        }
+    }
+    return purged;
+}
+
+std::optional<TimerWheel::Clock::time_point> TimerWheel::nextWakeup() const {
+    if (size_ == 0) {
+        return std::nullopt;
+    }
+    // Either a timer of the lowest level expires, or the upper levels need to be cascaded
+    uint64_t tick = current_tick_ + 1;
+    for (; (tick & kMask) != 0; ++tick) {
+        if (!slots_[0][tick & kMask].empty()) {
+            break;
+        }
+    }
+    return tickTime(tick);
+}
+
+TimerList TimerWheel::drain() {
+    TimerList drained;
+    for (auto& level : slots_) {
+        for (auto& slot : level) {
+            while (TimerNode* node = slot.popNode()) {
+                drained.push(node);
+            }
+        }
+    }
+    size_ = 0;
+    return drained;
+}
+
+}  // namespace details
@@ -0,0 +1,231 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "task_group.hpp"
+#include "async_mutex.hpp"
+
+using namespace std::chrono_literals;
+
+
+// Tracks the maximal number of concurrent holders
+struct ConcurrencyMeter {
+    void enter() {
+        int now = in_flight.fetch_add(1) + 1;
+        int prev = max_in_flight.load();
+        while (prev < now && !max_in_flight.compare_exchange_weak(prev, now)) {   }
+    }
+
+    void leave() { in_flight.fetch_sub(1); }
+
+    std::atomic<int> in_flight { 0 };
+    std::atomic<int> max_in_flight { 0 };
+};
+
+
+DEFINE_TEST(mutex_just_works) {
+    ThreadPool pool(4);
+    AsyncMutex mutex;
+    ConcurrencyMeter meter;
+    // Not synchronized other than by the mutex
+    int counter = 0;
+
+    constexpr int NUM_TASKS = 1000;
+    TaskGroup<void> tg;
+    for (int idx = 0; idx < NUM_TASKS; ++idx) {
+        tg.join(call_async<void>(pool, []() {}).then<AsyncResult<void> >([&mutex, &pool, &meter, &counter]() {
+            return mutex.lock(pool).then<void>([&meter, &counter](AsyncMutex::Guard) {
+                meter.enter();
+                ++counter;
+                std::this_thread::yield();
+                meter.leave();
+            });
+        }).flatten());
+    }
+    tg.all().get();
+    ASSERT_EQ(counter, NUM_TASKS);
+    ASSERT_EQ(meter.max_in_flight.load(), 1);
+}
+
+
+DEFINE_TEST(try_lock) {
+    ThreadPool pool(1);
+    AsyncMutex mutex;
+    auto guard = mutex.tryLock();
+    ASSERT(guard.has_value());
+    ASSERT(guard->ownsPermit());
+    ASSERT(!mutex.tryLock().has_value());
+    auto waiter = mutex.lock(pool);
+    ASSERT(!waiter.wait_for(10ms));
+    guard.reset();
+    // The permit is handed over to the waiter, not to a barging tryLock
+    ASSERT(!mutex.tryLock().has_value());
+    auto next = waiter.get();
+    ASSERT(next.ownsPermit());
+    next.release();
+    ASSERT(!next.ownsPermit());
+    ASSERT(mutex.tryLock().has_value());
+}
+
+
+DEFINE_TEST(waiters_park_no_worker) {
+    ThreadPool pool(1);
+    AsyncMutex mutex;
+    auto holder = mutex.tryLock();
+
+    constexpr int NUM_WAITERS = 10;
+    std::vector<int> order;
+    TaskGroup<void> tg;
+    for (int idx = 0; idx < NUM_WAITERS; ++idx) {
+        tg.join(mutex.lock(pool).then<void>([&order, idx](AsyncMutex::Guard) { order.push_back(idx); }));
+    }
+    // The only worker is free while the waiters are queued
+    ASSERT_EQ(call_async<int>(pool, []() { return 42; }).get(), 42);
+    ASSERT(order.empty());
+
+    holder.reset();
+    tg.all().get();
+    ASSERT_EQ(order.size(), static_cast<size_t>(NUM_WAITERS));
+    // FIFO
+    for (int idx = 0; idx < NUM_WAITERS; ++idx) {
+        ASSERT_EQ(order[idx], idx);
+    }
+}
+
+
+DEFINE_TEST(abandoned_waiter) {
+    ThreadPool pool(1);
+    AsyncMutex mutex;
+    auto holder = mutex.tryLock();
+    {
+        // Nobody consumes the guard, so it goes back right away
+        auto abandoned = mutex.lock(pool);
+    }
+    holder.reset();
+    auto guard = mutex.lock(pool);
+    ASSERT(guard.wait_for(1s));
+    ASSERT(guard.get().ownsPermit());
+}
+
+
+DEFINE_TEST(semaphore_limits_concurrency) {
+    ThreadPool pool(8);
+    constexpr int NUM_PERMITS = 3;
+    AsyncSemaphore semaphore(NUM_PERMITS);
+    ConcurrencyMeter meter;
+
+    TaskGroup<void> tg;
+    for (int idx = 0; idx < 100; ++idx) {
+        tg.join(semaphore.acquire(pool).then<void>([&meter](AsyncSemaphore::Guard) {
+            meter.enter();
+            std::this_thread::sleep_for(1ms);
+            meter.leave();
+        }));
+    }
+    tg.all().get();
+    ASSERT(meter.max_in_flight.load() <= NUM_PERMITS);
+    ASSERT(meter.max_in_flight.load() > 0);
+
+    try {
+        AsyncSemaphore invalid(0);
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+}
+
+
+// A plain blocking semaphore for comparison
+class BlockingSemaphore {
+public:
+    explicit BlockingSemaphore(int permits) : permits_(permits) {   }
+
+    void acquire() {
+        std::unique_lock lock(mtx_);
+        cv_.wait(lock, [this]() { return permits_ > 0; });
+        --permits_;
+    }
+
+    void release() {
+        std::lock_guard lock(mtx_);
+        ++permits_;
+        cv_.notify_one();
+    }
+
+private:
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    int permits_;
+};
+
+DEFINE_TEST(blocking_vs_async_benchmark) {
+    constexpr int NUM_WORKERS = 8;
+    constexpr int NUM_PERMITS = 2;
+    constexpr int NUM_WRITES = 40;
+    constexpr int NUM_OTHERS = 200;
+    constexpr auto WRITE_TIME = 5ms;
+
+    // Writers hold a permit for a while; meanwhile the pool has other short tasks to run.
+    // Returns the time it takes the short tasks to complete.
+    auto run = [&](auto submit_write) {
+        ThreadPool pool(NUM_WORKERS);
+        std::vector<AsyncResult<void> > writes;
+        for (int idx = 0; idx < NUM_WRITES; ++idx) {
+            writes.push_back(submit_write(pool));
+        }
+        Timer timer;
+        TaskGroup<void> others;
+        for (int idx = 0; idx < NUM_OTHERS; ++idx) {
+            others.join(call_async<void>(pool, []() {}));
+        }
+        others.all().get();
+        double others_ms = timer.elapsedMilliseconds();
+        for (auto& write : writes) {
+            write.get();
+        }
+        return others_ms;
+    };
+
+    BlockingSemaphore blocking(NUM_PERMITS);
+    double blocking_ms = run([&blocking, WRITE_TIME](ThreadPool& pool) {
+        return call_async<void>(pool, [&blocking, WRITE_TIME]() {
+            blocking.acquire();
+            std::this_thread::sleep_for(WRITE_TIME);
+            blocking.release();
+        });
+    });
+
+    AsyncSemaphore async(NUM_PERMITS);
+    double async_ms = run([&async, WRITE_TIME](ThreadPool& pool) {
+        return async.acquire(pool).then<void>([WRITE_TIME](AsyncSemaphore::Guard) {
+            std::this_thread::sleep_for(WRITE_TIME);
+        });
+    });
+
+    LOG_INFO << std::fixed << std::setprecision(2) << NUM_OTHERS << " short tasks next to blocked writers: " << blocking_ms << " ms";
+    LOG_INFO << std::fixed << std::setprecision(2) << NUM_OTHERS << " short tasks next to suspended writers: " << async_ms << " ms";
+}
+
+
+int main() {
+    RUN_TEST(mutex_just_works, "AsyncMutex just works");
+    RUN_TEST(try_lock, "tryLock & hand over");
+    RUN_TEST(waiters_park_no_worker, "Waiters occupy no worker");
+    RUN_TEST(abandoned_waiter, "Abandoned waiter returns the lock");
+    RUN_TEST(semaphore_limits_concurrency, "AsyncSemaphore limits concurrency");
+    RUN_TEST(blocking_vs_async_benchmark, "Blocking vs async semaphore");
+    COMPLETE();
+}
@@ -0,0 +1,304 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <ctime>
+#include <cstdint>
+#include <string>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "task_group.hpp"
+#include "stop_token.hpp"
+
+using namespace std::chrono_literals;
+
+
+// Occupies the only worker of a pool until released
+struct Blocker {
+    void operator()() {
+        while (!released.load()) {
+            std::this_thread::sleep_for(1ms);
+        }
+    }
+
+    std::atomic<bool>& released;
+};
+
+template <class T>
+bool isCancelled(AsyncResult<T>& result) {
+    try {
+        result.get();
+    } catch (const CancelledError&) {
+        return true;
+    } catch (...) {
+    }
+    return false;
+}
+
+
+DEFINE_TEST(token_just_works) {
+    StopToken empty;
+    ASSERT(!empty.stopPossible());
+    ASSERT(!empty.stopRequested());
+
+    StopSource parent;
+    StopSource child(parent.token());
+    StopToken token = child.token();
+    ASSERT(token.stopPossible());
+    ASSERT(!token.stopRequested());
+    ASSERT(parent.requestStop());
+    ASSERT(!parent.requestStop());
+    // Child is stopped via its parent
+    ASSERT(token.stopRequested());
+    try {
+        token.throwIfStopped();
+        FAIL();
+    } catch (const CancelledError&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(queued_tasks_are_skipped) {
+    ThreadPool pool(1);
+    std::atomic<bool> released { false };
+    auto blocker = call_async<void>(pool, Blocker{released});
+
+    StopSource source;
+    std::atomic<int> num_executed { 0 };
+    constexpr int NUM_TASKS = 100;
+    std::vector<AsyncResult<int>> results;
+    for (int idx = 0; idx < NUM_TASKS; ++idx) {
+        results.push_back(call_async<int>(pool, source.token(), [&num_executed](int val) {
+            num_executed.fetch_add(1);
+            return val;
+        }, idx));
+    }
+    source.requestStop();
+    released.store(true);
+    blocker.wait();
+    for (auto& result : results) {
+        ASSERT(isCancelled(result));
+    }
+    ASSERT_EQ(num_executed.load(), 0);
+}
+
+
+DEFINE_TEST(then_chain_short_circuits) {
+    ThreadPool pool(2);
+    StopSource source;
+    std::atomic<bool> in { false }, out { false };
+    std::atomic<int> num_continuations { 0 };
+    auto result = call_async<int>(pool, source.token(), [&in, &out]() {
+        in.store(true);
+        while (!out.load()) {
+            std::this_thread::sleep_for(1ms);
+        }
+        return 1;
+    }).then<int>([&num_continuations](int val) {
+        num_continuations.fetch_add(1);
+        return val + 1;
+    }).then<int>([&num_continuations](int val) {
+        num_continuations.fetch_add(1);
+        return val + 1;
+    }).catch_err<CancelledError>([](const CancelledError&) {
+        return -1;
+    });
+    while (!in.load()) {
+        std::this_thread::sleep_for(1ms);
+    }
+    // The running task is not interrupted, but its continuations are skipped
+    source.requestStop();
+    out.store(true);
+    ASSERT_EQ(result.get(), -1);
+    ASSERT_EQ(num_continuations.load(), 0);
+
+    // A token attached in the middle of the chain
+    StopSource late_source;
+    late_source.requestStop();
+    auto late_result = call_async<int>(pool, []() { return 1; })
+        .then<int>([](int val) { return val + 1; })
+        .withStopToken(late_source.token())
+        .then<int>([](int val) { return val + 1; });
+    ASSERT(isCancelled(late_result));
+}
+
+
+DEFINE_TEST(callable_polls_token) {
+    ThreadPool pool(2);
+    StopSource source;
+    std::atomic<int64_t> num_iters { 0 };
+    auto result = call_async<void>(pool, source.token(), [&num_iters]() {
+        for (;;) {
+            StopToken::current().throwIfStopped();
+            num_iters.fetch_add(1);
+            std::this_thread::sleep_for(100us);
+        }
+    });
+    while (num_iters.load() < 10) {
+        std::this_thread::sleep_for(1ms);
+    }
+    source.requestStop();
+    ASSERT(isCancelled(result));
+    // No token outside of tasks
+    ASSERT(!StopToken::current().stopPossible());
+}
+
+
+DEFINE_TEST(task_group_cancels_rest) {
+    ThreadPool pool(1);
+    std::atomic<bool> released { false };
+    auto blocker = call_async<void>(pool, Blocker{released});
+
+    std::atomic<int> num_executed { 0 };
+    auto count_async = [&num_executed](int val) {
+        num_executed.fetch_add(1);
+        return val;
+    };
+
+    TaskGroup<int> tg;
+    for (int idx = 0; idx < 10; ++idx) {
+        tg.join(call_async<int>(pool, tg.token(), count_async, idx));
+    }
+    tg.join(AsyncResult<int>::instant(42));
+    ASSERT_EQ(tg.first(CancelPolicy::CancelRest).get(), 42);
+
+    for (int idx = 0; idx < 10; ++idx) {
+        tg.join(call_async<int>(pool, tg.token(), count_async, idx));
+    }
+    tg.join(AsyncResult<int>::instant(1));
+    tg.join(AsyncResult<int>::instant(2));
+    std::vector<int> expected = {1, 2};
+    ASSERT_EQ(tg.atLeast(2, CancelPolicy::CancelRest).get(), expected);
+
+    // The next group is not affected
+    tg.join(call_async<int>(pool, tg.token(), count_async, 3));
+    auto last = tg.all(CancelPolicy::CancelRest);
+
+    released.store(true);
+    ASSERT_EQ(last.get(), std::vector<int>{3});
+    ASSERT_EQ(num_executed.load(), 1);
+}
+
+
+DEFINE_TEST(task_group_parent_token) {
+    ThreadPool pool(1);
+    std::atomic<bool> released { false };
+    auto blocker = call_async<void>(pool, Blocker{released});
+
+    StopSource request;
+    TaskGroup<int> tg(request.token());
+    for (int idx = 0; idx < 10; ++idx) {
+        tg.join(call_async<int>(pool, tg.token(), [](int val) { return val; }, idx));
+    }
+    auto all = tg.all();
+    request.requestStop();
+    released.store(true);
+    ASSERT(isCancelled(all));
+}
+
+
+// Burns CPU instead of sleeping, so that the saved CPU time is observable
+void spin(std::chrono::microseconds duration) {
+    Timer timer;
+    while (timer.elapsedMilliseconds() * 1000 < duration.count()) {
+    }
+}
+
+struct RequestsStats {
+    double wall_ms = 0;
+    double cpu_ms = 0;
+    // Callables, that have actually run
+    int64_t num_calls = 0;
+    int num_cancelled = 0;
+    int num_completed = 0;
+    // Of the requests, that nobody abandoned
+    int num_kept_completed = 0;
+};
+
+RequestsStats runRequests(ThreadPool& pool, int num_requests, double abandoned_share) {
+    constexpr auto kStepDuration = 200us;
+    std::clock_t cpu_start = std::clock();
+    Timer timer;
+
+    std::atomic<int64_t> num_calls = 0;
+    std::vector<StopSource> requests(num_requests);
+    std::vector<AsyncResult<int>> results;
+    for (int idx = 0; idx < num_requests; ++idx) {
+        results.push_back(call_async<int>(pool, requests[idx].token(), [kStepDuration, &num_calls]() {
+            ++num_calls;
+            spin(kStepDuration);
+            return 1;
+        }).then<int>([kStepDuration, &num_calls](int val) {
+            ++num_calls;
+            spin(kStepDuration);
+            return val + 1;
+        }));
+    }
+    // Clients abandon their requests right after sending them
+    const int num_abandoned = static_cast<int>(num_requests * abandoned_share);
+    for (int idx = 0; idx < num_abandoned; ++idx) {
+        requests[idx].requestStop();
+    }
+    for (auto& result : results) {
+        result.wait();
+    }
+
+    RequestsStats stats;
+    stats.cpu_ms = 1000.0 * (std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    stats.wall_ms = timer.elapsedMilliseconds();
+    stats.num_calls = num_calls.load();
+    for (int idx = 0; idx < num_requests; ++idx) {
+        try {
+            if (results[idx].get() == 2) {
+                ++stats.num_completed;
+                stats.num_kept_completed += idx >= num_abandoned ? 1 : 0;
+            }
+        } catch (const CancelledError&) {
+            ++stats.num_cancelled;
+        }
+    }
+    return stats;
+}
+
+DEFINE_TEST(abandoned_requests_benchmark) {
+    ThreadPool pool(4);
+    constexpr int NUM_REQUESTS = 1000;
+    RequestsStats full = runRequests(pool, NUM_REQUESTS, 0.0);
+    RequestsStats cancelled = runRequests(pool, NUM_REQUESTS, 0.9);
+
+    LOG_INFO << std::fixed << std::setprecision(2) << NUM_REQUESTS << " requests, none abandoned: "
+             << full.wall_ms << " ms wall, " << full.cpu_ms << " ms CPU, " << full.num_calls << " calls";
+    LOG_INFO << std::fixed << std::setprecision(2) << NUM_REQUESTS << " requests, 90% abandoned: "
+             << cancelled.wall_ms << " ms wall, " << cancelled.cpu_ms << " ms CPU, " << cancelled.num_calls
+             << " calls, " << cancelled.num_cancelled << " cancelled";
+    ASSERT_EQ(full.num_calls, 2 * NUM_REQUESTS);
+    ASSERT_EQ(full.num_completed, NUM_REQUESTS);
+    ASSERT_EQ(full.num_cancelled, 0);
+    // Every cancelled request has skipped at least its continuation
+    ASSERT_EQ(cancelled.num_completed + cancelled.num_cancelled, NUM_REQUESTS);
+    ASSERT_EQ(cancelled.num_kept_completed, NUM_REQUESTS / 10);
+    ASSERT(cancelled.num_cancelled > 0);
+    ASSERT(cancelled.num_calls <= 2 * cancelled.num_completed + cancelled.num_cancelled);
+}
+
+
+int main() {
+    RUN_TEST(token_just_works, "StopToken just works");
+    RUN_TEST(queued_tasks_are_skipped, "Queued tasks are skipped");
+    RUN_TEST(then_chain_short_circuits, "Continuations short-circuit");
+    RUN_TEST(callable_polls_token, "Callable polls the token");
+    RUN_TEST(task_group_cancels_rest, "TaskGroup cancels the rest");
+    RUN_TEST(task_group_parent_token, "TaskGroup is cancelled via parent token");
+    RUN_TEST(abandoned_requests_benchmark, "CPU saved by abandoned requests");
+    COMPLETE();
+}
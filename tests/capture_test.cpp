@@ -0,0 +1,247 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+#include "test_utils/alloc_counter.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "task_group.hpp"
+#include "capture.hpp"
+
+using namespace std::chrono_literals;
+
+
+// Jacobi iterations for a diagonally dominant system: n on the diagonal, ones elsewhere
+struct JacobiSystem {
+    explicit JacobiSystem(int64_t size) : size(size), rhs(size), x(size, 0.0) {
+        for (int64_t idx = 0; idx < size; ++idx) {
+            rhs[idx] = static_cast<double>(idx % 7);
+        }
+    }
+
+    double element(int64_t row) const {
+        double sum = 0;
+        for (int64_t col = 0; col < size; ++col) {
+            sum += col == row ? 0.0 : x[col];
+        }
+        return (rhs[row] - sum) / static_cast<double>(size);
+    }
+
+    void update(const std::vector<double>& updated) {
+        for (int64_t idx = 0; idx < size; ++idx) {
+            x[idx] = updated[idx];
+        }
+    }
+
+    int64_t size;
+    std::vector<double> rhs;
+    std::vector<double> x;
+};
+
+// The shape of resolveViaIterations: a task per element, a TaskGroup and a then per iteration
+void asyncIterations(ThreadPool& pool, JacobiSystem& system, int num_iters) {
+    auto async_element = make_async(pool, [&system](int64_t row) { return system.element(row); });
+    for (int iter = 0; iter < num_iters; ++iter) {
+        TaskGroup<double> elements;
+        for (int64_t row = 0; row < system.size; ++row) {
+            elements.join(async_element(row));
+        }
+        elements
+            .all()
+            .then<void>([&system](std::vector<double> updated) { system.update(updated); }, ThenPolicy::Eager)
+            .get();
+    }
+}
+
+// The same shape, captured once
+void captureIterations(AsyncCapture& capture, JacobiSystem& system) {
+    std::vector<Captured<double> > elements;
+    for (int64_t row = 0; row < system.size; ++row) {
+        elements.push_back(capture.call<double>([&system](int64_t idx) { return system.element(idx); }, row));
+    }
+    capture.all(elements).then<void>([&system](const std::vector<double>& updated) { system.update(updated); });
+}
+
+
+DEFINE_TEST(capture_just_works) {
+    ThreadPool pool(4);
+    AsyncCapture capture;
+    auto lhs = capture.input<int64_t>(1);
+    auto rhs = capture.input<int64_t>(2);
+    auto sum = capture.call<int64_t>([](int64_t a, int64_t b) { return a + b; }, lhs, rhs);
+    auto squared = sum.then<int64_t>([](int64_t value) { return value * value; });
+    std::vector<Captured<int64_t> > scaled;
+    for (int64_t factor = 0; factor < 10; ++factor) {
+        scaled.push_back(capture.call<int64_t>([](int64_t value, int64_t mult) { return value * mult; }, squared, factor));
+    }
+    auto scaled_all = capture.all(scaled);
+    std::atomic<int> side_effects = 0;
+    std::vector<Captured<void> > effects;
+    for (int idx = 0; idx < 3; ++idx) {
+        effects.push_back(squared.then<void>([&side_effects](int64_t) { ++side_effects; }));
+    }
+    auto after_effects = capture.all(effects).then<int>([&side_effects]() { return side_effects.load(); });
+
+    for (int64_t run = 0; run < 10; ++run) {
+        lhs.set(run);
+        capture.replay(pool);
+        int64_t expected = (run + 2) * (run + 2);
+        ASSERT_EQ(sum.get(), run + 2);
+        ASSERT_EQ(squared.get(), expected);
+        ASSERT_EQ(scaled_all.get().size(), 10u);
+        for (int64_t factor = 0; factor < 10; ++factor) {
+            ASSERT_EQ(scaled_all.get()[factor], expected * factor);
+        }
+        ASSERT_EQ(after_effects.get(), 3 * (run + 1));
+    }
+}
+
+
+DEFINE_TEST(replays_like_async) {
+    ThreadPool pool(4);
+    constexpr int NUM_ITERS = 100;
+    JacobiSystem async_system(64);
+    asyncIterations(pool, async_system, NUM_ITERS);
+
+    JacobiSystem captured_system(64);
+    AsyncCapture capture;
+    captureIterations(capture, captured_system);
+    ASSERT_EQ(capture.size(), 66u);
+    capture.replay(pool);
+
+    int64_t before = numAllocations();
+    for (int iter = 1; iter < NUM_ITERS; ++iter) {
+        capture.replay(pool);
+    }
+    int64_t allocated = numAllocations() - before;
+    ASSERT_EQ(allocated, 0);
+    ASSERT(captured_system.x == async_system.x);
+}
+
+
+DEFINE_TEST(errors) {
+    ThreadPool pool(2);
+    AsyncCapture capture;
+    auto divisor = capture.input<int>(0);
+    auto quotient = capture.call<int>([](int value) {
+        if (value == 0) {
+            throw std::runtime_error("Division by zero");
+        }
+        return 100 / value;
+    }, divisor);
+    auto doubled = quotient.then<int>([](int value) { return 2 * value; });
+    auto both = capture.all(std::vector<Captured<int> >{quotient, doubled});
+    try {
+        quotient.get();
+        FAIL();
+    } catch (const std::bad_optional_access&) {
+        // pass
+    }
+    try {
+        capture.replay(pool);
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(std::string(err.what()), "Division by zero");
+    }
+    divisor.set(4);
+    capture.replay(pool);
+    ASSERT_EQ(quotient.get(), 25);
+    ASSERT_EQ(doubled.get(), 50);
+    ASSERT(both.get() == std::vector<int>({25, 50}));
+
+    // The values of a successful replay are not left behind by a failing one
+    divisor.set(0);
+    try {
+        capture.replay(pool);
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(std::string(err.what()), "Division by zero");
+    }
+    ASSERT_EQ(divisor.get(), 0);
+    for (const Captured<int>& step : {quotient, doubled}) {
+        try {
+            step.get();
+            FAIL();
+        } catch (const std::bad_optional_access&) {
+            // pass
+        }
+    }
+    try {
+        both.get();
+        FAIL();
+    } catch (const std::bad_optional_access&) {
+        // pass
+    }
+    divisor.set(5);
+    capture.replay(pool);
+    ASSERT(both.get() == std::vector<int>({20, 40}));
+
+    try {
+        quotient.set(1);
+        FAIL();
+    } catch (const std::logic_error&) {
+        // pass
+    }
+    AsyncCapture other;
+    try {
+        other.call<int>([](int value) { return value; }, divisor);
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(replay_vs_async_benchmark) {
+    constexpr int NUM_ITERS = 1000;
+    Timer timer;
+    for (int64_t size : {16, 64, 256}) {
+        for (int num_workers : {1, 4}) {
+            ThreadPool pool(num_workers);
+            JacobiSystem async_system(size);
+            int64_t async_allocs = numAllocations();
+            timer.start();
+            asyncIterations(pool, async_system, NUM_ITERS);
+            double async_us = timer.elapsedMilliseconds() * 1000 / NUM_ITERS;
+            async_allocs = numAllocations() - async_allocs;
+
+            JacobiSystem captured_system(size);
+            AsyncCapture capture;
+            captureIterations(capture, captured_system);
+            int64_t replay_allocs = numAllocations();
+            timer.start();
+            for (int iter = 0; iter < NUM_ITERS; ++iter) {
+                capture.replay(pool);
+            }
+            double replay_us = timer.elapsedMilliseconds() * 1000 / NUM_ITERS;
+            replay_allocs = numAllocations() - replay_allocs;
+            ASSERT(captured_system.x == async_system.x);
+
+            LOG_INFO << std::fixed << std::setprecision(2) << size << " elements, " << num_workers
+                     << " workers, per iteration: async " << async_us << " us, " << async_allocs / NUM_ITERS
+                     << " allocations; replay " << replay_us << " us, " << replay_allocs / NUM_ITERS << " allocations";
+        }
+    }
+}
+
+
+int main() {
+    RUN_TEST(capture_just_works, "Capture just works");
+    RUN_TEST(replays_like_async, "Replays like async");
+    RUN_TEST(errors, "Errors");
+    RUN_TEST(replay_vs_async_benchmark, "Replay vs async benchmark");
+    COMPLETE();
+}
@@ -0,0 +1,265 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <future>
+#include <mutex>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "channel.hpp"
+
+using namespace std::chrono_literals;
+
+
+// Receives values in a loop of continuations until the channel is closed
+struct Consumer {
+    void start() {
+        channel.receive().then<void>([this](std::optional<int> value) {
+            if (!value.has_value()) {
+                done.set_value();
+                return;
+            }
+            sum += *value;
+            ++count;
+            start();
+        });
+    }
+
+    Channel<int>& channel;
+    int64_t sum = 0;
+    int64_t count = 0;
+    std::promise<void> done = {};
+};
+
+
+DEFINE_TEST(channel_just_works) {
+    ThreadPool pool(2);
+    Channel<int> channel(4, pool);
+    for (int idx = 0; idx < 4; ++idx) {
+        ASSERT(channel.send(idx).wait_for(0ms));
+    }
+    for (int idx = 0; idx < 4; ++idx) {
+        ASSERT(channel.receive().get() == std::optional<int>(idx));
+    }
+    // The receiver waits for the value
+    auto pending = channel.receive();
+    ASSERT(!pending.wait_for(10ms));
+    channel.send(42);
+    ASSERT(pending.get() == std::optional<int>(42));
+
+    try {
+        Channel<int> invalid(0, pool);
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(backpressure) {
+    ThreadPool pool(1);
+    Channel<int> channel(2, pool);
+    ASSERT(channel.send(1).wait_for(0ms));
+    ASSERT(channel.send(2).wait_for(0ms));
+    auto blocked = channel.send(3);
+    ASSERT(!blocked.wait_for(10ms));
+    // The sender occupies no worker
+    ASSERT_EQ(call_async<int>(pool, []() { return 42; }).get(), 42);
+
+    ASSERT(channel.receive().get() == std::optional<int>(1));
+    blocked.get();
+    ASSERT(channel.receive().get() == std::optional<int>(2));
+    ASSERT(channel.receive().get() == std::optional<int>(3));
+}
+
+
+DEFINE_TEST(try_send_and_receive) {
+    ThreadPool pool(1);
+    Channel<std::unique_ptr<int> > channel(1, pool);
+    ASSERT(!channel.tryReceive().has_value());
+    auto value = std::make_unique<int>(1);
+    ASSERT(channel.trySend(std::move(value)));
+    ASSERT(value == nullptr);
+
+    auto other = std::make_unique<int>(2);
+    ASSERT(!channel.trySend(std::move(other)));
+    // Left intact
+    ASSERT(other != nullptr);
+
+    auto received = channel.tryReceive();
+    ASSERT(received.has_value());
+    ASSERT_EQ(**received, 1);
+    channel.close();
+    ASSERT(!channel.trySend(std::move(other)));
+}
+
+
+DEFINE_TEST(receive_many) {
+    ThreadPool pool(1);
+    Channel<int> channel(8, pool);
+    for (int idx = 0; idx < 8; ++idx) {
+        channel.send(idx);
+    }
+    auto blocked = channel.send(8);
+    auto batch = channel.receiveMany(5).get();
+    ASSERT_EQ(batch, (std::vector<int>{0, 1, 2, 3, 4}));
+    // The blocked sender is unblocked by the batch
+    ASSERT(blocked.wait_for(1s));
+    batch = channel.receiveMany(100).get();
+    ASSERT_EQ(batch, (std::vector<int>{5, 6, 7, 8}));
+
+    // Resolved as soon as there is a single value
+    auto pending = channel.receiveMany(100);
+    ASSERT(!pending.wait_for(10ms));
+    channel.send(9);
+    ASSERT_EQ(pending.get(), std::vector<int>{9});
+}
+
+
+DEFINE_TEST(close_channel) {
+    ThreadPool pool(1);
+    Channel<int> channel(1, pool);
+    channel.send(1);
+    auto blocked = channel.send(2);
+    channel.close();
+    ASSERT(channel.closed());
+    try {
+        blocked.get();
+        FAIL();
+    } catch (const ChannelClosedError&) {
+        // pass
+    }
+    try {
+        channel.send(3).get();
+        FAIL();
+    } catch (const ChannelClosedError&) {
+        // pass
+    }
+    // The buffer is drained first
+    ASSERT(channel.receive().get() == std::optional<int>(1));
+    ASSERT(channel.receive().get() == std::nullopt);
+    ASSERT(channel.receiveMany(10).get().empty());
+
+    Channel<int> other(1, pool);
+    auto waiting = other.receive();
+    auto waiting_many = other.receiveMany(10);
+    other.close();
+    ASSERT(waiting.get() == std::nullopt);
+    ASSERT(waiting_many.get().empty());
+}
+
+
+DEFINE_TEST(mpmc) {
+    ThreadPool pool(4);
+    Channel<int> channel(16, pool);
+    constexpr int NUM_PRODUCERS = 4;
+    constexpr int NUM_CONSUMERS = 3;
+    constexpr int NUM_VALUES = 2000;
+
+    std::vector<std::unique_ptr<Consumer> > consumers;
+    for (int idx = 0; idx < NUM_CONSUMERS; ++idx) {
+        consumers.push_back(std::unique_ptr<Consumer>(new Consumer{channel}));
+        consumers.back()->start();
+    }
+    std::vector<std::thread> producers;
+    for (int prod = 0; prod < NUM_PRODUCERS; ++prod) {
+        producers.emplace_back([&channel]() {
+            for (int idx = 1; idx <= NUM_VALUES; ++idx) {
+                channel.send(idx).get();
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    channel.close();
+
+    int64_t sum = 0, count = 0;
+    for (auto& consumer : consumers) {
+        consumer->done.get_future().get();
+        sum += consumer->sum;
+        count += consumer->count;
+    }
+    ASSERT_EQ(count, int64_t(NUM_PRODUCERS) * NUM_VALUES);
+    ASSERT_EQ(sum, int64_t(NUM_PRODUCERS) * NUM_VALUES * (NUM_VALUES + 1) / 2);
+}
+
+
+DEFINE_TEST(stream_benchmark) {
+    ThreadPool pool(2);
+    constexpr int NUM_VALUES = 200'000;
+    constexpr size_t BATCH = 256;
+
+    // One task per item, with the consumer state under a mutex
+    int64_t task_sum = 0;
+    double task_ms = 0;
+    {
+        std::mutex mtx;
+        Timer timer;
+        std::vector<AsyncResult<void> > results;
+        results.reserve(NUM_VALUES);
+        for (int idx = 0; idx < NUM_VALUES; ++idx) {
+            results.push_back(call_async<void>(pool, [&mtx, &task_sum, idx]() {
+                std::lock_guard guard(mtx);
+                task_sum += idx;
+            }));
+        }
+        for (auto& result : results) {
+            result.wait();
+        }
+        task_ms = timer.elapsedMilliseconds();
+    }
+
+    // A single consumer draining the channel in batches
+    int64_t channel_sum = 0;
+    double channel_ms = 0;
+    {
+        Channel<int> channel(1024, pool);
+        std::promise<void> done;
+        std::function<void()> consume = [&]() {
+            channel.receiveMany(BATCH).then<void>([&](std::vector<int> values) {
+                if (values.empty()) {
+                    done.set_value();
+                    return;
+                }
+                for (int value : values) {
+                    channel_sum += value;
+                }
+                consume();
+            });
+        };
+        Timer timer;
+        consume();
+        for (int idx = 0; idx < NUM_VALUES; ++idx) {
+            channel.send(idx).wait();
+        }
+        channel.close();
+        done.get_future().get();
+        channel_ms = timer.elapsedMilliseconds();
+    }
+
+    ASSERT_EQ(task_sum, channel_sum);
+    LOG_INFO << std::fixed << std::setprecision(2) << NUM_VALUES << " items as separate tasks: " << task_ms << " ms";
+    LOG_INFO << std::fixed << std::setprecision(2) << NUM_VALUES << " items through a channel: " << channel_ms << " ms";
+}
+
+
+int main() {
+    RUN_TEST(channel_just_works, "Channel just works");
+    RUN_TEST(backpressure, "Backpressure");
+    RUN_TEST(try_send_and_receive, "trySend & tryReceive");
+    RUN_TEST(receive_many, "receiveMany");
+    RUN_TEST(close_channel, "Close");
+    RUN_TEST(mpmc, "Multiple producers & consumers");
+    RUN_TEST(stream_benchmark, "Channel vs task per item");
+    COMPLETE();
+}
@@ -0,0 +1,223 @@
+#include <iostream>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+#include "test_utils/alloc_counter.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "coro.hpp"
+
+using namespace std::chrono_literals;
+
+
+Task<int> answer() {
+    co_return 42;
+}
+
+Task<int> twice(int value) {
+    int first = co_await answer();
+    co_return first * value;
+}
+
+Task<void> fail() {
+    throw std::runtime_error("Coroutine failure");
+    co_return;
+}
+
+Task<int> depth(int level) {
+    if (level == 0) {
+        co_return 0;
+    }
+    co_return 1 + co_await depth(level - 1);
+}
+
+
+DEFINE_TEST(task_just_works) {
+    ThreadPool pool(2);
+    ASSERT_EQ(spawn(pool, twice(2)).get(), 84);
+    try {
+        spawn(pool, fail()).get();
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(std::string(err.what()), "Coroutine failure");
+    }
+}
+
+
+DEFINE_TEST(await_async_result) {
+    ThreadPool pool(2);
+    auto main_id = std::this_thread::get_id();
+    auto coro = [&pool, main_id]() -> Task<bool> {
+        int value = co_await call_async<int>(pool, []() {
+            std::this_thread::sleep_for(10ms);
+            return 1;
+        });
+        // Ready results are consumed without suspension
+        value += co_await AsyncResult<int>::instant(2);
+        co_await call_async<void>(pool, []() {});
+        try {
+            co_await call_async<void>(pool, []() { throw std::runtime_error("Async failure"); });
+        } catch (const std::runtime_error&) {
+            value += 3;
+        }
+        co_return value == 6 && std::this_thread::get_id() != main_id;
+    };
+    ASSERT(spawn(InlineExecutor::instance(), coro()).get());
+}
+
+
+DEFINE_TEST(await_concurrent_results) {
+    // Producers race with await_suspend: the coroutine may be resumed on another thread
+    // before await_suspend returns. Meant to be run under ThreadSanitizer as well.
+    constexpr int NUM_COROUTINES = 8;
+    constexpr int NUM_AWAITS = 2'000;
+    ThreadPool pool(4);
+    auto coro = [&pool]() -> Task<int64_t> {
+        int64_t sum = 0;
+        for (int idx = 0; idx < NUM_AWAITS; ++idx) {
+            sum += co_await call_async<int>(pool, [idx]() { return idx; });
+            if (idx % 100 == 0) {
+                try {
+                    co_await call_async<void>(pool, []() { throw std::runtime_error("Async failure"); });
+                } catch (const std::runtime_error&) {
+                    ++sum;
+                }
+            }
+        }
+        co_return sum;
+    };
+    std::vector<AsyncResult<int64_t>> results;
+    for (int idx = 0; idx < NUM_COROUTINES; ++idx) {
+        results.push_back(spawn(pool, coro()));
+    }
+    for (auto& result : results) {
+        ASSERT_EQ(result.get(), int64_t(NUM_AWAITS) * (NUM_AWAITS - 1) / 2 + NUM_AWAITS / 100);
+    }
+}
+
+
+DEFINE_TEST(symmetric_transfer) {
+    ThreadPool pool(1);
+    // Would overflow the stack, if every nested resumption took a frame of it.
+    // GCC only turns symmetric transfer into a tail call with optimizations enabled.
+#ifdef __OPTIMIZE__
+    constexpr int DEPTH = 200'000;
+#else
+    constexpr int DEPTH = 1'000;
+#endif
+    ASSERT_EQ(spawn(pool, depth(DEPTH)).get(), DEPTH);
+}
+
+
+DEFINE_TEST(resume_on) {
+    ThreadPool pool(1);
+    auto pool_id = call_async<std::thread::id>(pool, []() { return std::this_thread::get_id(); }).get();
+    auto coro = [&pool]() -> Task<std::thread::id> {
+        co_await resume_on(pool);
+        co_return std::this_thread::get_id();
+    };
+    ASSERT(spawn(InlineExecutor::instance(), coro()).get() == pool_id);
+}
+
+
+// Counts the frames unwound
+struct UnwindCounter {
+    ~UnwindCounter() { ++count; }
+    int& count;
+};
+
+DEFINE_TEST(stopped_pool) {
+    ThreadPool pool(1);
+    pool.stop();
+    int num_started = 0;
+    auto coro = [&num_started]() -> Task<int> {
+        ++num_started;
+        co_return 1;
+    };
+    try {
+        spawn(pool, coro()).get();
+        FAIL();
+    } catch (const CancelledError&) {
+        // pass
+    }
+    ASSERT_EQ(num_started, 0);
+
+    // A continuation, that the pool drops, resumes the coroutine with CancelledError
+    int num_unwound = 0;
+    auto moved = [&pool, &num_unwound]() -> Task<bool> {
+        UnwindCounter counter{num_unwound};
+        try {
+            co_await resume_on(pool);
+        } catch (const CancelledError&) {
+            co_return true;
+        }
+        co_return false;
+    };
+    ASSERT(spawn(InlineExecutor::instance(), moved()).get());
+    ASSERT_EQ(num_unwound, 1);
+
+    // The same for an awaited result, that resumes its awaiter in the stopped pool.
+    // It is produced once the coroutine has suspended, so that it is not consumed inline.
+    ThreadPool running(1);
+    std::atomic<bool> released = false;
+    auto awaiting = [&pool, &running, &released, &num_unwound]() -> Task<int> {
+        UnwindCounter counter{num_unwound};
+        co_return co_await call_async<int>(running, [&released]() {
+            while (!released) {
+                std::this_thread::yield();
+            }
+            return 1;
+        }).in(pool);
+    };
+    auto awaited = spawn(InlineExecutor::instance(), awaiting());
+    released = true;
+    try {
+        awaited.get();
+        FAIL();
+    } catch (const CancelledError&) {
+        // pass
+    }
+    ASSERT_EQ(num_unwound, 2);
+}
+
+
+DEFINE_TEST(frames_are_recycled) {
+    constexpr int NUM_TASKS = 10'000;
+    auto loop = []() -> Task<int> {
+        int sum = 0;
+        for (int idx = 0; idx < NUM_TASKS; ++idx) {
+            sum += co_await twice(1);
+        }
+        co_return sum;
+    };
+    auto outer = loop();
+    int64_t before = numAllocations();
+    auto result = spawn(InlineExecutor::instance(), std::move(outer));
+    int64_t allocated = numAllocations() - before;
+    ASSERT_EQ(result.get(), 42 * NUM_TASKS);
+    // 2 * NUM_TASKS frames, but the same few blocks are reused
+    ASSERT(allocated < 100);
+    LOG_INFO << 2 * NUM_TASKS << " coroutine frames took " << allocated << " heap allocations";
+}
+
+
+int main() {
+    RUN_TEST(task_just_works, "Task just works");
+    RUN_TEST(await_async_result, "Await AsyncResult");
+    RUN_TEST(await_concurrent_results, "Await results produced concurrently");
+    RUN_TEST(symmetric_transfer, "Symmetric transfer");
+    RUN_TEST(resume_on, "resume_on");
+    RUN_TEST(stopped_pool, "Stopped pool");
+    RUN_TEST(frames_are_recycled, "Coroutine frames are recycled");
+    COMPLETE();
+}
@@ -0,0 +1,187 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <ctime>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "shared_async_result.hpp"
+#include "task_group.hpp"
+
+using namespace std::chrono_literals;
+
+
+DEFINE_TEST(dropped_result_never_runs) {
+    ThreadPool pool(2);
+    std::atomic<int> num_executed { 0 };
+    auto count = [&num_executed]() { num_executed.fetch_add(1); };
+    {
+        auto dropped = call_deferred<void>(pool, count);
+        // Moving a deferred result around does not launch it either
+        auto moved = std::move(dropped).in(pool).withStopToken(StopToken());
+    }
+    std::this_thread::sleep_for(20ms);
+    ASSERT_EQ(num_executed.load(), 0);
+
+    call_deferred<void>(pool, count).wait();
+    ASSERT_EQ(num_executed.load(), 1);
+}
+
+
+DEFINE_TEST(get_runs_inline) {
+    ThreadPool pool(2);
+    auto this_id = std::this_thread::get_id();
+    auto id = call_deferred<std::thread::id>(pool, []() { return std::this_thread::get_id(); }).get();
+    ASSERT(id == this_id);
+
+    try {
+        call_deferred<int>(pool, []() -> int { throw std::runtime_error("Deferred failure"); }).get();
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(std::string(err.what()), "Deferred failure");
+    }
+
+    // A stopped token still cancels the task
+    StopSource source;
+    source.requestStop();
+    try {
+        call_deferred<int>(pool, source.token(), []() { return 1; }).get();
+        FAIL();
+    } catch (const CancelledError&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(subscription_launches) {
+    ThreadPool pool(2);
+    auto this_id = std::this_thread::get_id();
+    auto get_id = []() { return std::this_thread::get_id(); };
+
+    // Continuations schedule the task in the executor, and the consumer does not run it
+    auto id = call_deferred<std::thread::id>(pool, get_id)
+        .then<std::thread::id>([](std::thread::id id) { return id; })
+        .get();
+    ASSERT(id != this_id);
+
+    auto waited = call_deferred<std::thread::id>(pool, get_id);
+    ASSERT(waited.wait_for(1s));
+    ASSERT(waited.get() != this_id);
+
+    auto shared = call_deferred<int>(pool, []() { return 42; }).share();
+    ASSERT_EQ(shared.get(), 42);
+
+    TaskGroup<std::thread::id> tg;
+    tg.join(call_deferred<std::thread::id>(pool, get_id));
+    tg.join(call_deferred<std::thread::id>(pool, get_id));
+    for (const auto& worker_id : tg.all().get()) {
+        ASSERT(worker_id != this_id);
+    }
+
+    // Flattening launches the inner result too
+    auto flat = call_async<AsyncResult<int>>(pool, [&pool]() {
+        return call_deferred<int>(pool, []() { return 7; });
+    }).flatten();
+    ASSERT_EQ(flat.get(), 7);
+}
+
+
+DEFINE_TEST(speculative_first) {
+    ThreadPool pool(2);
+    std::atomic<int> num_executed { 0 };
+    auto attempt = [&num_executed](int val) {
+        num_executed.fetch_add(1);
+        return val;
+    };
+
+    // Speculative branches are built upfront, but only the demanded ones run
+    std::vector<AsyncResult<int>> branches;
+    for (int idx = 0; idx < 10; ++idx) {
+        branches.push_back(call_deferred<int>(pool, attempt, idx));
+    }
+    TaskGroup<int> tg;
+    tg.join(std::move(branches[3]));
+    tg.join(std::move(branches[5]));
+    int first = tg.first().get();
+    ASSERT(first == 3 || first == 5);
+    branches.clear();
+    std::this_thread::sleep_for(20ms);
+    ASSERT_EQ(num_executed.load(), 2);
+}
+
+
+// Burns CPU instead of sleeping, so that the saved CPU time is observable
+void spin(std::chrono::microseconds duration) {
+    Timer timer;
+    while (timer.elapsedMilliseconds() * 1000 < duration.count()) {
+    }
+}
+
+// Every request prepares a few alternatives, but consumes only one of them
+template <class Launch>
+double runSpeculation(int num_requests, Launch launch, double& cpu_ms, int64_t& num_runs) {
+    constexpr int kNumAlternatives = 4;
+    constexpr auto kDuration = 200us;
+    std::clock_t cpu_start = std::clock();
+    Timer timer;
+    ThreadPool pool(4);
+    std::atomic<int64_t> runs { 0 };
+
+    for (int req = 0; req < num_requests; ++req) {
+        std::vector<AsyncResult<int>> alternatives;
+        for (int idx = 0; idx < kNumAlternatives; ++idx) {
+            alternatives.push_back(launch(pool, [kDuration, &runs](int val) {
+                runs.fetch_add(1);
+                spin(kDuration);
+                return val;
+            }, idx));
+        }
+        alternatives[req % kNumAlternatives].get();
+    }
+    // Queued leftovers of the eager launch are cancelled here, which only favours it
+    pool.stop();
+
+    cpu_ms = 1000.0 * (std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    num_runs = runs.load();
+    return timer.elapsedMilliseconds();
+}
+
+DEFINE_TEST(eager_vs_deferred_benchmark) {
+    constexpr int NUM_REQUESTS = 500;
+    auto eager = [](ThreadPool& pool, auto fun, int val) { return call_async<int>(pool, fun, val); };
+    auto deferred = [](ThreadPool& pool, auto fun, int val) { return call_deferred<int>(pool, fun, val); };
+
+    double eager_cpu_ms = 0, deferred_cpu_ms = 0;
+    int64_t eager_runs = 0, deferred_runs = 0;
+    double eager_wall_ms = runSpeculation(NUM_REQUESTS, eager, eager_cpu_ms, eager_runs);
+    double deferred_wall_ms = runSpeculation(NUM_REQUESTS, deferred, deferred_cpu_ms, deferred_runs);
+
+    LOG_INFO << std::fixed << std::setprecision(2) << NUM_REQUESTS << " requests, eager launch: "
+             << eager_wall_ms << " ms wall, " << eager_cpu_ms << " ms CPU, " << eager_runs << " bodies run";
+    LOG_INFO << std::fixed << std::setprecision(2) << NUM_REQUESTS << " requests, deferred launch: "
+             << deferred_wall_ms << " ms wall, " << deferred_cpu_ms << " ms CPU, " << deferred_runs << " bodies run";
+    // Only the consumed alternative of every request runs
+    ASSERT_EQ(deferred_runs, NUM_REQUESTS);
+    ASSERT(eager_runs >= NUM_REQUESTS);
+}
+
+
+int main() {
+    RUN_TEST(dropped_result_never_runs, "Dropped result never runs");
+    RUN_TEST(get_runs_inline, "get runs the task inline");
+    RUN_TEST(subscription_launches, "Subscription launches the task");
+    RUN_TEST(speculative_first, "Speculative branches");
+    RUN_TEST(eager_vs_deferred_benchmark, "Eager vs deferred launch");
+    COMPLETE();
+}
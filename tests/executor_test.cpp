@@ -0,0 +1,175 @@
+#include <iostream>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <string>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "task_group.hpp"
+#include "executor.hpp"
+#include "strand.hpp"
+
+using namespace std::chrono_literals;
+
+
+// A user-defined executor, that counts the tasks and forwards them to a pool
+struct CountingExecutor {
+    void submit(std::unique_ptr<ITaskBase> task) {
+        num_submitted.fetch_add(1);
+        target.submit(std::move(task));
+    }
+
+    ThreadPool& pool() { return target; }
+
+    ThreadPool& target;
+    std::atomic<int> num_submitted { 0 };
+};
+
+static_assert(is_executor<ThreadPool>::value);
+static_assert(is_executor<Strand>::value);
+static_assert(is_executor<InlineExecutor>::value);
+static_assert(is_executor<ManualExecutor>::value);
+static_assert(is_executor<CountingExecutor>::value);
+static_assert(!is_executor<int>::value);
+
+
+DEFINE_TEST(inline_executor) {
+    auto this_id = std::this_thread::get_id();
+    auto res = call_async<std::thread::id>(InlineExecutor::instance(), []() {
+        return std::this_thread::get_id();
+    });
+    ASSERT(res.get() == this_id);
+
+    // Results with no executor continue inline
+    auto then_id = AsyncResult<int>::instant(1).then<std::thread::id>([](int) {
+        return std::this_thread::get_id();
+    });
+    ASSERT(then_id.get() == this_id);
+
+    // Stopped tasks are not run
+    StopSource source;
+    source.requestStop();
+    bool executed = false;
+    auto cancelled = call_async<void>(InlineExecutor::instance(), source.token(), [&executed]() { executed = true; });
+    try {
+        cancelled.get();
+        FAIL();
+    } catch (const CancelledError&) {
+        // pass
+    }
+    ASSERT(!executed);
+}
+
+
+DEFINE_TEST(manual_executor) {
+    ManualExecutor loop;
+    std::vector<int> trace;
+    auto res = call_async<int>(loop, [&trace]() {
+        trace.push_back(1);
+        return 1;
+    }).then<int>([&trace](int val) {
+        trace.push_back(2);
+        return val + 1;
+    });
+    // Nothing runs until the loop is driven
+    ASSERT(trace.empty());
+    ASSERT_EQ(loop.pending(), 1u);
+    // The continuation is submitted by the first task and waits for the next iteration
+    ASSERT_EQ(loop.runPending(), 1u);
+    ASSERT_EQ(trace, std::vector<int>{1});
+    ASSERT_EQ(loop.runAll(), 1u);
+    ASSERT_EQ(res.get(), 2);
+    ASSERT_EQ(trace, (std::vector<int>{1, 2}));
+    ASSERT(!loop.runOne());
+}
+
+
+DEFINE_TEST(pool_to_event_loop) {
+    ThreadPool pool(4);
+    ManualExecutor loop;
+    auto loop_id = std::this_thread::get_id();
+    std::atomic<int> num_on_loop { 0 };
+
+    constexpr int NUM_TASKS = 100;
+    TaskGroup<int> tg;
+    for (int idx = 0; idx < NUM_TASKS; ++idx) {
+        // Heavy work in the pool, and the result is delivered back to the loop thread
+        tg.join(call_async<int>(pool, [idx]() { return idx; }).in(loop).then<int>([&num_on_loop, loop_id](int val) {
+            if (std::this_thread::get_id() == loop_id) {
+                num_on_loop.fetch_add(1);
+            }
+            return val;
+        }));
+    }
+    auto all = tg.all();
+    while (!all.wait_for(0ms)) {
+        loop.runPending();
+        std::this_thread::sleep_for(100us);
+    }
+    ASSERT_EQ(all.get().size(), static_cast<size_t>(NUM_TASKS));
+    ASSERT_EQ(num_on_loop.load(), NUM_TASKS);
+}
+
+
+DEFINE_TEST(custom_executor) {
+    ThreadPool pool(2);
+    CountingExecutor counting{pool};
+    auto res = call_async<int>(counting, []() { return 1; })
+        .then<int>([](int val) { return val + 1; })
+        .then<int>([](int val) { return val + 1; });
+    ASSERT_EQ(res.get(), 3);
+    ASSERT_EQ(counting.num_submitted.load(), 3);
+
+    // Timers of the backing pool are available
+    auto slow = call_async<int>(counting, []() {
+        std::this_thread::sleep_for(100ms);
+        return 1;
+    }).withTimeout(10ms);
+    try {
+        slow.get();
+        FAIL();
+    } catch (const TimeoutError&) {
+        // pass
+    }
+
+    // Executors without a pool have no timer
+    ManualExecutor loop;
+    try {
+        AsyncResult<int>::instant(1).in(loop).withTimeout(10ms);
+        FAIL();
+    } catch (const std::runtime_error&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(executor_reference) {
+    ThreadPool pool(1);
+    Strand strand(pool);
+    Executor by_pool = pool;
+    Executor by_strand = strand;
+    ASSERT(by_pool != by_strand);
+    ASSERT(by_pool == Executor(pool));
+    ASSERT(by_pool.pool() == &pool);
+    ASSERT(by_strand.pool() == &pool);
+    ASSERT(Executor().pool() == nullptr);
+    ASSERT(Executor() == Executor(InlineExecutor::instance()));
+}
+
+
+int main() {
+    RUN_TEST(inline_executor, "InlineExecutor");
+    RUN_TEST(manual_executor, "ManualExecutor");
+    RUN_TEST(pool_to_event_loop, "Deliver results from pool to event loop");
+    RUN_TEST(custom_executor, "User defined executor");
+    RUN_TEST(executor_reference, "Executor reference");
+    COMPLETE();
+}
@@ -0,0 +1,171 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <string>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+#include "test_utils/alloc_counter.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "task_group.hpp"
+#include "fork_join.hpp"
+
+using namespace std::chrono_literals;
+
+
+// Occupies a worker of a pool until released
+struct Blocker {
+    void operator()() {
+        while (!released.load()) {
+            std::this_thread::sleep_for(1ms);
+        }
+    }
+
+    std::atomic<bool>& released;
+};
+
+int64_t fib(int n) {
+    return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+int64_t forkJoinFib(ThreadPool& pool, int n) {
+    if (n < 2) {
+        return n;
+    }
+    int64_t first = 0, second = 0;
+    invoke_parallel(pool,
+        [&]() { first = forkJoinFib(pool, n - 1); },
+        [&]() { second = forkJoinFib(pool, n - 2); });
+    return first + second;
+}
+
+AsyncResult<int64_t> asyncFib(ThreadPool& pool, int n) {
+    if (n < 2) {
+        return AsyncResult<int64_t>::instant(static_cast<int64_t>(n));
+    }
+    return call_async<AsyncResult<int64_t>>(pool, [&pool, n]() {
+        TaskGroup<int64_t> halves;
+        halves.join(asyncFib(pool, n - 1));
+        halves.join(asyncFib(pool, n - 2));
+        return halves.all().then<int64_t>([](std::vector<int64_t> values) {
+            return values[0] + values[1];
+        });
+    }).flatten();
+}
+
+
+DEFINE_TEST(invoke_parallel_just_works) {
+    ThreadPool pool(4);
+    ASSERT_EQ(forkJoinFib(pool, 20), fib(20));
+
+    // Also from inside the pool
+    auto result = call_async<int64_t>(pool, [&pool]() { return forkJoinFib(pool, 18); });
+    ASSERT_EQ(result.get(), fib(18));
+}
+
+
+DEFINE_TEST(branches_run_in_parallel) {
+    ThreadPool pool(2);
+    std::atomic<bool> second_started { false };
+    std::thread::id first_id, second_id;
+    invoke_parallel(pool,
+        [&]() {
+            first_id = std::this_thread::get_id();
+            // Only returns once a worker has stolen the second branch
+            while (!second_started.load()) {
+                std::this_thread::sleep_for(1ms);
+            }
+        },
+        [&]() {
+            second_id = std::this_thread::get_id();
+            second_started.store(true);
+        });
+    ASSERT(first_id == std::this_thread::get_id());
+    ASSERT(second_id != first_id);
+}
+
+
+DEFINE_TEST(errors) {
+    ThreadPool pool(2);
+    std::atomic<bool> second_done { false };
+    try {
+        invoke_parallel(pool,
+            []() { throw std::runtime_error("First failure"); },
+            [&second_done]() {
+                std::this_thread::sleep_for(10ms);
+                second_done.store(true);
+            });
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(std::string(err.what()), "First failure");
+    }
+    // The second branch is not abandoned
+    ASSERT(second_done.load());
+
+    try {
+        invoke_parallel(pool, []() {}, []() { throw std::runtime_error("Second failure"); });
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(std::string(err.what()), "Second failure");
+    }
+}
+
+
+DEFINE_TEST(fast_path_does_not_allocate) {
+    ThreadPool pool(1);
+    std::atomic<bool> released { false };
+    auto blocker = call_async<void>(pool, Blocker{released});
+    // Make sure the only worker is busy
+    std::this_thread::sleep_for(10ms);
+
+    int64_t before = numAllocations();
+    int64_t value = forkJoinFib(pool, 15);
+    int64_t allocated = numAllocations() - before;
+    released.store(true);
+
+    ASSERT_EQ(value, fib(15));
+    ASSERT_EQ(allocated, 0);
+}
+
+
+DEFINE_TEST(fork_join_vs_callbacks_benchmark) {
+    ThreadPool pool(4);
+    constexpr int N = 22;
+    Timer timer;
+
+    timer.start();
+    int64_t expected = fib(N);
+    double sequential_ms = timer.elapsedMilliseconds();
+
+    timer.start();
+    int64_t fork_join = forkJoinFib(pool, N);
+    double fork_join_ms = timer.elapsedMilliseconds();
+
+    timer.start();
+    int64_t callbacks = asyncFib(pool, N).get();
+    double callbacks_ms = timer.elapsedMilliseconds();
+
+    ASSERT_EQ(fork_join, expected);
+    ASSERT_EQ(callbacks, expected);
+    LOG_INFO << std::fixed << std::setprecision(2) << "fib(" << N << "), sequential:      " << sequential_ms << " ms";
+    LOG_INFO << std::fixed << std::setprecision(2) << "fib(" << N << "), invoke_parallel: " << fork_join_ms << " ms";
+    LOG_INFO << std::fixed << std::setprecision(2) << "fib(" << N << "), call_async:      " << callbacks_ms << " ms";
+}
+
+
+int main() {
+    RUN_TEST(invoke_parallel_just_works, "invoke_parallel just works");
+    RUN_TEST(branches_run_in_parallel, "Branches run in parallel");
+    RUN_TEST(errors, "Errors");
+    RUN_TEST(fast_path_does_not_allocate, "Fast path does not allocate");
+    RUN_TEST(fork_join_vs_callbacks_benchmark, "Fork-join vs callbacks");
+    COMPLETE();
+}
@@ -1,4 +1,5 @@
 #include <cmath>
+#include <functional>
 
 #include "utils/logger.hpp"
 #include "test_utils/timer.hpp"
@@ -9,6 +10,9 @@
 #include "async_function.hpp"
 #include "thread_pool.hpp"
 #include "task_group.hpp"
+#include "parallel_reduce.hpp"
+#include "sparse.hpp"
+#include "team.hpp"
 
 
 template <class T>
@@ -51,6 +55,43 @@ ColumnVec<double> resolveViaIterations(const Matrix<T>& mtx, const ColumnVec<T>
     return result;
 }
 
+// The same iterations on a team: each member keeps its rows, and a barrier separates the
+// reads of the old result from the writes of the new one instead of a TaskGroup round trip.
+template <class T>
+ColumnVec<double> resolveViaTeam(const Matrix<T>& mtx, const ColumnVec<T> rhs, ThreadPool& pool) {
+    if (mtx.cols() != mtx.rows()) {
+        throw std::runtime_error("Non-sqare matrixes not supported");
+    }
+    if (mtx.rows() != rhs.size()) {
+        throw std::runtime_error("Mismatching matrix and rhs size");
+    }
+    int64_t size = rhs.size();
+    ColumnVec<double> result(size), updated(size);
+    run_team(pool, [&](TeamMember& member) {
+        auto [begin, end] = member.range(0, size);
+        for (int iter = 0; iter < 1000; ++iter) {
+            for (int64_t idx = begin; idx < end; ++idx) {
+                updated[idx] = computeElement<T>(mtx[idx], result, rhs[idx], idx);
+            }
+            member.barrier();
+            for (int64_t idx = begin; idx < end; ++idx) {
+                result[idx] = updated[idx];
+            }
+            member.barrier();
+        }
+    });
+    return result;
+}
+
+// Reproducible from run to run, unlike a reduction in completion order
+double parallelDot(const ColumnVec<double>& lhs, const ColumnVec<double>& rhs, ThreadPool& pool) {
+    return parallel_transform_reduce(pool, 0, lhs.size(), 0.0, std::plus<double>(),
+        [&lhs, &rhs](int64_t idx) { return lhs[idx] * rhs[idx]; }, ReduceOrder::Deterministic);
+}
+
+// Squared residual norm, at which the iterations stop
+constexpr double kConvergedRR = 1e-20;
+
 template <class T>
 ColumnVec<double> resolveViaConjugateGrads(const Matrix<T>& mtx, const ColumnVec<T> rhs, ThreadPool& pool) {
     if (mtx.cols() != mtx.rows()) {
@@ -67,20 +108,20 @@ ColumnVec<double> resolveViaConjugateGrads(const Matrix<T>& mtx, const ColumnVec
 
     for (int iter = 0; iter < size * 2; ++iter) {
         TaskGroup<double> mtx_mul_tasks;
+        double prev_rr = parallelDot(r, r, pool);
+        if (prev_rr < kConvergedRR) {
+            break;
+        }
         for (int idx = 0; idx < size; ++idx) {
-            mtx_mul_tasks.join( asyncDot(mtx[idx], r) );
+            mtx_mul_tasks.join( asyncDot(mtx[idx], z) );
         }
-        double prev_rr = Linalg::dot(r, r);
         ColumnVec<double> Az = mtx_mul_tasks
             .all()
             .then<ColumnVec<double>>([](std::vector<double> res) {
                 return ColumnVec<double>(std::move(res));
             }, ThenPolicy::NoSchedule)
             .get();
-        double Azz = Linalg::dot(Az, z);
-        if (prev_rr == 0) {
-            throw std::runtime_error("r_{k-1} * r_{k-1} == 0");
-        }
+        double Azz = parallelDot(Az, z, pool);
         if (Azz == 0) {
             throw std::runtime_error("Az * z == 0");
         }
@@ -90,7 +131,7 @@ ColumnVec<double> resolveViaConjugateGrads(const Matrix<T>& mtx, const ColumnVec
             x[idx] = x[idx] + alpha * z[idx];
             r[idx] = r[idx] - alpha * Az[idx];
         }
-        beta = Linalg::dot(r, r) / prev_rr;
+        beta = parallelDot(r, r, pool) / prev_rr;
         for (int idx = 0; idx < size; ++idx) {
             z[idx] = r[idx] + beta * z[idx];
         }
@@ -107,9 +148,19 @@ int main() {
     rhs[0] = rhs[1] = rhs[2] = 1;
 
     ColumnVec<double> iter_ans = resolveViaIterations<double>(mtx, rhs, pool);
+    ColumnVec<double> team_ans = resolveViaTeam<double>(mtx, rhs, pool);
     ColumnVec<double> grad_ans = resolveViaConjugateGrads<double>(mtx, rhs, pool);
     std::cout << "Iterations answer:" << std::endl;
     dump(iter_ans);
+    std::cout << "Team iter  answer:" << std::endl;
+    dump(team_ans);
     std::cout << "Conj Grad  answer:" << std::endl;
     dump(grad_ans);
+
+    // The same system in CSR, solved by the library kernels
+    auto sparse_mtx = CsrMatrix<double>::fromEntries(3, 3, {{0, 0, 3}, {1, 1, 3}, {2, 2, 3}});
+    std::vector<double> sparse_rhs(3, 1.0), sparse_ans(3, 0.0);
+    CgResult result = conjugate_gradient(pool, sparse_mtx, sparse_rhs, sparse_ans, 1e-10, 100);
+    std::cout << "Sparse CG  answer (" << result.iterations << " iterations):" << std::endl;
+    dump(ColumnVec<double>(sparse_ans));
 }
@@ -1,7 +1,10 @@
 #include <cmath>
 #include <functional>
+#include <iomanip>
 #include <random>
+#include <sstream>
 
+#include "utils/logger.hpp"
 #include "test_utils/timer.hpp"
 #include "test_utils/tester.hpp"
 #include "test_utils/matrix.hpp"
@@ -9,6 +12,7 @@
 #include "async_function.hpp"
 #include "thread_pool.hpp"
 #include "task_group.hpp"
+#include "gemm.hpp"
 
 
 Matrix<int64_t> simpleMultiply(const Matrix<int64_t>& lhs, const Matrix<int64_t>& rhs) {
@@ -79,6 +83,36 @@ Matrix<int64_t> parallelMultiply(const Matrix<int64_t>& lhs, const Matrix<int64_
         .get();
 }
 
+template <class T>
+Matrix<T> gemmMultiply(const Matrix<T>& lhs, const Matrix<T>& rhs, ThreadPool& tp) {
+    if (lhs.cols() != rhs.rows()) {
+        throw std::runtime_error("Invalid matrix sizes");
+    }
+    Matrix<T> result(lhs.rows(), rhs.cols());
+    parallel_gemm(tp, lhs.rows(), rhs.cols(), lhs.cols(), lhs.data(), lhs.cols(),
+                  rhs.data(), rhs.cols(), result.data(), result.cols());
+    return result;
+}
+
+template <class T>
+Matrix<T> randomMatrix(int64_t rows, int64_t cols, std::mt19937& PRG) {
+    std::uniform_int_distribution<int> elt_dist(-10, 10);
+    Matrix<T> mtx(rows, cols);
+    for (int64_t idx = 0; idx < rows * cols; ++idx) {
+        mtx.data()[idx] = static_cast<T>(elt_dist(PRG));
+    }
+    return mtx;
+}
+
+template <class T>
+Matrix<T> toFloating(const Matrix<int64_t>& mtx) {
+    Matrix<T> result(mtx.rows(), mtx.cols());
+    for (int64_t idx = 0; idx < mtx.rows() * mtx.cols(); ++idx) {
+        result.data()[idx] = static_cast<T>(mtx.data()[idx]);
+    }
+    return result;
+}
+
 
 template <int num_workers>
 DEFINE_TEST(testParallelMultiplication) {
@@ -120,9 +154,102 @@ DEFINE_TEST(testParallelMultiplication) {
 }
 
 
+DEFINE_TEST(testGemm) {
+    ThreadPool tp(4);
+    std::mt19937 PRG;
+    std::uniform_int_distribution<int> size_dist(1, 50);
+    auto check = [&](int64_t rows, int64_t mid, int64_t cols) {
+        Matrix<int64_t> lhs = randomMatrix<int64_t>(rows, mid, PRG);
+        Matrix<int64_t> rhs = randomMatrix<int64_t>(mid, cols, PRG);
+        Matrix<int64_t> expected = simpleMultiply(lhs, rhs);
+        Matrix<int64_t> actual = gemmMultiply(lhs, rhs, tp);
+        // Small integers are exact in floating point as well
+        Matrix<double> actual_double = gemmMultiply(toFloating<double>(lhs), toFloating<double>(rhs), tp);
+        Matrix<float> actual_float = gemmMultiply(toFloating<float>(lhs), toFloating<float>(rhs), tp);
+        for (int64_t idx = 0; idx < rows * cols; ++idx) {
+            ASSERT_EQ(actual.data()[idx], expected.data()[idx]);
+            ASSERT_EQ(actual_double.data()[idx], static_cast<double>(expected.data()[idx]));
+            ASSERT_EQ(actual_float.data()[idx], static_cast<float>(expected.data()[idx]));
+        }
+    };
+    for (int iter = 0; iter < 100; ++iter) {
+        check(size_dist(PRG), size_dist(PRG), size_dist(PRG));
+    }
+    // Edges of the tiles and the panels
+    check(97, 300, 261);
+    check(256, 256, 256);
+    check(1, 1000, 1);
+    check(300, 1, 300);
+
+    // A block in the middle, via the leading dimensions
+    Matrix<int64_t> lhs = randomMatrix<int64_t>(100, 100, PRG);
+    Matrix<int64_t> rhs = randomMatrix<int64_t>(100, 100, PRG);
+    Matrix<int64_t> out(100, 100);
+    parallel_gemm(tp, 30, 40, 50, &lhs.data()[10 * 100 + 20], 100,
+                  &rhs.data()[20 * 100 + 5], 100, &out.data()[5 * 100 + 7], 100);
+    for (int64_t row = 0; row < 30; ++row) {
+        for (int64_t col = 0; col < 40; ++col) {
+            int64_t expected = 0;
+            for (int64_t idx = 0; idx < 50; ++idx) {
+                expected += lhs[10 + row][20 + idx] * rhs[20 + idx][5 + col];
+            }
+            ASSERT_EQ(out[5 + row][7 + col], expected);
+        }
+    }
+    ASSERT_EQ(out[0][0], 0);
+
+    try {
+        parallel_gemm(tp, 10, 10, 10, lhs.data(), 5, rhs.data(), 100, out.data(), 100);
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(gemmBenchmark) {
+    std::mt19937 PRG;
+    Timer timer;
+    LOG_INFO << "GEMM microkernels: " << gemm_isa();
+    for (int64_t size : {128, 256, 512, 1024}) {
+        Matrix<int64_t> lhs = randomMatrix<int64_t>(size, size, PRG);
+        Matrix<int64_t> rhs = randomMatrix<int64_t>(size, size, PRG);
+        Matrix<double> lhs_double = toFloating<double>(lhs);
+        Matrix<double> rhs_double = toFloating<double>(rhs);
+        Matrix<float> lhs_float = toFloating<float>(lhs);
+        Matrix<float> rhs_float = toFloating<float>(rhs);
+        const double flops = 2.0 * size * size * size;
+        for (int num_workers : {1, 2, 4}) {
+            ThreadPool tp(num_workers);
+            auto gflops = [&](auto multiply) {
+                timer.start();
+                multiply();
+                return flops / timer.elapsedMilliseconds() / 1e6;
+            };
+            std::stringstream row_per_task;
+            // Too slow for the largest size
+            if (size <= 512) {
+                row_per_task << std::fixed << std::setprecision(2)
+                             << gflops([&]() { parallelMultiply(lhs, rhs, tp); });
+            } else {
+                row_per_task << "-";
+            }
+            double gemm_int = gflops([&]() { gemmMultiply(lhs, rhs, tp); });
+            double gemm_double = gflops([&]() { gemmMultiply(lhs_double, rhs_double, tp); });
+            double gemm_float = gflops([&]() { gemmMultiply(lhs_float, rhs_float, tp); });
+            LOG_INFO << std::fixed << std::setprecision(2) << size << "x" << size << ", " << num_workers
+                     << " workers, GFLOP/s: row per task (int64) " << row_per_task.str() << ", GEMM int64 "
+                     << gemm_int << ", double " << gemm_double << ", float " << gemm_float;
+        }
+    }
+}
+
+
 int main() {
     RUN_TEST(testParallelMultiplication<1>, "1 Worker");
     RUN_TEST(testParallelMultiplication<2>, "2 Workers");
     RUN_TEST(testParallelMultiplication<4>, "4 Workers");
+    RUN_TEST(testGemm, "GEMM");
+    RUN_TEST(gemmBenchmark, "GEMM benchmark");
     COMPLETE();
 }
@@ -0,0 +1,169 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "task_group.hpp"
+#include "parallel_for.hpp"
+
+using namespace std::chrono_literals;
+
+
+// Checks that every index is visited exactly once
+template <class Partitioner>
+bool visitsAll(ThreadPool& pool, int64_t begin, int64_t end, Partitioner partitioner) {
+    std::vector<std::atomic<int>> visits(end > begin ? end - begin : 0);
+    parallel_for(pool, begin, end, [&visits, begin](int64_t idx) {
+        visits[idx - begin].fetch_add(1, std::memory_order_relaxed);
+    }, partitioner);
+    for (const auto& count : visits) {
+        if (count.load() != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+DEFINE_TEST(parallel_for_just_works) {
+    ThreadPool pool(4);
+    for (int64_t size : {0, 1, 2, 7, 1000, 100'003}) {
+        for (int64_t grain : {1, 3, 64, 1'000'000}) {
+            ASSERT(visitsAll(pool, 10, 10 + size, StaticPartitioner(grain)));
+            ASSERT(visitsAll(pool, 10, 10 + size, GuidedPartitioner(grain)));
+            ASSERT(visitsAll(pool, 10, 10 + size, AutoPartitioner(grain)));
+        }
+    }
+
+    // Called from inside the pool as well
+    auto nested = call_async<bool>(pool, [&pool]() { return visitsAll(pool, 0, 10'000, AutoPartitioner()); });
+    ASSERT(nested.get());
+}
+
+
+DEFINE_TEST(chunk_body_and_grain) {
+    ThreadPool pool(4);
+    constexpr int64_t SIZE = 100'000;
+    constexpr int64_t GRAIN = 1000;
+    std::atomic<int64_t> sum { 0 };
+    std::atomic<bool> chunks_ok { true };
+    auto check_chunk = [&](int64_t begin, int64_t end) {
+        // Only the last chunk may be shorter than the grain
+        if (end - begin < GRAIN && end != SIZE) {
+            chunks_ok.store(false);
+        }
+        int64_t local = 0;
+        for (int64_t idx = begin; idx < end; ++idx) {
+            local += idx;
+        }
+        sum.fetch_add(local);
+    };
+    parallel_for(pool, 0, SIZE, check_chunk, StaticPartitioner(GRAIN));
+    parallel_for(pool, 0, SIZE, check_chunk, GuidedPartitioner(GRAIN));
+    ASSERT(chunks_ok.load());
+    ASSERT_EQ(sum.load(), 2 * SIZE * (SIZE - 1) / 2);
+
+    try {
+        parallel_for(pool, 0, 10, [](int64_t) {}, AutoPartitioner(0));
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(errors) {
+    ThreadPool pool(4);
+    try {
+        parallel_for(pool, 0, 10'000, [](int64_t idx) {
+            if (idx == 5000) {
+                throw std::runtime_error("Bad index");
+            }
+        });
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(std::string(err.what()), "Bad index");
+    }
+}
+
+
+DEFINE_TEST(imbalanced_iterations) {
+    ThreadPool pool(4);
+    // The cost of an iteration grows with its index, so static blocks are imbalanced
+    constexpr int64_t SIZE = 2000;
+    std::vector<double> out(SIZE);
+    auto body = [&out](int64_t idx) {
+        double acc = 0;
+        for (int64_t step = 0; step < idx * 20; ++step) {
+            acc += std::sqrt(static_cast<double>(step));
+        }
+        out[idx] = acc;
+    };
+    Timer timer;
+    parallel_for(pool, 0, SIZE, body, StaticPartitioner());
+    double static_ms = timer.elapsedMilliseconds();
+    timer.start();
+    parallel_for(pool, 0, SIZE, body, GuidedPartitioner());
+    double guided_ms = timer.elapsedMilliseconds();
+    timer.start();
+    parallel_for(pool, 0, SIZE, body, AutoPartitioner());
+    double auto_ms = timer.elapsedMilliseconds();
+    LOG_INFO << std::fixed << std::setprecision(2) << "Imbalanced iterations, static: " << static_ms
+             << " ms, guided: " << guided_ms << " ms, auto: " << auto_ms << " ms";
+}
+
+
+DEFINE_TEST(grain_size_benchmark) {
+    ThreadPool pool(4);
+    constexpr int64_t SIZE = 1'000'000;
+    std::vector<double> out(SIZE);
+    auto body = [&out](int64_t idx) { out[idx] = std::sqrt(static_cast<double>(idx)); };
+
+    // One task per index, as the loops in MatrixTest and LinearEquations do
+    constexpr int64_t PER_INDEX_SIZE = 100'000;
+    Timer timer;
+    auto async_body = make_async(pool, [&out](int64_t idx) { out[idx] = std::sqrt(static_cast<double>(idx)); });
+    TaskGroup<void> per_index;
+    for (int64_t idx = 0; idx < PER_INDEX_SIZE; ++idx) {
+        per_index.join(async_body(idx));
+    }
+    per_index.all().get();
+    double per_index_ms = timer.elapsedMilliseconds() * SIZE / PER_INDEX_SIZE;
+
+    for (int64_t grain : {1, 16, 256, 4096, 65536}) {
+        auto measure = [&](auto partitioner) {
+            timer.start();
+            parallel_for(pool, 0, SIZE, body, partitioner);
+            return timer.elapsedMilliseconds();
+        };
+        double static_ms = measure(StaticPartitioner(grain));
+        double guided_ms = measure(GuidedPartitioner(grain));
+        double auto_ms = measure(AutoPartitioner(grain));
+        LOG_INFO << std::fixed << std::setprecision(2) << SIZE << " iterations, grain " << grain
+                 << ": static " << static_ms << " ms, guided " << guided_ms << " ms, auto " << auto_ms << " ms";
+    }
+    LOG_INFO << std::fixed << std::setprecision(2) << "Task per index via make_async: "
+             << per_index_ms << " ms per " << SIZE << " iterations (extrapolated)";
+}
+
+
+int main() {
+    RUN_TEST(parallel_for_just_works, "parallel_for just works");
+    RUN_TEST(chunk_body_and_grain, "Chunk body and grain");
+    RUN_TEST(errors, "Errors");
+    RUN_TEST(imbalanced_iterations, "Imbalanced iterations");
+    RUN_TEST(grain_size_benchmark, "Grain size sweep");
+    COMPLETE();
+}
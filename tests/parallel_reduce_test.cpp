@@ -0,0 +1,202 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <string>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "task_group.hpp"
+#include "parallel_reduce.hpp"
+
+using namespace std::chrono_literals;
+
+
+int64_t sumRange(ThreadPool& pool, int64_t begin, int64_t end, ReduceOrder order, int64_t grain) {
+    return parallel_reduce(pool, begin, end, int64_t(0),
+        [](int64_t chunk_begin, int64_t chunk_end, int64_t acc) {
+            for (int64_t idx = chunk_begin; idx < chunk_end; ++idx) {
+                acc += idx;
+            }
+            return acc;
+        }, std::plus<int64_t>(), order, grain);
+}
+
+bool sameBits(double lhs, double rhs) {
+    return std::memcmp(&lhs, &rhs, sizeof(double)) == 0;
+}
+
+
+DEFINE_TEST(reduce_just_works) {
+    ThreadPool pool(4);
+    for (ReduceOrder order : {ReduceOrder::Any, ReduceOrder::Deterministic}) {
+        for (int64_t size : {0, 1, 5, 1000, 100'003}) {
+            for (int64_t grain : {1, 7, 1024}) {
+                ASSERT_EQ(sumRange(pool, 0, size, order, grain), size * (size - 1) / 2);
+            }
+        }
+    }
+
+    std::vector<int> values(10'000);
+    std::iota(values.begin(), values.end(), 1);
+    int64_t max = parallel_reduce(pool, values.begin(), values.end(), int64_t(0),
+        [](auto first, auto last, int64_t acc) { return std::max<int64_t>(acc, *std::max_element(first, last)); },
+        [](int64_t lhs, int64_t rhs) { return std::max(lhs, rhs); });
+    ASSERT_EQ(max, 10'000);
+
+    // From inside the pool
+    auto nested = call_async<int64_t>(pool, [&pool]() { return sumRange(pool, 0, 1000, ReduceOrder::Any, 10); });
+    ASSERT_EQ(nested.get(), 1000 * 999 / 2);
+}
+
+
+DEFINE_TEST(transform_reduce) {
+    ThreadPool pool(4);
+    std::vector<int64_t> values(10'000);
+    std::iota(values.begin(), values.end(), 0);
+    auto square = [](int64_t value) { return value * value; };
+    int64_t expected = std::transform_reduce(values.begin(), values.end(), int64_t(5), std::plus<int64_t>(), square);
+
+    ASSERT_EQ(parallel_transform_reduce(pool, values.begin(), values.end(), int64_t(5), std::plus<int64_t>(), square),
+              expected);
+    ASSERT_EQ(parallel_transform_reduce(pool, 0, 10'000, int64_t(5), std::plus<int64_t>(),
+                                        [&](int64_t idx) { return square(values[idx]); }),
+              expected);
+    // Only the init for an empty range
+    ASSERT_EQ(parallel_transform_reduce(pool, 0, 0, int64_t(5), std::plus<int64_t>(), square), int64_t(5));
+}
+
+
+DEFINE_TEST(deterministic_order) {
+    std::mt19937 PRG;
+    std::uniform_real_distribution<double> mantissa(-1, 1);
+    std::uniform_int_distribution<int> exponent(-20, 20);
+    constexpr int SIZE = 200'000;
+    std::vector<double> values(SIZE);
+    for (double& value : values) {
+        value = std::ldexp(mantissa(PRG), exponent(PRG));
+    }
+
+    // Same bits regardless of the number of workers and the timing
+    std::vector<double> sums;
+    for (int num_workers : {1, 2, 4, 8}) {
+        ThreadPool pool(num_workers);
+        for (int iter = 0; iter < 3; ++iter) {
+            sums.push_back(parallel_transform_reduce(pool, values.begin(), values.end(), 0.0, std::plus<double>(),
+                [](double value) { return value; }, ReduceOrder::Deterministic, 1000));
+        }
+    }
+    for (double sum : sums) {
+        ASSERT(sameBits(sum, sums[0]));
+    }
+
+    // Associative, but not commutative
+    ThreadPool pool(4);
+    std::string letters(5000, 'a');
+    for (size_t idx = 0; idx < letters.size(); ++idx) {
+        letters[idx] = static_cast<char>('a' + idx % 26);
+    }
+    std::string concatenated = parallel_reduce(pool, letters.begin(), letters.end(), std::string(),
+        [](auto first, auto last, std::string acc) { return acc.append(first, last); },
+        [](std::string lhs, const std::string& rhs) { return lhs + rhs; },
+        ReduceOrder::Deterministic, 7);
+    ASSERT_EQ(concatenated, letters);
+}
+
+
+DEFINE_TEST(errors) {
+    ThreadPool pool(2);
+    try {
+        parallel_transform_reduce(pool, 0, 10'000, 0, std::plus<int>(), [](int64_t idx) -> int {
+            if (idx == 1234) {
+                throw std::runtime_error("Bad element");
+            }
+            return 1;
+        });
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(std::string(err.what()), "Bad element");
+    }
+    try {
+        sumRange(pool, 0, 10, ReduceOrder::Any, 0);
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(dot_product_benchmark) {
+    ThreadPool pool(4);
+    constexpr int64_t SIZE = 10'000'000;
+    constexpr int64_t NUM_CHUNKS = 1000;
+    std::vector<double> lhs(SIZE), rhs(SIZE);
+    for (int64_t idx = 0; idx < SIZE; ++idx) {
+        lhs[idx] = std::sin(static_cast<double>(idx));
+        rhs[idx] = std::cos(static_cast<double>(idx));
+    }
+    auto product = [&](int64_t idx) { return lhs[idx] * rhs[idx]; };
+    Timer timer;
+
+    timer.start();
+    double serial = 0;
+    for (int64_t idx = 0; idx < SIZE; ++idx) {
+        serial += product(idx);
+    }
+    double serial_ms = timer.elapsedMilliseconds();
+
+    // TaskGroup::all and a serial fold, the only way so far
+    timer.start();
+    TaskGroup<double> chunks;
+    for (int64_t chunk = 0; chunk < NUM_CHUNKS; ++chunk) {
+        chunks.join(call_async<double>(pool, [&product, chunk]() {
+            double acc = 0;
+            for (int64_t idx = chunk * SIZE / NUM_CHUNKS; idx < (chunk + 1) * SIZE / NUM_CHUNKS; ++idx) {
+                acc += product(idx);
+            }
+            return acc;
+        }));
+    }
+    auto partials = chunks.all().get();
+    double group = std::accumulate(partials.begin(), partials.end(), 0.0);
+    double group_ms = timer.elapsedMilliseconds();
+
+    timer.start();
+    double any = parallel_transform_reduce(pool, 0, SIZE, 0.0, std::plus<double>(), product);
+    double any_ms = timer.elapsedMilliseconds();
+
+    timer.start();
+    double deterministic = parallel_transform_reduce(pool, 0, SIZE, 0.0, std::plus<double>(), product,
+                                                     ReduceOrder::Deterministic);
+    double deterministic_ms = timer.elapsedMilliseconds();
+
+    ASSERT(std::abs(group - serial) < 1e-6);
+    ASSERT(std::abs(any - serial) < 1e-6);
+    ASSERT(std::abs(deterministic - serial) < 1e-6);
+    LOG_INFO << std::fixed << std::setprecision(2) << "Dot product of " << SIZE << " elements: serial "
+             << serial_ms << " ms, TaskGroup " << group_ms << " ms, reduce " << any_ms
+             << " ms, deterministic reduce " << deterministic_ms << " ms";
+}
+
+
+int main() {
+    RUN_TEST(reduce_just_works, "parallel_reduce just works");
+    RUN_TEST(transform_reduce, "parallel_transform_reduce");
+    RUN_TEST(deterministic_order, "Deterministic order");
+    RUN_TEST(errors, "Errors");
+    RUN_TEST(dot_product_benchmark, "Dot product");
+    COMPLETE();
+}
@@ -0,0 +1,208 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <string>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "parallel_for.hpp"
+#include "parallel_scan.hpp"
+
+using namespace std::chrono_literals;
+
+
+template <class T>
+std::vector<T> smallValues(size_t size, std::mt19937& PRG) {
+    // Small integers keep floating-point sums exact
+    std::vector<T> values(size);
+    for (T& value : values) {
+        value = static_cast<T>(static_cast<int>(PRG() % 201) - 100);
+    }
+    return values;
+}
+
+template <class T>
+bool scansLikeStd(ThreadPool& pool, const std::vector<T>& values) {
+    std::vector<T> expected(values.size()), result(values.size());
+    std::inclusive_scan(values.begin(), values.end(), expected.begin());
+    auto end = parallel_inclusive_scan(pool, values.begin(), values.end(), result.begin());
+    if (end != result.end() || result != expected) {
+        return false;
+    }
+    std::inclusive_scan(values.begin(), values.end(), expected.begin(), std::plus<T>(), T(7));
+    parallel_inclusive_scan(pool, values.begin(), values.end(), result.begin(), std::plus<T>(), T(7));
+    if (result != expected) {
+        return false;
+    }
+    std::exclusive_scan(values.begin(), values.end(), expected.begin(), T(7));
+    parallel_exclusive_scan(pool, values.begin(), values.end(), result.begin(), T(7));
+    return result == expected;
+}
+
+
+DEFINE_TEST(scan_just_works) {
+    ThreadPool pool(4);
+    std::mt19937 PRG;
+    for (size_t size : {0, 1, 3, 5, 1000, 16'385, 100'003, 1'000'000}) {
+        ASSERT(scansLikeStd(pool, smallValues<int>(size, PRG)));
+        ASSERT(scansLikeStd(pool, smallValues<int64_t>(size, PRG)));
+        ASSERT(scansLikeStd(pool, smallValues<uint32_t>(size, PRG)));
+        ASSERT(scansLikeStd(pool, smallValues<float>(size, PRG)));
+        ASSERT(scansLikeStd(pool, smallValues<double>(size, PRG)));
+        ASSERT(scansLikeStd(pool, smallValues<int16_t>(size, PRG)));
+    }
+
+    // In place, and out of a non-contiguous container
+    std::vector<int> values = smallValues<int>(200'000, PRG);
+    std::vector<int> expected(values.size());
+    std::exclusive_scan(values.begin(), values.end(), expected.begin(), 0);
+    std::deque<int> deque(values.begin(), values.end());
+    parallel_exclusive_scan(pool, values.begin(), values.end(), values.begin(), 0);
+    ASSERT(values == expected);
+    parallel_exclusive_scan(pool, deque.begin(), deque.end(), deque.begin(), 0);
+    ASSERT(std::equal(deque.begin(), deque.end(), expected.begin()));
+
+    // From inside the pool
+    auto nested = call_async<bool>(pool, [&]() { return scansLikeStd(pool, smallValues<int>(100'000, PRG)); });
+    ASSERT(nested.get());
+}
+
+
+DEFINE_TEST(custom_op) {
+    ThreadPool pool(4);
+    // Associative, but not commutative
+    constexpr size_t SIZE = 100'000;
+    std::vector<std::string> letters(SIZE);
+    for (size_t idx = 0; idx < SIZE; ++idx) {
+        letters[idx] = std::string(1, static_cast<char>('a' + idx % 26));
+    }
+    // Keeps the last 3 characters of the concatenation
+    auto suffix = [](std::string lhs, const std::string& rhs) {
+        lhs += rhs;
+        return lhs.size() > 3 ? lhs.substr(lhs.size() - 3) : lhs;
+    };
+    std::vector<std::string> expected(SIZE), result(SIZE);
+    std::inclusive_scan(letters.begin(), letters.end(), expected.begin(), suffix);
+    parallel_inclusive_scan(pool, letters.begin(), letters.end(), result.begin(), suffix);
+    ASSERT(result == expected);
+    std::exclusive_scan(letters.begin(), letters.end(), expected.begin(), std::string("<"), suffix);
+    parallel_exclusive_scan(pool, letters.begin(), letters.end(), result.begin(), std::string("<"), suffix);
+    ASSERT(result == expected);
+
+    // Running maximum
+    std::mt19937 PRG;
+    std::vector<int> values = smallValues<int>(SIZE, PRG);
+    std::vector<int> max_expected(SIZE), max_result(SIZE);
+    auto max = [](int lhs, int rhs) { return std::max(lhs, rhs); };
+    std::inclusive_scan(values.begin(), values.end(), max_expected.begin(), max);
+    parallel_inclusive_scan(pool, values.begin(), values.end(), max_result.begin(), max);
+    ASSERT(max_result == max_expected);
+}
+
+
+DEFINE_TEST(stream_compaction) {
+    ThreadPool pool(4);
+    std::mt19937 PRG;
+    constexpr int64_t SIZE = 1'000'000;
+    std::vector<int> values = smallValues<int>(SIZE, PRG);
+
+    // Positions of the kept elements are the exclusive sums of the flags
+    std::vector<int64_t> positions(SIZE);
+    parallel_for(pool, 0, SIZE, [&](int64_t idx) { positions[idx] = values[idx] > 0 ? 1 : 0; });
+    int64_t num_kept = positions.back();
+    parallel_exclusive_scan(pool, positions.begin(), positions.end(), positions.begin(), int64_t(0));
+    num_kept += positions.back();
+    std::vector<int> compacted(num_kept);
+    parallel_for(pool, 0, SIZE, [&](int64_t idx) {
+        if (values[idx] > 0) {
+            compacted[positions[idx]] = values[idx];
+        }
+    });
+
+    std::vector<int> expected;
+    std::copy_if(values.begin(), values.end(), std::back_inserter(expected), [](int value) { return value > 0; });
+    ASSERT(compacted == expected);
+}
+
+
+DEFINE_TEST(errors) {
+    ThreadPool pool(2);
+    std::vector<int> values(100'000, 1), result(100'000);
+    try {
+        parallel_inclusive_scan(pool, values.begin(), values.end(), result.begin(), [](int lhs, int rhs) {
+            if (lhs == 50'000) {
+                throw std::runtime_error("Bad sum");
+            }
+            return lhs + rhs;
+        });
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(std::string(err.what()), "Bad sum");
+    }
+}
+
+
+DEFINE_TEST(scan_benchmark) {
+    constexpr int64_t SIZE = 20'000'000;
+    std::mt19937 PRG;
+    std::vector<int64_t> ints = smallValues<int64_t>(SIZE, PRG);
+    std::vector<float> floats = smallValues<float>(SIZE, PRG);
+    std::vector<int64_t> int_out(SIZE);
+    std::vector<float> float_out(SIZE);
+    Timer timer;
+    auto measure = [&timer](auto scan) {
+        timer.start();
+        scan();
+        return timer.elapsedMilliseconds();
+    };
+    // Not std::plus, so the scalar block kernel is used
+    auto scalar_plus = [](auto lhs, auto rhs) { return lhs + rhs; };
+
+    double std_int_ms = measure([&]() { std::inclusive_scan(ints.begin(), ints.end(), int_out.begin()); });
+    double std_float_ms = measure([&]() { std::inclusive_scan(floats.begin(), floats.end(), float_out.begin()); });
+    LOG_INFO << std::fixed << std::setprecision(2) << SIZE << " elements, std::inclusive_scan int64 "
+             << std_int_ms << " ms, float " << std_float_ms << " ms";
+    for (int num_workers : {1, 4}) {
+        ThreadPool pool(num_workers);
+        double scalar_int_ms = measure([&]() {
+            parallel_inclusive_scan(pool, ints.begin(), ints.end(), int_out.begin(), scalar_plus);
+        });
+        double simd_int_ms = measure([&]() { parallel_inclusive_scan(pool, ints.begin(), ints.end(), int_out.begin()); });
+        double scalar_float_ms = measure([&]() {
+            parallel_inclusive_scan(pool, floats.begin(), floats.end(), float_out.begin(), scalar_plus);
+        });
+        double simd_float_ms = measure([&]() {
+            parallel_inclusive_scan(pool, floats.begin(), floats.end(), float_out.begin());
+        });
+        ASSERT_EQ(int_out.back(), std::accumulate(ints.begin(), ints.end(), int64_t(0)));
+        LOG_INFO << std::fixed << std::setprecision(2) << num_workers << " workers, int64: scalar "
+                 << scalar_int_ms << " ms, SSE2 " << simd_int_ms << " ms; float: scalar "
+                 << scalar_float_ms << " ms, SSE2 " << simd_float_ms << " ms";
+    }
+}
+
+
+int main() {
+    RUN_TEST(scan_just_works, "Scans just work");
+    RUN_TEST(custom_op, "Custom op");
+    RUN_TEST(stream_compaction, "Stream compaction");
+    RUN_TEST(errors, "Errors");
+    RUN_TEST(scan_benchmark, "Scan benchmark");
+    COMPLETE();
+}
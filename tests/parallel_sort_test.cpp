@@ -0,0 +1,214 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "parallel_sort.hpp"
+
+using namespace std::chrono_literals;
+
+
+template <class T>
+std::vector<T> randomValues(size_t size, T min, T max, std::mt19937& PRG) {
+    std::uniform_int_distribution<T> dist(min, max);
+    std::vector<T> values(size);
+    for (T& value : values) {
+        value = dist(PRG);
+    }
+    return values;
+}
+
+// Sorts a copy both ways and compares
+template <class T, class... Compare>
+bool sortsLikeStd(ThreadPool& pool, std::vector<T> values, Compare... comp) {
+    std::vector<T> expected = values;
+    std::sort(expected.begin(), expected.end(), comp...);
+    parallel_sort(pool, values.begin(), values.end(), comp...);
+    return values == expected;
+}
+
+
+DEFINE_TEST(sort_just_works) {
+    ThreadPool pool(4);
+    std::mt19937 PRG;
+    for (size_t size : {0, 1, 2, 100, 20'000, 100'003, 1'000'000}) {
+        // Few distinct values, then mostly distinct
+        ASSERT(sortsLikeStd(pool, randomValues<int>(size, -100, 100, PRG), std::less<int>()));
+        ASSERT(sortsLikeStd(pool, randomValues<int>(size, -1'000'000'000, 1'000'000'000, PRG), std::less<int>()));
+        ASSERT(sortsLikeStd(pool, randomValues<int>(size, -1'000'000'000, 1'000'000'000, PRG), std::greater<int>()));
+    }
+
+    constexpr size_t SIZE = 300'000;
+    std::vector<int> sorted(SIZE);
+    for (size_t idx = 0; idx < SIZE; ++idx) {
+        sorted[idx] = static_cast<int>(idx);
+    }
+    std::vector<int> reversed(sorted.rbegin(), sorted.rend());
+    ASSERT(sortsLikeStd(pool, sorted, std::less<int>()));
+    ASSERT(sortsLikeStd(pool, reversed, std::less<int>()));
+    ASSERT(sortsLikeStd(pool, std::vector<int>(SIZE, 42), std::less<int>()));
+
+    std::vector<std::string> strings(SIZE);
+    for (std::string& str : strings) {
+        str = std::to_string(PRG() % 100'000);
+    }
+    ASSERT(sortsLikeStd(pool, strings));
+    ASSERT(sortsLikeStd(pool, randomValues<int64_t>(SIZE, 0, 1000, PRG), std::less<int64_t>()));
+
+    // From inside the pool
+    auto nested = call_async<bool>(pool, [&]() {
+        return sortsLikeStd(pool, randomValues<int>(SIZE, -1000, 1000, PRG), std::less<int>());
+    });
+    ASSERT(nested.get());
+}
+
+
+DEFINE_TEST(radix_sort) {
+    ThreadPool pool(4);
+    std::mt19937 PRG;
+    constexpr size_t SIZE = 200'000;
+    ASSERT(sortsLikeStd(pool, randomValues<int>(SIZE, std::numeric_limits<int>::min(),
+                                                std::numeric_limits<int>::max(), PRG)));
+    ASSERT(sortsLikeStd(pool, randomValues<int>(SIZE, -100, 100, PRG)));
+    ASSERT(sortsLikeStd(pool, randomValues<int16_t>(SIZE, std::numeric_limits<int16_t>::min(),
+                                                    std::numeric_limits<int16_t>::max(), PRG)));
+    ASSERT(sortsLikeStd(pool, randomValues<int64_t>(SIZE, std::numeric_limits<int64_t>::min(),
+                                                    std::numeric_limits<int64_t>::max(), PRG)));
+    ASSERT(sortsLikeStd(pool, randomValues<uint32_t>(SIZE, 0, std::numeric_limits<uint32_t>::max(), PRG)));
+    ASSERT(sortsLikeStd(pool, randomValues<uint64_t>(SIZE, 0, 1u << 20, PRG)));
+
+    std::vector<char> letters(SIZE);
+    for (char& letter : letters) {
+        letter = static_cast<char>(PRG() % 128);
+    }
+    ASSERT(sortsLikeStd(pool, letters));
+    ASSERT(sortsLikeStd(pool, std::vector<int>(SIZE, -7)));
+
+    // Keys, that share most of their digits, so that only some of the passes run: in an odd
+    // number of passes, a middle one, or none at all
+    ASSERT(sortsLikeStd(pool, randomValues<int64_t>(SIZE, 0, 255, PRG)));
+    ASSERT(sortsLikeStd(pool, randomValues<int64_t>(SIZE, 0, 1 << 23, PRG)));
+    ASSERT(sortsLikeStd(pool, randomValues<int64_t>(SIZE, -100, -1, PRG)));
+    std::vector<int64_t> middle_digit = randomValues<int64_t>(SIZE, 0, 255, PRG);
+    for (int64_t& value : middle_digit) {
+        value = (value << 16) | 0x1234;
+    }
+    ASSERT(sortsLikeStd(pool, middle_digit));
+    ASSERT(sortsLikeStd(pool, std::vector<int64_t>(SIZE, 1'000'000'007)));
+}
+
+
+DEFINE_TEST(stable_sort) {
+    ThreadPool pool(4);
+    std::mt19937 PRG;
+    // Sorted by the key only, the index tells the original order
+    using Entry = std::pair<int, int>;
+    auto by_key = [](const Entry& lhs, const Entry& rhs) { return lhs.first < rhs.first; };
+    for (size_t size : {0, 1, 1000, 100'000, 500'003}) {
+        for (int num_keys : {1, 10, 100'000}) {
+            std::vector<Entry> entries(size);
+            for (size_t idx = 0; idx < size; ++idx) {
+                entries[idx] = {static_cast<int>(PRG() % num_keys), static_cast<int>(idx)};
+            }
+            std::vector<Entry> expected = entries;
+            std::stable_sort(expected.begin(), expected.end(), by_key);
+            parallel_stable_sort(pool, entries.begin(), entries.end(), by_key);
+            ASSERT(entries == expected);
+        }
+    }
+
+    std::vector<double> values(100'000);
+    for (double& value : values) {
+        value = static_cast<double>(PRG()) / 1000;
+    }
+    std::vector<double> expected = values;
+    std::sort(expected.begin(), expected.end());
+    parallel_stable_sort(pool, values.begin(), values.end());
+    ASSERT(values == expected);
+}
+
+
+DEFINE_TEST(errors) {
+    ThreadPool pool(2);
+    std::mt19937 PRG;
+    std::vector<int> values = randomValues<int>(100'000, 0, 1000, PRG);
+    auto throwing = [](int lhs, int rhs) {
+        if (lhs == 500 || rhs == 500) {
+            throw std::runtime_error("Bad comparison");
+        }
+        return lhs < rhs;
+    };
+    try {
+        parallel_sort(pool, values.begin(), values.end(), throwing);
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(std::string(err.what()), "Bad comparison");
+    }
+    try {
+        parallel_stable_sort(pool, values.begin(), values.end(), throwing);
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(std::string(err.what()), "Bad comparison");
+    }
+}
+
+
+DEFINE_TEST(sort_benchmark) {
+    std::mt19937 PRG;
+    constexpr size_t SIZE = 2'000'000;
+    std::vector<int> values = randomValues<int>(SIZE, -1'000'000'000, 1'000'000'000, PRG);
+    std::vector<std::pair<int, int> > entries(SIZE);
+    for (size_t idx = 0; idx < SIZE; ++idx) {
+        entries[idx] = {values[idx] % 1000, static_cast<int>(idx)};
+    }
+    Timer timer;
+    auto measure = [&timer](auto input, auto sort) {
+        timer.start();
+        sort(input.begin(), input.end());
+        double ms = timer.elapsedMilliseconds();
+        return std::is_sorted(input.begin(), input.end()) ? ms : -1.0;
+    };
+
+    double std_ms = measure(values, [](auto first, auto last) { std::sort(first, last); });
+    double std_stable_ms = measure(entries, [](auto first, auto last) { std::stable_sort(first, last); });
+    LOG_INFO << std::fixed << std::setprecision(2) << SIZE << " elements, std::sort " << std_ms
+             << " ms, std::stable_sort " << std_stable_ms << " ms";
+    for (int num_workers : {1, 4, 16}) {
+        ThreadPool pool(num_workers);
+        auto sample = [&pool](auto first, auto last) { parallel_sort(pool, first, last, std::less<>()); };
+        auto radix = [&pool](auto first, auto last) { parallel_sort(pool, first, last); };
+        auto stable = [&pool](auto first, auto last) { parallel_stable_sort(pool, first, last); };
+        double sample_ms = measure(values, sample);
+        double radix_ms = measure(values, radix);
+        double stable_ms = measure(entries, stable);
+        ASSERT(sample_ms >= 0 && radix_ms >= 0 && stable_ms >= 0);
+        LOG_INFO << std::fixed << std::setprecision(2) << num_workers << " workers: sample sort " << sample_ms
+                 << " ms, radix sort " << radix_ms << " ms, stable sort " << stable_ms << " ms";
+    }
+}
+
+
+int main() {
+    RUN_TEST(sort_just_works, "parallel_sort just works");
+    RUN_TEST(radix_sort, "Radix sort");
+    RUN_TEST(stable_sort, "parallel_stable_sort");
+    RUN_TEST(errors, "Errors");
+    RUN_TEST(sort_benchmark, "Sort benchmark");
+    COMPLETE();
+}
@@ -0,0 +1,298 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <string>
+#include <numeric>
+#include <algorithm>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "pipeline.hpp"
+
+using namespace std::chrono_literals;
+
+
+// Produces numbers 0, 1, ..., count - 1
+struct Counter {
+    int operator()(FlowControl& flow) {
+        if (next == count) {
+            flow.stop();
+            return 0;
+        }
+        return next++;
+    }
+
+    int count;
+    int next = 0;
+};
+
+// Detects concurrent execution of the calls that share it
+struct ExclusionChecker {
+    void operator()() {
+        if (in_flight.fetch_add(1) != 0) {
+            ok.store(false);
+        }
+        std::this_thread::yield();
+        in_flight.fetch_sub(1);
+    }
+
+    std::atomic<int>& in_flight;
+    std::atomic<bool>& ok;
+};
+
+
+DEFINE_TEST(pipeline_just_works) {
+    ThreadPool pool(4);
+    constexpr int NUM_ITEMS = 1000;
+    std::vector<std::string> output;
+
+    auto stats = make_pipeline<int>(pool, Counter{NUM_ITEMS})
+        .stage<std::string>(StageMode::Parallel, [](int value) {
+            return std::to_string(value);
+        })
+        .stage<std::string>(StageMode::Parallel, [](std::string str) {
+            return "#" + str;
+        })
+        .stage<void>(StageMode::SerialInOrder, [&output](std::string str) {
+            output.push_back(std::move(str));
+        })
+        .run(8)
+        .get();
+
+    ASSERT_EQ(output.size(), static_cast<size_t>(NUM_ITEMS));
+    for (int idx = 0; idx < NUM_ITEMS; ++idx) {
+        ASSERT_EQ(output[idx], "#" + std::to_string(idx));
+    }
+    ASSERT_EQ(stats.stages.size(), 4u);
+    for (const auto& stage : stats.stages) {
+        ASSERT_EQ(stage.items, static_cast<uint64_t>(NUM_ITEMS));
+    }
+}
+
+
+DEFINE_TEST(serial_stages) {
+    ThreadPool pool(4);
+    constexpr int NUM_ITEMS = 500;
+    std::atomic<int> in_flight_1 { 0 }, in_flight_2 { 0 };
+    std::atomic<bool> ok { true };
+    std::vector<int> unordered, ordered;
+
+    make_pipeline<int>(pool, Counter{NUM_ITEMS})
+        .stage<int>(StageMode::Parallel, [](int value) {
+            // Shuffle the items
+            if (value % 7 == 0) {
+                std::this_thread::sleep_for(100us);
+            }
+            return value;
+        })
+        .stage<int>(StageMode::SerialOutOfOrder, [&](int value) {
+            ExclusionChecker{in_flight_1, ok}();
+            unordered.push_back(value);
+            return value;
+        })
+        .stage<void>(StageMode::SerialInOrder, [&](int value) {
+            ExclusionChecker{in_flight_2, ok}();
+            ordered.push_back(value);
+        })
+        .run(16)
+        .get();
+
+    ASSERT(ok.load());
+    std::vector<int> expected(NUM_ITEMS);
+    std::iota(expected.begin(), expected.end(), 0);
+    ASSERT(ordered == expected);
+    std::sort(unordered.begin(), unordered.end());
+    ASSERT(unordered == expected);
+}
+
+
+DEFINE_TEST(tokens_are_bounded) {
+    ThreadPool pool(4);
+    constexpr size_t MAX_TOKENS = 3;
+    std::atomic<size_t> in_flight { 0 };
+    std::atomic<size_t> max_in_flight { 0 };
+
+    make_pipeline<int>(pool, [&in_flight, &max_in_flight, count = 0](FlowControl& flow) mutable {
+            if (count == 200) {
+                flow.stop();
+                return 0;
+            }
+            size_t now = in_flight.fetch_add(1) + 1;
+            size_t prev = max_in_flight.load();
+            while (prev < now && !max_in_flight.compare_exchange_weak(prev, now)) {   }
+            return count++;
+        })
+        .stage<void>(StageMode::Parallel, [&in_flight](int) {
+            std::this_thread::sleep_for(100us);
+            in_flight.fetch_sub(1);
+        })
+        .run(MAX_TOKENS)
+        .get();
+
+    ASSERT(max_in_flight.load() <= MAX_TOKENS);
+}
+
+
+DEFINE_TEST(error_in_stage) {
+    ThreadPool pool(2);
+    std::atomic<int> consumed { 0 };
+    auto result = make_pipeline<int>(pool, Counter{1000})
+        .stage<int>(StageMode::Parallel, [](int value) {
+            if (value == 100) {
+                throw std::runtime_error("Bad item");
+            }
+            return value;
+        })
+        .stage<void>(StageMode::SerialInOrder, [&consumed](int) { consumed.fetch_add(1); })
+        .run(4);
+    try {
+        result.get();
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(std::string(err.what()), "Bad item");
+    }
+    // The source is stopped soon after the failure
+    ASSERT(consumed.load() < 1000);
+
+    try {
+        make_pipeline<int>(pool, Counter{10}).run(0);
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(stopped_pool) {
+    // Started on a stopped pool
+    ThreadPool stopped(1);
+    stopped.stop();
+    auto never = make_pipeline<int>(stopped, Counter{10})
+        .stage<void>(StageMode::SerialInOrder, [](int) {   })
+        .run(4);
+    try {
+        never.get();
+        FAIL();
+    } catch (const CancelledError&) {
+        // pass
+    }
+
+    // The pool stops while an endless source is running
+    ThreadPool pool(2);
+    std::atomic<int> consumed { 0 };
+    auto endless = make_pipeline<int>(pool, [](FlowControl&) { return 1; })
+        .stage<int>(StageMode::Parallel, [](int value) {
+            std::this_thread::yield();
+            return value;
+        })
+        .stage<void>(StageMode::SerialInOrder, [&consumed](int) { consumed.fetch_add(1); })
+        .run(4);
+    while (consumed.load() < 100) {
+        std::this_thread::yield();
+    }
+    pool.stop();
+    try {
+        endless.get();
+        FAIL();
+    } catch (const CancelledError&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(bottleneck_stats) {
+    ThreadPool pool(4);
+    auto stats = make_pipeline<int>(pool, Counter{100})
+        .stage<int>(StageMode::Parallel, [](int value) { return value; })
+        .stage<int>(StageMode::SerialInOrder, [](int value) {
+            std::this_thread::sleep_for(500us);
+            return value;
+        })
+        .stage<void>(StageMode::Parallel, [](int) {})
+        .run(8)
+        .get();
+
+    // The slow serial stage is the busiest one, and items queue up in front of it
+    size_t busiest = 0, most_queued = 0;
+    for (size_t idx = 0; idx < stats.stages.size(); ++idx) {
+        if (stats.stages[idx].busy > stats.stages[busiest].busy) {
+            busiest = idx;
+        }
+        if (stats.stages[idx].queued > stats.stages[most_queued].queued) {
+            most_queued = idx;
+        }
+    }
+    ASSERT_EQ(busiest, 2u);
+    ASSERT_EQ(most_queued, 2u);
+    ASSERT(stats.stages[2].mode == StageMode::SerialInOrder);
+    ASSERT(stats.elapsed >= 50ms);
+}
+
+
+// read -> parse -> transform -> aggregate
+DEFINE_TEST(pipeline_vs_then_chains_benchmark) {
+    ThreadPool pool(4);
+    constexpr int NUM_LINES = 100'000;
+    auto parse = [](std::string line) { return std::stoll(line); };
+    auto transform = [](int64_t value) { return value * value % 1000; };
+
+    int64_t chain_sum = 0;
+    double chain_ms = 0;
+    {
+        Timer timer;
+        std::vector<AsyncResult<int64_t> > results;
+        results.reserve(NUM_LINES);
+        for (int idx = 0; idx < NUM_LINES; ++idx) {
+            results.push_back(call_async<std::string>(pool, [idx]() { return std::to_string(idx); })
+                .then<int64_t>(parse)
+                .then<int64_t>(transform));
+        }
+        for (auto& result : results) {
+            chain_sum += result.get();
+        }
+        chain_ms = timer.elapsedMilliseconds();
+    }
+
+    int64_t pipeline_sum = 0;
+    double pipeline_ms = 0;
+    {
+        Timer timer;
+        make_pipeline<std::string>(pool, [idx = 0](FlowControl& flow) mutable {
+                if (idx == NUM_LINES) {
+                    flow.stop();
+                }
+                return std::to_string(idx++);
+            })
+            .stage<int64_t>(StageMode::Parallel, parse)
+            .stage<int64_t>(StageMode::Parallel, transform)
+            .stage<void>(StageMode::SerialOutOfOrder, [&pipeline_sum](int64_t value) { pipeline_sum += value; })
+            .run(64)
+            .get();
+        pipeline_ms = timer.elapsedMilliseconds();
+    }
+
+    ASSERT_EQ(chain_sum, pipeline_sum);
+    LOG_INFO << std::fixed << std::setprecision(2) << NUM_LINES << " lines via then chains: " << chain_ms << " ms";
+    LOG_INFO << std::fixed << std::setprecision(2) << NUM_LINES << " lines via pipeline: " << pipeline_ms << " ms";
+}
+
+
+int main() {
+    RUN_TEST(pipeline_just_works, "Pipeline just works");
+    RUN_TEST(serial_stages, "Serial stages");
+    RUN_TEST(tokens_are_bounded, "Tokens in flight are bounded");
+    RUN_TEST(error_in_stage, "Error in stage");
+    RUN_TEST(stopped_pool, "Stopped pool");
+    RUN_TEST(bottleneck_stats, "Stage stats reveal the bottleneck");
+    RUN_TEST(pipeline_vs_then_chains_benchmark, "Pipeline vs then chains");
+    COMPLETE();
+}
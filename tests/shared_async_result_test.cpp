@@ -0,0 +1,181 @@
+#include <iostream>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <string>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "shared_async_result.hpp"
+#include "task_group.hpp"
+
+using namespace std::chrono_literals;
+
+
+// Counts the copies made by the library
+struct CopyCounter {
+    explicit CopyCounter(std::atomic<int>& copies) : copies(&copies) {   }
+
+    CopyCounter(const CopyCounter& other) : copies(other.copies) { copies->fetch_add(1); }
+    CopyCounter(CopyCounter&&) = default;
+    CopyCounter& operator=(const CopyCounter& other) {
+        copies = other.copies;
+        copies->fetch_add(1);
+        return *this;
+    }
+    CopyCounter& operator=(CopyCounter&&) = default;
+
+    std::atomic<int>* copies;
+};
+
+
+DEFINE_TEST(just_works) {
+    ThreadPool pool(2);
+    SharedAsyncResult<std::string> shared = call_async<std::string>(pool, []() {
+        std::this_thread::sleep_for(10ms);
+        return std::string("shared");
+    }).share();
+    SharedAsyncResult<std::string> copy = shared;
+    ASSERT_EQ(shared.get(), "shared");
+    ASSERT_EQ(copy.get(), "shared");
+    // Both handles refer to the very same value
+    ASSERT(&shared.get() == &copy.get());
+}
+
+
+DEFINE_TEST(fan_out_continuations) {
+    ThreadPool pool(4);
+    std::atomic<int> copies { 0 };
+    auto shared = call_async<CopyCounter>(pool, [&copies]() {
+        std::this_thread::sleep_for(10ms);
+        return CopyCounter(copies);
+    }).share();
+
+    constexpr int NUM_SUBSCRIBERS = 100;
+    TaskGroup<bool> tg;
+    for (int idx = 0; idx < NUM_SUBSCRIBERS; ++idx) {
+        tg.join(shared.then<bool>([&copies](const CopyCounter& val) {
+            return val.copies == &copies;
+        }));
+    }
+    auto results = tg.all().get();
+    ASSERT_EQ(results.size(), static_cast<size_t>(NUM_SUBSCRIBERS));
+    for (bool res : results) {
+        ASSERT(res);
+    }
+    // Subscription after the value has been produced
+    ASSERT(shared.then<bool>([](const CopyCounter&) { return true; }, ThenPolicy::NoSchedule).get());
+    ASSERT_EQ(copies.load(), 0);
+}
+
+
+DEFINE_TEST(blocking_waiters) {
+    ThreadPool pool(1);
+    std::atomic<bool> release { false };
+    auto shared = call_async<int>(pool, [&release]() {
+        while (!release.load()) {
+            std::this_thread::sleep_for(1ms);
+        }
+        return 42;
+    }).share();
+
+    constexpr int NUM_WAITERS = 8;
+    std::atomic<int> sum { 0 };
+    std::vector<std::thread> waiters;
+    for (int idx = 0; idx < NUM_WAITERS; ++idx) {
+        waiters.emplace_back([shared, &sum]() {
+            sum.fetch_add(shared.get());
+        });
+    }
+    std::this_thread::sleep_for(10ms);
+    ASSERT_EQ(sum.load(), 0);
+    release.store(true);
+    for (auto& waiter : waiters) {
+        waiter.join();
+    }
+    ASSERT_EQ(sum.load(), 42 * NUM_WAITERS);
+}
+
+
+DEFINE_TEST(error_reaches_everyone) {
+    ThreadPool pool(2);
+    auto shared = call_async<int>(pool, []() {
+        throw std::runtime_error("Oops");
+        return 0;
+    }).share();
+    auto then_res = shared.then<int>([](const int& val) { return val + 1; });
+    try {
+        shared.get();
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(err.what(), std::string("Oops"));
+    }
+    try {
+        then_res.get();
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(err.what(), std::string("Oops"));
+    }
+}
+
+
+DEFINE_TEST(shared_void) {
+    ThreadPool pool(2);
+    std::atomic<int> counter { 0 };
+    auto shared = call_async<void>(pool, [&counter]() { counter.fetch_add(1); }).share();
+    TaskGroup<void> tg;
+    for (int idx = 0; idx < 10; ++idx) {
+        tg.join(shared.then<void>([&counter]() { counter.fetch_add(1); }));
+    }
+    tg.all().get();
+    shared.get();
+    ASSERT_EQ(counter.load(), 11);
+}
+
+
+DEFINE_TEST(in_does_transfer) {
+    ThreadPool pool_1(1);
+    ThreadPool pool_2(1);
+    auto tid_2 = call_async<std::thread::id>(pool_2, []() { return std::this_thread::get_id(); }).get();
+    auto shared = call_async<int>(pool_1, []() { return 1; }).share();
+    auto executed_on = shared.in(pool_2).then<std::thread::id>([](const int&) {
+        return std::this_thread::get_id();
+    });
+    ASSERT(executed_on.get() == tid_2);
+}
+
+
+DEFINE_TEST(subscribe_while_producing) {
+    ThreadPool pool(4);
+    constexpr int NUM_ITERS = 1000;
+    constexpr int NUM_SUBSCRIBERS = 4;
+    for (int iter = 0; iter < NUM_ITERS; ++iter) {
+        auto shared = call_async<int>(pool, [iter]() { return iter; }).share();
+        std::atomic<int> sum { 0 };
+        TaskGroup<void> tg;
+        for (int idx = 0; idx < NUM_SUBSCRIBERS; ++idx) {
+            tg.join(shared.then<void>([&sum](const int& val) { sum.fetch_add(val); }, ThenPolicy::Eager));
+        }
+        tg.all().get();
+        ASSERT_EQ(sum.load(), iter * NUM_SUBSCRIBERS);
+    }
+}
+
+
+int main() {
+    RUN_TEST(just_works, "Just works");
+    RUN_TEST(fan_out_continuations, "Fan out continuations do not copy the value");
+    RUN_TEST(blocking_waiters, "Multiple blocking waiters");
+    RUN_TEST(error_reaches_everyone, "Error reaches every consumer");
+    RUN_TEST(shared_void, "SharedAsyncResult<void>");
+    RUN_TEST(in_does_transfer, "In transfers execution to thread pool");
+    RUN_TEST(subscribe_while_producing, "Subscribe while producing");
+    COMPLETE();
+}
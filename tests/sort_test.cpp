@@ -6,10 +6,14 @@
 #include "test_utils/timer.hpp"
 #include "test_utils/tester.hpp"
 #include "test_utils/table.hpp"
+#include "test_utils/alloc_counter.hpp"
 
 #include "async_function.hpp"
 #include "thread_pool.hpp"
 #include "task_group.hpp"
+#include "fork_join.hpp"
+#include "parallel_sort.hpp"
+#include "coro.hpp"
 
 
 namespace details {
@@ -51,6 +55,33 @@ AsyncResult<void> divideAndSort(Iterator begin, Iterator end, ThreadPool& pool)
         }).flatten();
 }
 
+template <class Iterator>
+void forkJoinSort(Iterator begin, Iterator end, ThreadPool& pool) {
+    if (std::distance(begin, end) <= 1) {
+        return;
+    }
+    auto [first, second] = split(begin, end);
+    invoke_parallel(pool,
+        [&, first = first]() { forkJoinSort(begin, first, pool); },
+        [&, second = second]() { forkJoinSort(second, end, pool); });
+}
+
+#ifdef __cpp_impl_coroutine
+
+template <class Iterator>
+Task<void> coDivideAndSort(Iterator begin, Iterator end, ThreadPool& pool) {
+    if (std::distance(begin, end) <= 1) {
+        co_return;
+    }
+    auto [first, second] = split(begin, end);
+    // The left half goes to another worker, and the right one is sorted right here
+    auto left = spawn(pool, coDivideAndSort(begin, first, pool));
+    co_await coDivideAndSort(second, end, pool);
+    co_await std::move(left);
+}
+
+#endif
+
 }  // namespace details
 
 
@@ -59,6 +90,20 @@ void parallelQuickSort(Iterator begin, Iterator end, ThreadPool& pool) {
     details::divideAndSort(begin, end, pool).wait();
 }
 
+template <class Iterator>
+void forkJoinQuickSort(Iterator begin, Iterator end, ThreadPool& pool) {
+    details::forkJoinSort(begin, end, pool);
+}
+
+#ifdef __cpp_impl_coroutine
+
+template <class Iterator>
+void coroQuickSort(Iterator begin, Iterator end, ThreadPool& pool) {
+    spawn(pool, details::coDivideAndSort(begin, end, pool)).wait();
+}
+
+#endif
+
 
 DEFINE_TEST(test_sort) {
     Timer timer;
@@ -102,7 +147,144 @@ DEFINE_TEST(test_sort) {
     table.dump();
 }
 
+DEFINE_TEST(callbacks_vs_fork_join) {
+    std::mt19937 PRG;
+    std::uniform_int_distribution<int> elt_dist(-10'000, 10'000);
+    constexpr int NUM_ITERS = 5;
+    constexpr int SIZE = 500'000;
+    constexpr int NUM_WORKERS = 4;
+
+    ThreadPool pool(NUM_WORKERS);
+    bool all_sorted = true;
+    auto run = [&](auto sort) {
+        Timer timer;
+        double sum_time = 0;
+        for (int iter = 0; iter < NUM_ITERS; ++iter) {
+            std::vector<int> my_sort(SIZE, 0);
+            for (int & elt : my_sort) {
+                elt = elt_dist(PRG);
+            }
+            std::vector stl_sort = my_sort;
+            std::sort(stl_sort.begin(), stl_sort.end());
+
+            timer.start();
+            sort(my_sort.begin(), my_sort.end(), pool);
+            sum_time += timer.elapsedMilliseconds();
+
+            all_sorted = all_sorted && my_sort == stl_sort;
+        }
+        return sum_time / NUM_ITERS;
+    };
+
+    using Iterator = std::vector<int>::iterator;
+    double callback_ms = run(parallelQuickSort<Iterator>);
+    double fork_join_ms = run(forkJoinQuickSort<Iterator>);
+    ASSERT(all_sorted);
+    LOG_INFO << "Callbacks: " << callback_ms << " ms per sort";
+    LOG_INFO << "Fork-join: " << fork_join_ms << " ms per sort";
+}
+
+DEFINE_TEST(library_sort) {
+    Timer timer;
+    StatsTable table(10, 5);
+    table.addHeader();
+
+    std::mt19937 PRG;
+    std::uniform_int_distribution<int> elt_dist(-10'000, 10'000);
+    constexpr int NUM_ITERS = 3;
+    constexpr int SIZE = 500'000;
+
+    auto run = [&](const std::string& name, auto sort) {
+        double sum_time = 0;
+        double max_time = std::numeric_limits<double>::min();
+        double min_time = std::numeric_limits<double>::max();
+        bool sorted = true;
+        for (int iter = 0; iter < NUM_ITERS; ++iter) {
+            std::vector<int> my_sort(SIZE, 0);
+            for (int & elt : my_sort) {
+                elt = elt_dist(PRG);
+            }
+            timer.start();
+            sort(my_sort.begin(), my_sort.end());
+            double ms = timer.elapsedMilliseconds();
+            sum_time += ms;
+            max_time = std::max<double>(max_time, ms);
+            min_time = std::min<double>(min_time, ms);
+            sorted = sorted && std::is_sorted(my_sort.begin(), my_sort.end());
+        }
+        table.addEntry(name, min_time, sum_time / NUM_ITERS, max_time);
+        return sorted;
+    };
+
+    using Iterator = std::vector<int>::iterator;
+    bool all_sorted = run("std::sort", [](Iterator begin, Iterator end) { std::sort(begin, end); });
+    for (int num_workers : {1, 2, 4, 8, 16, 32, 64}) {
+        ThreadPool pool(num_workers);
+        std::string workers = std::to_string(num_workers) + "W ";
+        all_sorted = run(workers + "callbacks", [&pool](Iterator begin, Iterator end) {
+            parallelQuickSort(begin, end, pool);
+        }) && all_sorted;
+        all_sorted = run(workers + "sample", [&pool](Iterator begin, Iterator end) {
+            parallel_sort(pool, begin, end, std::less<int>());
+        }) && all_sorted;
+        all_sorted = run(workers + "radix", [&pool](Iterator begin, Iterator end) {
+            parallel_sort(pool, begin, end);
+        }) && all_sorted;
+    }
+    ASSERT(all_sorted);
+    table.dump();
+}
+
+#ifdef __cpp_impl_coroutine
+
+DEFINE_TEST(callbacks_vs_coroutines) {
+    std::mt19937 PRG;
+    std::uniform_int_distribution<int> elt_dist(-10'000, 10'000);
+    constexpr int NUM_ITERS = 5;
+    constexpr int SIZE = 500'000;
+    constexpr int NUM_WORKERS = 4;
+
+    ThreadPool pool(NUM_WORKERS);
+    bool all_sorted = true;
+    auto run = [&](auto sort) {
+        Timer timer;
+        double sum_time = 0;
+        int64_t sum_allocations = 0;
+        for (int iter = 0; iter < NUM_ITERS; ++iter) {
+            std::vector<int> my_sort(SIZE, 0);
+            for (int & elt : my_sort) {
+                elt = elt_dist(PRG);
+            }
+            std::vector stl_sort = my_sort;
+            std::sort(stl_sort.begin(), stl_sort.end());
+
+            int64_t allocations = numAllocations();
+            timer.start();
+            sort(my_sort.begin(), my_sort.end(), pool);
+            sum_time += timer.elapsedMilliseconds();
+            sum_allocations += numAllocations() - allocations;
+
+            all_sorted = all_sorted && my_sort == stl_sort;
+        }
+        return std::make_pair(sum_time / NUM_ITERS, sum_allocations / NUM_ITERS);
+    };
+
+    using Iterator = std::vector<int>::iterator;
+    auto [callback_ms, callback_allocations] = run(parallelQuickSort<Iterator>);
+    auto [coro_ms, coro_allocations] = run(coroQuickSort<Iterator>);
+    ASSERT(all_sorted);
+    LOG_INFO << "Callbacks:  " << callback_ms << " ms, " << callback_allocations << " allocations per sort";
+    LOG_INFO << "Coroutines: " << coro_ms << " ms, " << coro_allocations << " allocations per sort";
+}
+
+#endif
+
 int main() {
     RUN_TEST(test_sort, "Test sort");
+    RUN_TEST(callbacks_vs_fork_join, "Callbacks vs fork-join");
+    RUN_TEST(library_sort, "Library sort");
+#ifdef __cpp_impl_coroutine
+    RUN_TEST(callbacks_vs_coroutines, "Callbacks vs coroutines");
+#endif
     COMPLETE();
 }
@@ -0,0 +1,224 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "sparse.hpp"
+
+using namespace std::chrono_literals;
+
+
+// The largest Poisson system in the benchmark, about 1 GB. Lower it for sanitizer builds.
+constexpr int64_t kMaxUnknowns = 10'000'000;
+
+
+// 5-point Laplacian on a grid x grid mesh with Dirichlet boundaries: symmetric positive definite
+CsrMatrix<double> poisson2D(int64_t grid) {
+    const int64_t size = grid * grid;
+    std::vector<int64_t> row_offsets(size + 1, 0);
+    std::vector<int32_t> col_indices;
+    std::vector<double> values;
+    col_indices.reserve(5 * size);
+    values.reserve(5 * size);
+    for (int64_t row = 0; row < grid; ++row) {
+        for (int64_t col = 0; col < grid; ++col) {
+            int64_t idx = row * grid + col;
+            auto add = [&](int64_t neighbour, double value) {
+                col_indices.push_back(static_cast<int32_t>(neighbour));
+                values.push_back(value);
+            };
+            if (row > 0) {
+                add(idx - grid, -1);
+            }
+            if (col > 0) {
+                add(idx - 1, -1);
+            }
+            add(idx, 4);
+            if (col + 1 < grid) {
+                add(idx + 1, -1);
+            }
+            if (row + 1 < grid) {
+                add(idx + grid, -1);
+            }
+            row_offsets[idx + 1] = static_cast<int64_t>(values.size());
+        }
+    }
+    return CsrMatrix<double>(size, size, std::move(row_offsets), std::move(col_indices), std::move(values));
+}
+
+std::vector<double> serialSpmv(const CsrMatrix<double>& mtx, const std::vector<double>& x) {
+    std::vector<double> y(mtx.rows(), 0);
+    for (int64_t row = 0; row < mtx.rows(); ++row) {
+        for (int64_t idx = mtx.rowOffsets()[row]; idx < mtx.rowOffsets()[row + 1]; ++idx) {
+            y[row] += mtx.values()[idx] * x[mtx.colIndices()[idx]];
+        }
+    }
+    return y;
+}
+
+double maxResidual(const CsrMatrix<double>& mtx, const std::vector<double>& x, const std::vector<double>& rhs) {
+    std::vector<double> product = serialSpmv(mtx, x);
+    double residual = 0;
+    for (size_t idx = 0; idx < rhs.size(); ++idx) {
+        residual = std::max(residual, std::abs(product[idx] - rhs[idx]));
+    }
+    return residual;
+}
+
+
+DEFINE_TEST(csr_construction) {
+    // [[1, 0, 2],
+    //  [0, 0, 0],
+    //  [3, 4, 0]]
+    auto mtx = CsrMatrix<double>::fromEntries(3, 3, {{2, 1, 4}, {0, 2, 1}, {0, 0, 1}, {2, 0, 3}, {0, 2, 1}});
+    ASSERT_EQ(mtx.nonZeros(), 4);
+    ASSERT(mtx.rowOffsets() == std::vector<int64_t>({0, 2, 2, 4}));
+    ASSERT(mtx.colIndices() == std::vector<int32_t>({0, 2, 0, 1}));
+    ASSERT(mtx.values() == std::vector<double>({1, 2, 3, 4}));
+
+    try {
+        CsrMatrix<double>(2, 2, {0, 1, 1}, {5}, {1.0});
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+    try {
+        CsrMatrix<double>(2, 2, {0, 2, 1}, {0}, {1.0});
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+    try {
+        CsrMatrix<double>::fromEntries(2, 2, {{2, 0, 1.0}});
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(spmv) {
+    ThreadPool pool(4);
+    std::mt19937 PRG;
+    std::uniform_real_distribution<double> value_dist(-1, 1);
+
+    // A few dense rows among sparse ones
+    constexpr int64_t SIZE = 50'000;
+    std::vector<SparseEntry<double> > entries;
+    for (int64_t row = 0; row < SIZE; ++row) {
+        int64_t row_size = row % 10'000 == 0 ? SIZE / 2 : 3;
+        for (int64_t idx = 0; idx < row_size; ++idx) {
+            entries.push_back({row, static_cast<int64_t>(PRG() % SIZE), value_dist(PRG)});
+        }
+    }
+    auto mtx = CsrMatrix<double>::fromEntries(SIZE, SIZE, std::move(entries));
+    std::vector<double> x(SIZE);
+    for (double& value : x) {
+        value = value_dist(PRG);
+    }
+    std::vector<double> expected = serialSpmv(mtx, x);
+    std::vector<double> y(SIZE);
+    parallel_spmv(pool, mtx, x.data(), y.data());
+    // Same order of additions within a row
+    ASSERT(y == expected);
+
+    // Blocks are balanced by nonzeros, not by rows
+    auto bounds = details::balancedRowBlocks(pool, mtx.rowOffsets());
+    ASSERT_EQ(bounds.front(), 0);
+    ASSERT_EQ(bounds.back(), SIZE);
+    for (size_t block = 0; block + 1 < bounds.size(); ++block) {
+        int64_t block_non_zeros = mtx.rowOffsets()[bounds[block + 1]] - mtx.rowOffsets()[bounds[block]];
+        ASSERT(block_non_zeros <= 2 * mtx.nonZeros() / static_cast<int64_t>(bounds.size() - 1) + SIZE / 2);
+    }
+
+    auto empty = CsrMatrix<double>::fromEntries(0, 0, {});
+    parallel_spmv(pool, empty, x.data(), y.data());
+}
+
+
+DEFINE_TEST(cg_solver) {
+    ThreadPool pool(4);
+    auto mtx = poisson2D(100);
+    std::vector<double> rhs(mtx.rows(), 1.0);
+    std::vector<double> x(mtx.rows(), 0.0);
+    CgResult result = conjugate_gradient(pool, mtx, rhs, x, 1e-10, 10'000);
+    ASSERT(result.converged);
+    ASSERT(result.iterations > 0);
+    ASSERT(maxResidual(mtx, x, rhs) < 1e-7);
+
+    // The same iterations with any number of workers
+    ThreadPool single(1);
+    std::vector<double> single_x(mtx.rows(), 0.0);
+    CgResult single_result = conjugate_gradient(single, mtx, rhs, single_x, 1e-10, 10'000);
+    ASSERT_EQ(single_result.iterations, result.iterations);
+    ASSERT(single_x == x);
+
+    // Already solved, and out of iterations
+    CgResult solved = conjugate_gradient(pool, mtx, rhs, x, 1e-6, 10'000);
+    ASSERT_EQ(solved.iterations, 0);
+    std::fill(x.begin(), x.end(), 0.0);
+    CgResult limited = conjugate_gradient(pool, mtx, rhs, x, 1e-10, 5);
+    ASSERT_EQ(limited.iterations, 5);
+    ASSERT(!limited.converged);
+
+    try {
+        std::vector<double> short_rhs(10, 1.0);
+        conjugate_gradient(pool, mtx, short_rhs, x, 1e-10, 10);
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(poisson_benchmark) {
+    constexpr int NUM_SPMV = 5;
+    constexpr int64_t NUM_CG_ITERS = 50;
+    Timer timer;
+    for (int64_t unknowns = 10'000; unknowns <= kMaxUnknowns; unknowns *= 10) {
+        auto grid = static_cast<int64_t>(std::sqrt(static_cast<double>(unknowns)));
+        auto mtx = poisson2D(grid);
+        const int64_t size = mtx.rows();
+        std::vector<double> x(size, 1.0), y(size);
+        std::vector<double> rhs(size, 1.0);
+        for (int num_workers : {1, 4}) {
+            ThreadPool pool(num_workers);
+            timer.start();
+            for (int iter = 0; iter < NUM_SPMV; ++iter) {
+                parallel_spmv(pool, mtx, x.data(), y.data());
+            }
+            double spmv_ms = timer.elapsedMilliseconds() / NUM_SPMV;
+
+            std::vector<double> solution(size, 0.0);
+            timer.start();
+            CgResult result = conjugate_gradient(pool, mtx, rhs, solution, 1e-12, NUM_CG_ITERS);
+            double cg_ms = timer.elapsedMilliseconds() / std::max<int64_t>(result.iterations, 1);
+            ASSERT(result.converged || result.iterations == NUM_CG_ITERS);
+            LOG_INFO << std::fixed << std::setprecision(2) << size << " unknowns, " << mtx.nonZeros() << " nonzeros, "
+                     << num_workers << " workers: SpMV " << spmv_ms << " ms ("
+                     << 2e-6 * static_cast<double>(mtx.nonZeros()) / spmv_ms << " GFLOP/s), CG "
+                     << cg_ms << " ms per iteration";
+        }
+    }
+}
+
+
+int main() {
+    RUN_TEST(csr_construction, "CSR construction");
+    RUN_TEST(spmv, "Parallel SpMV");
+    RUN_TEST(cg_solver, "Conjugate gradients");
+    RUN_TEST(poisson_benchmark, "Poisson benchmark");
+    COMPLETE();
+}
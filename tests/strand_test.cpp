@@ -0,0 +1,248 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include <vector>
+#include <unordered_map>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "task_group.hpp"
+#include "strand.hpp"
+
+using namespace std::chrono_literals;
+
+
+// Detects concurrent execution of the tasks that share it
+struct ExclusionChecker {
+    void operator()() {
+        if (in_flight.fetch_add(1) != 0) {
+            ok.store(false);
+        }
+        std::this_thread::yield();
+        in_flight.fetch_sub(1);
+    }
+
+    std::atomic<int>& in_flight;
+    std::atomic<bool>& ok;
+};
+
+
+DEFINE_TEST(tasks_are_serialized) {
+    ThreadPool pool(4);
+    Strand strand(pool);
+    constexpr int NUM_PRODUCERS = 4;
+    constexpr int NUM_TASKS = 1000;
+
+    std::atomic<int> in_flight { 0 };
+    std::atomic<bool> ok { true };
+    // Not synchronized other than by the strand
+    std::vector<std::vector<int> > consumed(NUM_PRODUCERS);
+
+    std::vector<std::thread> producers;
+    std::vector<AsyncResult<void> > results[NUM_PRODUCERS];
+    for (int prod = 0; prod < NUM_PRODUCERS; ++prod) {
+        producers.emplace_back([&, prod]() {
+            for (int idx = 0; idx < NUM_TASKS; ++idx) {
+                results[prod].push_back(call_async<void>(strand, [&, prod, idx]() {
+                    ExclusionChecker{in_flight, ok}();
+                    consumed[prod].push_back(idx);
+                }));
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    for (auto& prod_results : results) {
+        for (auto& result : prod_results) {
+            result.wait();
+        }
+    }
+    ASSERT(ok.load());
+    for (int prod = 0; prod < NUM_PRODUCERS; ++prod) {
+        ASSERT_EQ(consumed[prod].size(), static_cast<size_t>(NUM_TASKS));
+        // Submission order of every producer is preserved
+        for (int idx = 0; idx < NUM_TASKS; ++idx) {
+            ASSERT_EQ(consumed[prod][idx], idx);
+        }
+    }
+}
+
+
+DEFINE_TEST(in_and_make_async) {
+    ThreadPool pool(4);
+    Strand strand(pool);
+    std::atomic<int> in_flight { 0 };
+    std::atomic<bool> ok { true };
+    int counter = 0;
+
+    auto increment = make_async(strand, [&counter, &in_flight, &ok]() {
+        ExclusionChecker{in_flight, ok}();
+        return ++counter;
+    });
+    TaskGroup<int> tg;
+    for (int idx = 0; idx < 100; ++idx) {
+        tg.join(increment());
+        // Heavy part runs in parallel, and the shared part is serialized by the strand
+        tg.join(call_async<int>(pool, []() { return 0; }).in(strand).then<int>(
+            [&counter, &in_flight, &ok](int) {
+                ExclusionChecker{in_flight, ok}();
+                return ++counter;
+            }));
+    }
+    tg.all().get();
+    ASSERT(ok.load());
+    ASSERT_EQ(counter, 200);
+}
+
+
+DEFINE_TEST(strands_run_in_parallel) {
+    ThreadPool pool(2);
+    Strand strand_1(pool);
+    Strand strand_2(pool);
+    std::atomic<bool> in_1 { false }, in_2 { false };
+    // Each task waits for the other one, so they have to run concurrently
+    auto res_1 = call_async<void>(strand_1, [&in_1, &in_2]() {
+        in_1.store(true);
+        while (!in_2.load()) {
+            std::this_thread::sleep_for(1ms);
+        }
+    });
+    auto res_2 = call_async<void>(strand_2, [&in_1, &in_2]() {
+        in_2.store(true);
+        while (!in_1.load()) {
+            std::this_thread::sleep_for(1ms);
+        }
+    });
+    res_1.get();
+    res_2.get();
+}
+
+
+DEFINE_TEST(idle_strand_is_free) {
+    ThreadPool pool(1);
+    std::atomic<int> counter { 0 };
+    {
+        Strand strand(pool);
+        call_async<void>(strand, [&counter]() { counter.fetch_add(1); }).get();
+        // The only worker is not occupied by the idle strand
+        ASSERT_EQ(call_async<int>(pool, []() { return 42; }).get(), 42);
+        // Pending tasks survive the strand
+        for (int idx = 0; idx < 10; ++idx) {
+            call_async<void>(strand, [&counter]() { counter.fetch_add(1); });
+        }
+    }
+    pool.submitAfter(20ms, []() {}).get();
+    ASSERT_EQ(counter.load(), 11);
+}
+
+
+template <class Submit>
+double runVotes(int num_tasks, Submit submit) {
+    Timer timer;
+    std::vector<AsyncResult<void> > results;
+    results.reserve(num_tasks);
+    for (int idx = 0; idx < num_tasks; ++idx) {
+        results.push_back(submit());
+    }
+    for (auto& result : results) {
+        result.wait();
+    }
+    return timer.elapsedMilliseconds();
+}
+
+template <class T>
+bool isCancelled(AsyncResult<T>& result) {
+    try {
+        result.get();
+    } catch (const CancelledError&) {
+        return true;
+    } catch (...) {
+    }
+    return false;
+}
+
+DEFINE_TEST(stopped_pool_cancels_queued_tasks) {
+    ThreadPool pool(1);
+    Strand strand(pool);
+    std::atomic<bool> started { false }, released { false };
+    auto busy = call_async<int>(strand, [&started, &released]() {
+        started.store(true);
+        while (!released.load()) {
+            std::this_thread::sleep_for(1ms);
+        }
+        return 1;
+    });
+    while (!started.load()) {
+        std::this_thread::sleep_for(1ms);
+    }
+    // Queued behind the busy task
+    std::vector<AsyncResult<int>> queued;
+    for (int idx = 0; idx < 3; ++idx) {
+        queued.push_back(call_async<int>(strand, [idx]() { return idx; }));
+    }
+    std::thread stopper([&pool]() { pool.stop(); });
+    std::this_thread::sleep_for(20ms);
+    released.store(true);
+    stopper.join();
+
+    ASSERT_EQ(busy.get(), 1);
+    for (auto& result : queued) {
+        ASSERT(isCancelled(result));
+    }
+    // The strand does not stay busy forever
+    auto late = call_async<int>(strand, []() { return 42; });
+    ASSERT(isCancelled(late));
+}
+
+
+DEFINE_TEST(strand_vs_mutex_benchmark) {
+    ThreadPool pool(4);
+    constexpr int NUM_TASKS = 100'000;
+
+    std::unordered_map<std::thread::id, size_t> mutex_votes;
+    std::mutex mtx;
+    double mutex_ms = runVotes(NUM_TASKS, [&pool, &mutex_votes, &mtx]() {
+        return call_async<void>(pool, [&mutex_votes, &mtx]() {
+            std::lock_guard guard(mtx);
+            ++mutex_votes[std::this_thread::get_id()];
+        });
+    });
+
+    Strand strand(pool);
+    std::unordered_map<std::thread::id, size_t> strand_votes;
+    double strand_ms = runVotes(NUM_TASKS, [&strand, &strand_votes]() {
+        return call_async<void>(strand, [&strand_votes]() {
+            ++strand_votes[std::this_thread::get_id()];
+        });
+    });
+
+    size_t mutex_total = 0, strand_total = 0;
+    for (const auto& [id, cnt] : mutex_votes) mutex_total += cnt;
+    for (const auto& [id, cnt] : strand_votes) strand_total += cnt;
+    ASSERT_EQ(mutex_total, static_cast<size_t>(NUM_TASKS));
+    ASSERT_EQ(strand_total, static_cast<size_t>(NUM_TASKS));
+    LOG_INFO << std::fixed << std::setprecision(2) << NUM_TASKS << " tasks guarded by mutex: " << mutex_ms << " ms";
+    LOG_INFO << std::fixed << std::setprecision(2) << NUM_TASKS << " tasks in strand: " << strand_ms << " ms";
+}
+
+
+int main() {
+    RUN_TEST(tasks_are_serialized, "Tasks are serialized in submission order");
+    RUN_TEST(in_and_make_async, "Strand as target of in & make_async");
+    RUN_TEST(strands_run_in_parallel, "Different strands run in parallel");
+    RUN_TEST(idle_strand_is_free, "Idle strand occupies no worker");
+    RUN_TEST(stopped_pool_cancels_queued_tasks, "Stopped pool cancels queued tasks");
+    RUN_TEST(strand_vs_mutex_benchmark, "Strand vs mutex");
+    COMPLETE();
+}
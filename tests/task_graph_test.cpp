@@ -0,0 +1,276 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+#include "test_utils/alloc_counter.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "task_group.hpp"
+#include "task_graph.hpp"
+
+using namespace std::chrono_literals;
+
+
+// Layers of nodes, where every node depends on two nodes of the previous layer.
+// Each node records the step, at which it has run.
+struct LayeredGraph {
+    LayeredGraph(int num_layers, int width)
+        : num_layers(num_layers)
+        , width(width)
+        , steps(num_layers * width)
+    {
+        for (int layer = 0; layer < num_layers; ++layer) {
+            for (int idx = 0; idx < width; ++idx) {
+                int node = layer * width + idx;
+                graph.addTask([this, node]() { steps[node].store(clock.fetch_add(1)); });
+                if (layer > 0) {
+                    graph.addEdge(node - width, node);
+                    graph.addEdge((layer - 1) * width + (idx + 1) % width, node);
+                }
+            }
+        }
+    }
+
+    bool ranInOrder() const {
+        for (int layer = 1; layer < num_layers; ++layer) {
+            for (int idx = 0; idx < width; ++idx) {
+                int node = layer * width + idx;
+                int64_t step = steps[node].load();
+                if (step <= steps[node - width].load() || step <= steps[(layer - 1) * width + (idx + 1) % width].load()) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    int num_layers;
+    int width;
+    TaskGraph graph;
+    std::atomic<int64_t> clock { 0 };
+    std::vector<std::atomic<int64_t> > steps;
+};
+
+
+DEFINE_TEST(graph_just_works) {
+    ThreadPool pool(4);
+    LayeredGraph layered(10, 8);
+    ASSERT_EQ(layered.graph.size(), 80u);
+    for (int run = 0; run < 100; ++run) {
+        layered.graph.run(pool);
+        ASSERT(layered.ranInOrder());
+        // Every node once per run
+        ASSERT_EQ(layered.clock.load(), 80 * (run + 1));
+    }
+
+    // A diamond, run from inside the pool and without workers at all
+    TaskGraph diamond;
+    std::vector<int> trace;
+    std::atomic<int> middle = 0;
+    auto top = diamond.addTask([&]() { trace.push_back(1); });
+    auto left = diamond.addTask([&]() { ++middle; });
+    auto right = diamond.addTask([&]() { ++middle; });
+    auto bottom = diamond.addTask([&]() { trace.push_back(middle.load()); });
+    diamond.addEdge(top, left);
+    diamond.addEdge(top, right);
+    diamond.addEdge(left, bottom);
+    diamond.addEdge(right, bottom);
+    call_async<void>(pool, [&]() { diamond.run(pool); }).get();
+    ThreadPool empty(0);
+    middle = 0;
+    diamond.run(empty);
+    ASSERT(trace == std::vector<int>({1, 2, 1, 2}));
+
+    TaskGraph nothing;
+    nothing.run(pool);
+}
+
+
+DEFINE_TEST(conditions_and_subgraphs) {
+    ThreadPool pool(4);
+    // branch 0 -> then_node -> after_then, branch 1 -> else_node
+    TaskGraph graph;
+    size_t choice = 0;
+    std::atomic<int> then_runs = 0, after_then_runs = 0, else_runs = 0, joined_runs = 0;
+    auto branch = graph.addCondition([&choice]() { return choice; });
+    auto then_node = graph.addTask([&]() { ++then_runs; });
+    auto else_node = graph.addTask([&]() { ++else_runs; });
+    auto after_then = graph.addTask([&]() { ++after_then_runs; });
+    // Depends on both branches, so it is always skipped
+    auto joined = graph.addTask([&]() { ++joined_runs; });
+    graph.addEdge(branch, then_node);
+    graph.addEdge(branch, else_node);
+    graph.addEdge(then_node, after_then);
+    graph.addEdge(then_node, joined);
+    graph.addEdge(else_node, joined);
+
+    graph.run(pool);
+    choice = 1;
+    graph.run(pool);
+    // Not a successor of the condition
+    choice = 2;
+    try {
+        graph.run(pool);
+        FAIL();
+    } catch (const std::out_of_range&) {
+        // pass
+    }
+    ASSERT_EQ(then_runs.load(), 1);
+    ASSERT_EQ(after_then_runs.load(), 1);
+    ASSERT_EQ(else_runs.load(), 1);
+    ASSERT_EQ(joined_runs.load(), 0);
+
+    // A subgraph runs as a whole between its neighbours
+    LayeredGraph inner(4, 4);
+    TaskGraph outer;
+    int64_t before_clock = -1, after_clock = -1;
+    auto before = outer.addTask([&]() { before_clock = inner.clock.load(); });
+    auto sub = outer.addSubgraph(inner.graph);
+    auto after = outer.addTask([&]() { after_clock = inner.clock.load(); });
+    outer.addEdge(before, sub);
+    outer.addEdge(sub, after);
+    for (int run = 0; run < 10; ++run) {
+        outer.run(pool);
+        ASSERT_EQ(before_clock, 16 * run);
+        ASSERT_EQ(after_clock, 16 * (run + 1));
+        ASSERT(inner.ranInOrder());
+    }
+}
+
+
+DEFINE_TEST(errors) {
+    ThreadPool pool(2);
+    TaskGraph graph;
+    std::atomic<int> after_runs = 0;
+    auto first = graph.addTask([]() { throw std::runtime_error("Node failed"); });
+    auto after = graph.addTask([&after_runs]() { ++after_runs; });
+    graph.addEdge(first, after);
+    for (int run = 0; run < 3; ++run) {
+        try {
+            graph.run(pool);
+            FAIL();
+        } catch (const std::runtime_error& err) {
+            ASSERT_EQ(std::string(err.what()), "Node failed");
+        }
+    }
+    ASSERT_EQ(after_runs.load(), 0);
+
+    try {
+        graph.addEdge(first, 2);
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+    try {
+        graph.addSubgraph(graph);
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+
+    TaskGraph cyclic;
+    auto a = cyclic.addTask([]() {});
+    auto b = cyclic.addTask([]() {});
+    auto c = cyclic.addTask([]() {});
+    cyclic.addEdge(a, b);
+    cyclic.addEdge(b, c);
+    cyclic.addEdge(c, b);
+    try {
+        cyclic.run(pool);
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+
+    // The same graph twice at a time
+    TaskGraph self_running;
+    self_running.addTask([&self_running, &pool]() { self_running.run(pool); });
+    try {
+        self_running.run(pool);
+        FAIL();
+    } catch (const std::logic_error&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(repeated_runs_do_not_allocate) {
+    ThreadPool pool(2);
+    LayeredGraph layered(8, 8);
+    LayeredGraph inner(2, 2);
+    layered.graph.addEdge(layered.graph.addSubgraph(inner.graph), 0);
+    // The first run prepares the graph
+    layered.graph.run(pool);
+
+    int64_t before = numAllocations();
+    for (int run = 0; run < 100; ++run) {
+        layered.graph.run(pool);
+    }
+    int64_t allocated = numAllocations() - before;
+    ASSERT_EQ(allocated, 0);
+    ASSERT(layered.ranInOrder());
+}
+
+
+DEFINE_TEST(graph_vs_task_groups_benchmark) {
+    constexpr int NUM_RUNS = 1000;
+    constexpr int NUM_LAYERS = 8;
+    Timer timer;
+    for (int width : {4, 16, 64}) {
+        for (int num_workers : {1, 4}) {
+            ThreadPool pool(num_workers);
+            LayeredGraph layered(NUM_LAYERS, width);
+            int64_t graph_allocs = numAllocations();
+            timer.start();
+            for (int run = 0; run < NUM_RUNS; ++run) {
+                layered.graph.run(pool);
+            }
+            double graph_us = timer.elapsedMilliseconds() * 1000 / NUM_RUNS;
+            graph_allocs = numAllocations() - graph_allocs;
+
+            // The same work level by level, with the groups and their contracts built on every run
+            std::atomic<int64_t> clock = 0;
+            std::vector<int64_t> steps(NUM_LAYERS * width);
+            auto async_node = make_async(pool, [&clock, &steps](int node) { steps[node] = clock.fetch_add(1); });
+            int64_t group_allocs = numAllocations();
+            timer.start();
+            for (int run = 0; run < NUM_RUNS; ++run) {
+                for (int layer = 0; layer < NUM_LAYERS; ++layer) {
+                    TaskGroup<void> group;
+                    for (int idx = 0; idx < width; ++idx) {
+                        group.join(async_node(layer * width + idx));
+                    }
+                    group.all().get();
+                }
+            }
+            double group_us = timer.elapsedMilliseconds() * 1000 / NUM_RUNS;
+            group_allocs = numAllocations() - group_allocs;
+            LOG_INFO << std::fixed << std::setprecision(2) << NUM_LAYERS << " x " << width << " nodes, "
+                     << num_workers << " workers, per run: TaskGraph " << graph_us << " us, "
+                     << graph_allocs / NUM_RUNS << " allocations; TaskGroup per layer " << group_us << " us, "
+                     << group_allocs / NUM_RUNS << " allocations";
+        }
+    }
+}
+
+
+int main() {
+    RUN_TEST(graph_just_works, "TaskGraph just works");
+    RUN_TEST(conditions_and_subgraphs, "Conditions and subgraphs");
+    RUN_TEST(errors, "Errors");
+    RUN_TEST(repeated_runs_do_not_allocate, "Repeated runs do not allocate");
+    RUN_TEST(graph_vs_task_groups_benchmark, "TaskGraph vs TaskGroup benchmark");
+    COMPLETE();
+}
@@ -4,6 +4,10 @@
 #include <thread>
 #include <cmath>
 #include <cstdint>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
 
 #include <vector>
 #include <map>
@@ -78,6 +82,98 @@ DEFINE_TEST(first_doesnt_wait_all) {
 }
 
 
+DEFINE_TEST(at_least_just_works) {
+    ThreadPool pool(6);
+    TaskGroup<int> tg;
+    // The slowest members are held until the quorum is reached
+    std::atomic<bool> released = false;
+    auto sleepy_async = make_async(pool, [&released](int val) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10 * val));
+        while (val >= 3 && !released.load()) {
+            std::this_thread::sleep_for(1ms);
+        }
+        return val;
+    });
+    // Join in the reversed order, so that the quorum does not follow join order
+    for (int val = 5; val >= 0; --val) {
+        tg.join(sleepy_async(val));
+    }
+    auto results = tg.atLeast(3).get();
+    released.store(true);
+    // Values are ordered by completion and the slowest members are not awaited
+    std::vector<int> expected = {0, 1, 2};
+    ASSERT_EQ(results, expected);
+
+    // Trivial quorum: resolves at once with no values
+    tg.join(sleepy_async(1));
+    ASSERT(tg.atLeast(0).get().empty());
+    try {
+        tg.join(sleepy_async(1));
+        tg.atLeast(-1);
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+    // The group is still usable
+    ASSERT_EQ(tg.atLeast(1).get(), std::vector<int>({1}));
+}
+
+
+DEFINE_TEST(at_least_fails_fast) {
+    ThreadPool pool(4);
+    TaskGroup<int> tg;
+    // Healthy replicas answer only after the result is known
+    std::atomic<bool> released = false;
+    auto hazardous_async = make_async(pool, [&released](int val) {
+        if (val < 0) {
+            throw std::runtime_error("Replica is down");
+        }
+        while (!released.load()) {
+            std::this_thread::sleep_for(1ms);
+        }
+        return val;
+    });
+    tg.join(hazardous_async(1));
+    tg.join(hazardous_async(-1));
+    tg.join(hazardous_async(2));
+    tg.join(hazardous_async(-2));
+    auto res = tg.atLeast(3);
+    // Two errors out of four make a quorum of three unreachable
+    try {
+        res.get();
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(err.what(), std::string("Replica is down"));
+    }
+    released.store(true);
+
+    // Quorum exceeds the group size
+    tg.join(AsyncResult<int>::instant(42));
+    try {
+        tg.atLeast(2).get();
+        FAIL();
+    } catch (const std::runtime_error&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(at_least_void) {
+    ThreadPool pool(4);
+    TaskGroup<void> tg;
+    std::atomic<int> state { 0 };
+    auto increment = make_async(pool, [&state]() { state.fetch_add(1); });
+    constexpr int NUM_ITERS = 100;
+    for (int iter = 0; iter < NUM_ITERS; ++iter) {
+        for (int member = 0; member < 5; ++member) {
+            tg.join(increment());
+        }
+        tg.atLeast(3).get();
+        ASSERT(state.load() >= 3 * (iter + 1));
+    }
+}
+
+
 struct WorstType {
     WorstType() = delete;
     explicit WorstType(int val) : val(val) {    }
@@ -364,6 +460,110 @@ DEFINE_TEST(first_all) {
 }
 
 
+DEFINE_TEST(hedge_just_works) {
+    std::atomic<int> num_calls { 0 };
+    std::atomic<bool> released { false };
+    std::atomic<bool> third_stopped { false };
+    ThreadPool pool(4);
+    auto flaky_async = make_async(pool, [&](int val) {
+        int call = num_calls.fetch_add(1);
+        if (call == 0) {
+            // Only the very first call is slow, until the hedged result has arrived
+            while (!released) {
+                std::this_thread::yield();
+            }
+        } else if (call == 2) {
+            // A third attempt, if issued before the result, is stopped once the second one wins
+            while (!StopToken::current().stopRequested()) {
+                std::this_thread::yield();
+            }
+            third_stopped = true;
+        }
+        return val;
+    });
+    ASSERT_EQ(hedge(flaky_async, 20ms, 3, 42).get(), 42);
+    released = true;
+    // Otherwise the third attempt is skipped by the timer, since the group token is stopped
+    ASSERT(num_calls.load() <= 3);
+    while (num_calls.load() == 3 && !third_stopped) {
+        std::this_thread::yield();
+    }
+
+    // All attempts fail
+    auto failing_async = make_async(pool, []() -> int { throw std::runtime_error("Oops"); });
+    try {
+        failing_async.hedge(1ms, 3).get();
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(err.what(), std::string("Oops"));
+    }
+}
+
+
+DEFINE_TEST(hedge_adapts_delay) {
+    std::atomic<int> num_calls { 0 };
+    std::atomic<bool> released { false };
+    ThreadPool pool(4);
+    auto flaky_async = make_async(pool, [&num_calls, &released]() {
+        if (num_calls.fetch_add(1) == 100) {
+            // Held until the hedged result has arrived
+            while (!released) {
+                std::this_thread::yield();
+            }
+        }
+        return 1;
+    });
+    // Warm up latency statistics, which only hedged calls feed
+    for (int idx = 0; idx < 100; ++idx) {
+        flaky_async.hedge(10s, 1).get();
+    }
+    // The slow call never returns by itself, and the fallback delay is far beyond the timeout:
+    // only a backup issued after the observed latencies resolves the call in time
+    auto hedged = hedge(flaky_async, HedgeDelay::percentile(90, 1h), 2).withTimeout(pool, 1min);
+    try {
+        ASSERT_EQ(hedged.get(), 1);
+    } catch (const TimeoutError&) {
+        released = true;
+        FAIL();
+    }
+    released = true;
+    ASSERT_EQ(num_calls.load(), 102);
+}
+
+
+template <class Call>
+std::vector<double> measureLatencies(int num_requests, Call call) {
+    std::vector<double> latencies;
+    for (int idx = 0; idx < num_requests; ++idx) {
+        Timer timer;
+        call();
+        latencies.push_back(timer.elapsedMilliseconds());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    return latencies;
+}
+
+DEFINE_TEST(hedge_tail_latency_benchmark) {
+    ThreadPool pool(4);
+    std::atomic<int> num_calls { 0 };
+    // Every 20th call is 50x slower than usual
+    auto service_async = make_async(pool, [&num_calls]() {
+        bool slow = num_calls.fetch_add(1) % 20 == 0;
+        std::this_thread::sleep_for(slow ? 50ms : 1ms);
+        return 1;
+    });
+    constexpr int NUM_REQUESTS = 400;
+    auto plain = measureLatencies(NUM_REQUESTS, [&service_async]() { service_async().get(); });
+    auto hedged = measureLatencies(NUM_REQUESTS, [&service_async]() {
+        service_async.hedge(HedgeDelay::percentile(90, 10ms), 2).get();
+    });
+    auto p50 = [](const std::vector<double>& lat) { return lat[lat.size() / 2]; };
+    auto p99 = [](const std::vector<double>& lat) { return lat[lat.size() * 99 / 100]; };
+    LOG_INFO << std::fixed << std::setprecision(2) << "Plain calls:  p50 " << p50(plain) << " ms, p99 " << p99(plain) << " ms";
+    LOG_INFO << std::fixed << std::setprecision(2) << "Hedged calls: p50 " << p50(hedged) << " ms, p99 " << p99(hedged) << " ms";
+}
+
+
 template <size_t num_workers, size_t jobMs>
 DEFINE_TEST(perfect_parallelization) {
     ThreadPool pool(num_workers);
@@ -393,6 +593,9 @@ int main() {
     RUN_TEST(all_just_works, "TaskGroup::all just works");
     RUN_TEST(first_just_works, "TaskGroup::first just works");
     RUN_TEST(first_doesnt_wait_all, "TaskGroup::first doesnt wait for all tasks to finish");
+    RUN_TEST(at_least_just_works, "TaskGroup::atLeast just works");
+    RUN_TEST(at_least_fails_fast, "TaskGroup::atLeast fails fast");
+    RUN_TEST(at_least_void, "TaskGroup<void>::atLeast");
     RUN_TEST(worst_type, "TaskGroup with moveonly & non-default-constructible type")
     RUN_TEST(void_group_all, "TaskGroup<void> just works");
     RUN_TEST(continuation, "Continuation");
@@ -403,6 +606,9 @@ int main() {
     RUN_TEST(prod_cons_pools, "Producer and consumer pools in single TaskGroup");
     RUN_TEST(all_first, "Wait for all tasks, where each is TaskGroup::first");
     RUN_TEST(first_all, "Wait for first task, where each is TaskGroup::all");
+    RUN_TEST(hedge_just_works, "Hedged call just works");
+    RUN_TEST(hedge_adapts_delay, "Hedged call adapts its delay");
+    RUN_TEST(hedge_tail_latency_benchmark, "Tail latency of hedged calls");
     RUN_TEST((perfect_parallelization<2, 10>), "Parallelization 2; 10ms");
     RUN_TEST((perfect_parallelization<8, 10>), "Parallelization 8; 10ms");
     RUN_TEST((perfect_parallelization<2, 50>), "Parallelization 2; 50ms");
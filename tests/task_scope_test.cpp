@@ -0,0 +1,212 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <string>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "task_group.hpp"
+#include "task_scope.hpp"
+
+using namespace std::chrono_literals;
+
+
+// Visits a complete binary tree, spawning a task per node
+void visitTree(TaskScope scope, int depth, std::atomic<int64_t>& num_visited) {
+    num_visited.fetch_add(1, std::memory_order_relaxed);
+    if (depth == 0) {
+        return;
+    }
+    for (int child = 0; child < 2; ++child) {
+        scope.spawn([scope, depth, &num_visited]() { visitTree(scope, depth - 1, num_visited); });
+    }
+}
+
+// The same with a TaskGroup per level
+AsyncResult<void> visitTreeViaGroups(ThreadPool& pool, int depth, std::atomic<int64_t>& num_visited) {
+    return call_async<AsyncResult<void>>(pool, [&pool, depth, &num_visited]() {
+        num_visited.fetch_add(1, std::memory_order_relaxed);
+        if (depth == 0) {
+            return AsyncResult<void>::instant();
+        }
+        TaskGroup<void> children;
+        children.join(visitTreeViaGroups(pool, depth - 1, num_visited));
+        children.join(visitTreeViaGroups(pool, depth - 1, num_visited));
+        return children.all();
+    }).flatten();
+}
+
+
+DEFINE_TEST(scope_just_works) {
+    ThreadPool pool(4);
+    constexpr int DEPTH = 12;
+    std::atomic<int64_t> num_visited { 0 };
+    TaskScope scope(pool);
+    scope.spawn([scope, &num_visited]() { visitTree(scope, DEPTH, num_visited); });
+    scope.join().get();
+    ASSERT_EQ(num_visited.load(), (int64_t(1) << (DEPTH + 1)) - 1);
+
+    // Nothing to wait for
+    TaskScope empty(pool);
+    empty.join().get();
+}
+
+
+DEFINE_TEST(spawn_after_join) {
+    ThreadPool pool(2);
+    std::atomic<bool> released { false };
+    std::atomic<int> num_executed { 0 };
+    TaskScope scope(pool);
+    scope.spawn([&released]() {
+        while (!released.load()) {
+            std::this_thread::sleep_for(1ms);
+        }
+    });
+    auto joined = scope.join();
+    // Still running, so spawning is fine
+    scope.spawn([&num_executed]() { num_executed.fetch_add(1); });
+    released.store(true);
+    joined.get();
+    ASSERT_EQ(num_executed.load(), 1);
+
+    try {
+        scope.spawn([]() {});
+        FAIL();
+    } catch (const std::logic_error&) {
+        // pass
+    }
+    try {
+        scope.join();
+        FAIL();
+    } catch (const std::logic_error&) {
+        // pass
+    }
+}
+
+
+// Throws on copy
+struct UncopyableTask {
+    UncopyableTask() = default;
+    UncopyableTask(const UncopyableTask&) { throw std::runtime_error("Copy failed"); }
+    UncopyableTask(UncopyableTask&&) = default;
+
+    void operator()() {   }
+};
+
+DEFINE_TEST(throwing_spawn) {
+    ThreadPool pool(2);
+    std::atomic<int> num_executed { 0 };
+    TaskScope scope(pool);
+    UncopyableTask uncopyable;
+    try {
+        scope.spawn(uncopyable);
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(std::string(err.what()), "Copy failed");
+    }
+    // Neither counted as pending, nor failing the scope
+    scope.spawn([&num_executed]() { num_executed.fetch_add(1); });
+    scope.spawn(UncopyableTask());
+    scope.join().get();
+    ASSERT_EQ(num_executed.load(), 1);
+}
+
+
+DEFINE_TEST(first_error) {
+    ThreadPool pool(1);
+    std::atomic<int> num_executed { 0 };
+    TaskScope scope(pool);
+    scope.spawn([scope]() mutable {
+        scope.spawn([]() {
+            std::this_thread::sleep_for(10ms);
+            throw std::runtime_error("Second failure");
+        });
+        throw std::runtime_error("First failure");
+    });
+    // Queued behind the failing task, so skipped
+    for (int idx = 0; idx < 10; ++idx) {
+        scope.spawn([&num_executed]() { num_executed.fetch_add(1); });
+    }
+    try {
+        scope.join().get();
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(std::string(err.what()), "First failure");
+    }
+    ASSERT_EQ(num_executed.load(), 0);
+    ASSERT(scope.token().stopRequested());
+}
+
+
+DEFINE_TEST(parent_token) {
+    ThreadPool pool(1);
+    StopSource parent;
+    TaskScope scope(pool, parent.token());
+    std::atomic<bool> started { false };
+    std::atomic<bool> polled { false };
+    scope.spawn([&started, &polled]() {
+        started.store(true);
+        while (!StopToken::current().stopRequested()) {
+            std::this_thread::sleep_for(1ms);
+        }
+        polled.store(true);
+    });
+    scope.spawn([]() {});
+    while (!started.load()) {
+        std::this_thread::sleep_for(1ms);
+    }
+    // The running task polls the token, and the queued one is skipped
+    parent.requestStop();
+    try {
+        scope.join().get();
+        FAIL();
+    } catch (const CancelledError&) {
+        // pass
+    }
+    ASSERT(polled.load());
+}
+
+
+DEFINE_TEST(scope_vs_groups_benchmark) {
+    ThreadPool pool(4);
+    constexpr int DEPTH = 15;
+    constexpr int64_t NUM_NODES = (int64_t(1) << (DEPTH + 1)) - 1;
+    Timer timer;
+
+    std::atomic<int64_t> scope_visited { 0 };
+    timer.start();
+    TaskScope scope(pool);
+    scope.spawn([scope, &scope_visited]() { visitTree(scope, DEPTH, scope_visited); });
+    scope.join().get();
+    double scope_ms = timer.elapsedMilliseconds();
+
+    std::atomic<int64_t> groups_visited { 0 };
+    timer.start();
+    visitTreeViaGroups(pool, DEPTH, groups_visited).get();
+    double groups_ms = timer.elapsedMilliseconds();
+
+    ASSERT_EQ(scope_visited.load(), NUM_NODES);
+    ASSERT_EQ(groups_visited.load(), NUM_NODES);
+    LOG_INFO << std::fixed << std::setprecision(2) << NUM_NODES << " nodes, TaskScope:          " << scope_ms << " ms";
+    LOG_INFO << std::fixed << std::setprecision(2) << NUM_NODES << " nodes, TaskGroup per level: " << groups_ms << " ms";
+}
+
+
+int main() {
+    RUN_TEST(scope_just_works, "TaskScope just works");
+    RUN_TEST(spawn_after_join, "Spawn after join");
+    RUN_TEST(throwing_spawn, "Throwing spawn");
+    RUN_TEST(first_error, "First error is propagated");
+    RUN_TEST(parent_token, "Parent token");
+    RUN_TEST(scope_vs_groups_benchmark, "TaskScope vs TaskGroup per level");
+    COMPLETE();
+}
@@ -0,0 +1,268 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "task_group.hpp"
+#include "parallel_for.hpp"
+#include "team.hpp"
+
+using namespace std::chrono_literals;
+
+
+// One step of 1D smoothing, from cur to next, for the indices in [begin, end)
+void smoothRange(const std::vector<double>& cur, std::vector<double>& next, int64_t begin, int64_t end) {
+    const int64_t size = static_cast<int64_t>(cur.size());
+    for (int64_t idx = begin; idx < end; ++idx) {
+        double left = idx > 0 ? cur[idx - 1] : 0.0;
+        double right = idx + 1 < size ? cur[idx + 1] : 0.0;
+        next[idx] = (left + cur[idx] + right) / 3;
+    }
+}
+
+std::vector<double> initialValues(int64_t size) {
+    std::vector<double> values(size);
+    for (int64_t idx = 0; idx < size; ++idx) {
+        values[idx] = static_cast<double>(idx % 17);
+    }
+    return values;
+}
+
+std::vector<double> serialSmooth(int64_t size, int num_iters) {
+    std::vector<double> cur = initialValues(size), next(size);
+    for (int iter = 0; iter < num_iters; ++iter) {
+        smoothRange(cur, next, 0, size);
+        cur.swap(next);
+    }
+    return cur;
+}
+
+// Double buffering needs a single barrier per iteration: nobody writes a buffer again
+// before everybody has passed the barrier after reading it.
+std::vector<double> teamSmooth(ThreadPool& pool, int num_members, int64_t size, int num_iters) {
+    std::vector<double> cur = initialValues(size), next(size);
+    run_team(pool, num_members, [&](TeamMember& member) {
+        auto [begin, end] = member.range(0, size);
+        std::vector<double>* from = &cur;
+        std::vector<double>* to = &next;
+        for (int iter = 0; iter < num_iters; ++iter) {
+            smoothRange(*from, *to, begin, end);
+            member.barrier();
+            std::swap(from, to);
+        }
+    });
+    return num_iters % 2 == 0 ? cur : next;
+}
+
+// A task per index and a TaskGroup round trip per iteration, as resolveViaIterations does
+std::vector<double> taskGroupSmooth(ThreadPool& pool, int64_t size, int num_iters) {
+    std::vector<double> cur = initialValues(size), next(size);
+    auto async_step = make_async(pool, [&cur, &next](int64_t idx) { smoothRange(cur, next, idx, idx + 1); });
+    for (int iter = 0; iter < num_iters; ++iter) {
+        TaskGroup<void> step;
+        for (int64_t idx = 0; idx < size; ++idx) {
+            step.join(async_step(idx));
+        }
+        step.all().get();
+        cur.swap(next);
+    }
+    return cur;
+}
+
+std::vector<double> parallelForSmooth(ThreadPool& pool, int64_t size, int num_iters) {
+    std::vector<double> cur = initialValues(size), next(size);
+    for (int iter = 0; iter < num_iters; ++iter) {
+        parallel_for(pool, 0, size, [&](int64_t begin, int64_t end) { smoothRange(cur, next, begin, end); },
+                     StaticPartitioner(1));
+        cur.swap(next);
+    }
+    return cur;
+}
+
+
+DEFINE_TEST(team_just_works) {
+    ThreadPool pool(4);
+    for (int num_members : {1, 2, 3, 5}) {
+        constexpr int NUM_ITERS = 200;
+        std::vector<int> slots(num_members, -1);
+        std::vector<int> ranks(num_members, 0);
+        std::atomic<bool> consistent = true;
+        run_team(pool, num_members, [&](TeamMember& member) {
+            ASSERT_EQ(member.size(), num_members);
+            ++ranks[member.rank()];
+            for (int iter = 0; iter < NUM_ITERS; ++iter) {
+                slots[member.rank()] = iter;
+                member.barrier();
+                // Everybody has written the slot of this iteration
+                for (int slot : slots) {
+                    if (slot != iter) {
+                        consistent = false;
+                    }
+                }
+                member.barrier();
+            }
+        });
+        ASSERT(consistent);
+        ASSERT(ranks == std::vector<int>(num_members, 1));
+    }
+
+    // The same results as the serial loop
+    ASSERT(teamSmooth(pool, 5, 10'000, 100) == serialSmooth(10'000, 100));
+    ASSERT(teamSmooth(pool, 4, 3, 7) == serialSmooth(3, 7));
+
+    // A member per available worker, also from inside the pool
+    std::atomic<int> outside = 0;
+    run_team(pool, [&](TeamMember&) { ++outside; });
+    ASSERT_EQ(outside.load(), 5);
+    auto nested = call_async<int>(pool, [&pool]() {
+        std::atomic<int> inside = 0;
+        run_team(pool, [&](TeamMember& member) {
+            member.barrier();
+            ++inside;
+        });
+        return inside.load();
+    });
+    ASSERT_EQ(nested.get(), 4);
+}
+
+
+DEFINE_TEST(member_range) {
+    ThreadPool pool(4);
+    for (int64_t size : {0, 1, 3, 4, 10, 1001}) {
+        std::vector<std::pair<int64_t, int64_t> > ranges(5);
+        run_team(pool, 5, [&](TeamMember& member) { ranges[member.rank()] = member.range(10, 10 + size); });
+        ASSERT_EQ(ranges.front().first, 10);
+        ASSERT_EQ(ranges.back().second, 10 + size);
+        for (size_t rank = 0; rank + 1 < ranges.size(); ++rank) {
+            ASSERT_EQ(ranges[rank].second, ranges[rank + 1].first);
+            ASSERT(ranges[rank].second - ranges[rank].first <= size / 5 + 1);
+        }
+    }
+}
+
+
+DEFINE_TEST(errors) {
+    ThreadPool pool(3);
+    try {
+        run_team(pool, 5, [](TeamMember&) {   });
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+    try {
+        run_team(pool, 0, [](TeamMember&) {   });
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+
+    // The others are released from the barrier, the first error is rethrown
+    std::atomic<int> finished = 0;
+    try {
+        run_team(pool, 4, [&finished](TeamMember& member) {
+            for (int iter = 0; iter < 100; ++iter) {
+                if (iter == 50 && member.rank() == 2) {
+                    throw std::runtime_error("Member failed");
+                }
+                member.barrier();
+            }
+            ++finished;
+        });
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(std::string(err.what()), "Member failed");
+    }
+    ASSERT_EQ(finished.load(), 0);
+
+    // The pool is fine afterwards
+    ASSERT(teamSmooth(pool, 4, 1000, 10) == serialSmooth(1000, 10));
+}
+
+
+DEFINE_TEST(stopped_pool) {
+    // A team started by a task, whose other member is still queued, when the pool stops
+    ThreadPool pool(2);
+    std::atomic<bool> released = false;
+    std::atomic<bool> entered = false;
+    auto busy = call_async<void>(pool, [&released]() {
+        while (!released) {
+            std::this_thread::yield();
+        }
+    });
+    auto team = call_async<void>(pool, [&pool, &entered]() {
+        entered = true;
+        run_team(pool, 2, [](TeamMember& member) { member.barrier(); });
+    });
+    while (!entered) {
+        std::this_thread::yield();
+    }
+    std::thread stopper([&pool]() { pool.stop(); });
+    try {
+        team.get();
+        FAIL();
+    } catch (const CancelledError&) {
+        // pass
+    }
+    released = true;
+    stopper.join();
+
+    // No workers to run the members anymore
+    try {
+        run_team(pool, 2, [](TeamMember&) {   });
+        FAIL();
+    } catch (const std::invalid_argument&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(iteration_overhead_benchmark) {
+    constexpr int NUM_ITERS = 1000;
+    Timer timer;
+    for (int64_t size : {64, 1024, 16'384}) {
+        timer.start();
+        std::vector<double> expected = serialSmooth(size, NUM_ITERS);
+        double serial_us = timer.elapsedMilliseconds() * 1000 / NUM_ITERS;
+        for (int num_workers : {1, 2, 4}) {
+            ThreadPool pool(num_workers);
+            // A task per index is slow enough to measure a tenth of the iterations
+            constexpr int TASK_GROUP_ITERS = NUM_ITERS / 10;
+            timer.start();
+            taskGroupSmooth(pool, size, TASK_GROUP_ITERS);
+            double task_group_us = timer.elapsedMilliseconds() * 1000 / TASK_GROUP_ITERS;
+            timer.start();
+            ASSERT(parallelForSmooth(pool, size, NUM_ITERS) == expected);
+            double parallel_for_us = timer.elapsedMilliseconds() * 1000 / NUM_ITERS;
+            timer.start();
+            ASSERT(teamSmooth(pool, num_workers + 1, size, NUM_ITERS) == expected);
+            double team_us = timer.elapsedMilliseconds() * 1000 / NUM_ITERS;
+            LOG_INFO << std::fixed << std::setprecision(2) << size << " elements, " << num_workers
+                     << " workers, us per iteration: serial " << serial_us << ", TaskGroup " << task_group_us
+                     << ", parallel_for " << parallel_for_us << ", team " << team_us;
+        }
+    }
+}
+
+
+int main() {
+    RUN_TEST(team_just_works, "Team just works");
+    RUN_TEST(member_range, "Member range");
+    RUN_TEST(errors, "Errors");
+    RUN_TEST(stopped_pool, "Stopped pool");
+    RUN_TEST(iteration_overhead_benchmark, "Iteration overhead benchmark");
+    COMPLETE();
+}
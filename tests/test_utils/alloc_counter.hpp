@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// Number of global operator new calls so far.
+// Available to the tests, that link alloc_counter.cpp, which replaces the global operator new.
+int64_t numAllocations();
@@ -79,6 +79,10 @@ public:
     int64_t rows() const { return n_rows_; }
     int64_t cols() const { return n_cols_; }
 
+    // Row-major storage without bounds checks, e.g. for GEMM
+    T* data() { return data_.data(); }
+    const T* data() const { return data_.data(); }
+
 private:
     int64_t n_rows_;
     int64_t n_cols_;
@@ -17,6 +17,8 @@
 
 #include "thread_pool.hpp"
 #include "async_function.hpp"
+#include "task_group.hpp"
+#include "worker_local.hpp"
 
 using namespace std::chrono_literals;
 
@@ -430,6 +432,110 @@ DEFINE_TEST(map_reduce) {
 }
 
 
+DEFINE_TEST(wait_for_is_bounded) {
+    ThreadPool pool(1);
+    auto fut = call_async<int>(pool, []() {
+        std::this_thread::sleep_for(100ms);
+        return 42;
+    });
+    Timer timer;
+    ASSERT(!fut.wait_for(20ms));
+    double elapsedMs = timer.elapsedMilliseconds();
+    ASSERT(elapsedMs >= 20 && elapsedMs < 60);
+    ASSERT(!fut.wait_until(std::chrono::steady_clock::now() + 10ms));
+    // The result is still valid after a timed out wait
+    ASSERT(fut.wait_for(1s));
+    ASSERT_EQ(fut.get(), 42);
+}
+
+
+DEFINE_TEST(with_timeout) {
+    ThreadPool pool(2);
+    // Timer fires first
+    Timer timer;
+    auto slow = call_async<int>(pool, []() {
+        std::this_thread::sleep_for(100ms);
+        return 1;
+    }).withTimeout(20ms);
+    try {
+        slow.get();
+        FAIL();
+    } catch (const TimeoutError&) {
+        // pass
+    }
+    double elapsedMs = timer.elapsedMilliseconds();
+    ASSERT(elapsedMs >= 20 && elapsedMs < 60);
+
+    // Result comes first
+    auto fast = call_async<int>(pool, []() { return 2; }).withTimeout(1s);
+    ASSERT_EQ(fast.get(), 2);
+
+    // Errors are delivered as is
+    auto failed = call_async<void>(pool, []() { throw std::runtime_error("Oops"); }).withTimeout(1s);
+    try {
+        failed.get();
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(err.what(), std::string("Oops"));
+    }
+
+    // Results of a group have no pool of their own, so the timer pool is given explicitly
+    TaskGroup<int> tg;
+    tg.join(call_async<int>(pool, []() { return 3; }));
+    tg.join(call_async<int>(pool, []() { return 4; }));
+    ASSERT_EQ(tg.all().withTimeout(pool, 1s).get(), std::vector<int>({3, 4}));
+    std::atomic<bool> released { false };
+    tg.join(call_async<int>(pool, [&released]() {
+        while (!released.load()) {
+            std::this_thread::sleep_for(1ms);
+        }
+        return 5;
+    }));
+    auto bounded = tg.all().withTimeout(pool, 20ms);
+    try {
+        bounded.get();
+        FAIL();
+    } catch (const TimeoutError&) {
+        // pass
+    }
+    released.store(true);
+    try {
+        tg.all().withTimeout(10ms);
+        FAIL();
+    } catch (const std::runtime_error&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(many_pending_timeouts) {
+    // Pending timeouts occupy neither workers nor extra threads
+    ThreadPool pool(1);
+    constexpr int NUM_ITERS = 10'000;
+    std::atomic<bool> released { false };
+    std::vector<AsyncResult<void>> results;
+    for (int iter = 0; iter < NUM_ITERS; ++iter) {
+        results.push_back(AsyncResult<void>::instant().in(pool).then<void>([&released]() {
+            while (!released.load()) {
+                std::this_thread::sleep_for(1ms);
+            }
+        }).withTimeout(std::chrono::milliseconds(10 + iter % 10)));
+    }
+    Timer timer;
+    int num_timeouts = 0;
+    for (auto & result : results) {
+        try {
+            result.get();
+        } catch (const TimeoutError&) {
+            ++num_timeouts;
+        }
+    }
+    ASSERT_EQ(num_timeouts, NUM_ITERS);
+    ASSERT(timer.elapsedMilliseconds() < 500);
+    released.store(true);
+}
+
+
 struct PoolVerifier {
     PoolVerifier(std::atomic<bool> & ok,
                  std::thread::id expected_tid,
@@ -490,14 +596,13 @@ DEFINE_TEST(in_does_transfer) {
 template <size_t num_workers>
 DEFINE_TEST(test_starvation) {
     ThreadPool pool(num_workers);
-    std::unordered_map<std::thread::id, size_t> worker_cnt;
-    std::mutex mtx;
+    // A counter per worker, so votes do not contend
+    WorkerLocal<size_t> worker_cnt(pool);
     constexpr size_t num_iters = 10'000;
 
     AsyncFunction<void()> vote_for_worker = make_async(pool, 
-        [&worker_cnt, &mtx]() mutable {
-            std::lock_guard guard(mtx);
-            ++worker_cnt[std::this_thread::get_id()];
+        [&worker_cnt]() mutable {
+            ++worker_cnt.local();
         });
     std::vector<AsyncResult<void>> task_handles;
     for (size_t iter = 0; iter < num_iters; ++iter) {
@@ -507,7 +612,9 @@ DEFINE_TEST(test_starvation) {
         handle.get();
     }
     ASSERT_EQ(worker_cnt.size(), num_workers);
-    for (const auto & [id, cnt] : worker_cnt) {
+    std::vector<size_t> counts;
+    worker_cnt.forEach([&counts](size_t cnt) { counts.push_back(cnt); });
+    for (size_t cnt : counts) {
         LOG_INFO << cnt << " / " << num_iters;
         ASSERT(cnt >= (num_iters / num_workers) / 3);
     }
@@ -553,6 +660,9 @@ int main() {
     RUN_TEST(catch_error, "Catch an exception")
     RUN_TEST(map_reduce, "Map reduce")
     RUN_TEST(in_does_transfer, "In transfers execution to thread pool");
+    RUN_TEST(wait_for_is_bounded, "wait_for and wait_until are bounded");
+    RUN_TEST(with_timeout, "withTimeout just works");
+    RUN_TEST(many_pending_timeouts, "Many pending timeouts");
     RUN_TEST(test_starvation<2>, "Starvation test with 2 workers")
     RUN_TEST(test_starvation<5>, "Starvation test with 5 workers")
     RUN_TEST(test_then_starvation<2>, "Continuation starvation test with 2 workers")
@@ -0,0 +1,266 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <mutex>
+
+#include <vector>
+#include <algorithm>
+#include <random>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "stop_token.hpp"
+
+using namespace std::chrono_literals;
+
+
+template <class T>
+bool isCancelled(AsyncResult<T>& result) {
+    try {
+        result.get();
+    } catch (const CancelledError&) {
+        return true;
+    } catch (...) {
+    }
+    return false;
+}
+
+
+DEFINE_TEST(submit_after_just_works) {
+    ThreadPool pool(2);
+    Timer timer;
+    auto result = pool.submitAfter(20ms, []() { return 42; });
+    ASSERT_EQ(result.get(), 42);
+    ASSERT(timer.elapsedMilliseconds() >= 20);
+
+    timer.start();
+    auto deadline = ThreadPool::Clock::now() + 20ms;
+    ASSERT(pool.submitAt(deadline, []() { return; }).then<bool>([deadline]() {
+        return ThreadPool::Clock::now() >= deadline;
+    }).get());
+    ASSERT(timer.elapsedMilliseconds() >= 20);
+
+    // Past deadlines expire immediately
+    ASSERT_EQ(pool.submitAt(ThreadPool::Clock::now() - 1s, []() { return 1; }).get(), 1);
+}
+
+
+DEFINE_TEST(deadlines_are_ordered) {
+    ThreadPool pool(1);
+    std::vector<int> delays;
+    for (int idx = 0; idx < 50; ++idx) {
+        delays.push_back(2 * idx);
+    }
+    std::shuffle(delays.begin(), delays.end(), std::mt19937(42));
+
+    std::mutex mtx;
+    std::vector<int> fired;
+    std::vector<AsyncResult<void>> results;
+    auto start = ThreadPool::Clock::now();
+    for (int delay : delays) {
+        results.push_back(pool.submitAt(start + std::chrono::milliseconds(delay), [delay, &mtx, &fired]() {
+            std::lock_guard guard(mtx);
+            fired.push_back(delay);
+        }));
+    }
+    for (auto& result : results) {
+        result.wait();
+    }
+    ASSERT(std::is_sorted(fired.begin(), fired.end()));
+    ASSERT_EQ(fired.size(), delays.size());
+}
+
+
+DEFINE_TEST(distant_deadlines) {
+    ThreadPool pool(2);
+    // These timers are cascaded from the upper levels of the wheel
+    std::vector<int> delays = {300, 700, 1100};
+    std::vector<AsyncResult<double>> results;
+    Timer timer;
+    for (int delay : delays) {
+        results.push_back(pool.submitAfter(std::chrono::milliseconds(delay), [&timer]() {
+            return timer.elapsedMilliseconds();
+        }));
+    }
+    for (size_t idx = 0; idx < delays.size(); ++idx) {
+        double elapsed = results[idx].get();
+        ASSERT(elapsed >= delays[idx]);
+        ASSERT(elapsed < delays[idx] + 50);
+    }
+}
+
+
+DEFINE_TEST(cancelled_timers_are_skipped) {
+    ThreadPool pool(2);
+    StopSource source;
+    std::atomic<int> num_executed { 0 };
+    std::vector<AsyncResult<void>> results;
+    for (int idx = 0; idx < 100; ++idx) {
+        results.push_back(pool.submitAfter(10ms, [&num_executed]() {
+            num_executed.fetch_add(1);
+        }, source.token()));
+    }
+    source.requestStop();
+    for (auto& result : results) {
+        ASSERT(isCancelled(result));
+    }
+    ASSERT_EQ(num_executed.load(), 0);
+}
+
+
+DEFINE_TEST(periodic_just_works) {
+    ThreadPool pool(2);
+    StopSource source;
+    std::atomic<int> num_runs { 0 };
+    auto periodic = pool.schedulePeriodic(10ms, [&num_runs]() { num_runs.fetch_add(1); }, source.token());
+    std::this_thread::sleep_for(105ms);
+    source.requestStop();
+    ASSERT(isCancelled(periodic));
+    int runs = num_runs.load();
+    ASSERT(runs >= 8 && runs <= 10);
+    std::this_thread::sleep_for(30ms);
+    ASSERT_EQ(num_runs.load(), runs);
+
+    // The schedule ends with the first error
+    auto failing = pool.schedulePeriodic(1ms, [&num_runs, runs]() {
+        if (num_runs.fetch_add(1) == runs + 5) {
+            throw std::runtime_error("Oops");
+        }
+    });
+    try {
+        failing.get();
+        FAIL();
+    } catch (const std::runtime_error& err) {
+        ASSERT_EQ(err.what(), std::string("Oops"));
+    }
+    ASSERT_EQ(num_runs.load(), runs + 6);
+}
+
+
+DEFINE_TEST(stopped_pool_cancels_timers) {
+    ThreadPool pool(2);
+    auto distant = pool.submitAfter(1h, []() { return 1; });
+    auto slow = pool.submitAfter(1h, []() { return 1; }).withTimeout(pool, 1h);
+    std::atomic<int> num_runs { 0 };
+    // Keeps rescheduling itself until the pool stops
+    auto periodic = pool.schedulePeriodic(1ms, [&num_runs]() { num_runs.fetch_add(1); });
+    while (num_runs.load() < 5) {
+        std::this_thread::sleep_for(1ms);
+    }
+    pool.stop();
+    ASSERT(isCancelled(distant));
+    ASSERT(isCancelled(slow));
+    ASSERT(isCancelled(periodic));
+
+    // Timers added after the stop are cancelled right away
+    auto late = pool.submitAfter(1ms, []() { return 1; });
+    ASSERT(isCancelled(late));
+}
+
+
+// Cancelled once its flag is set, like a timeout whose result has come first
+struct FlagTask : ITaskBase {
+    FlagTask(const std::atomic<bool>& flag, std::atomic<int>& num_cancels) : flag(flag), num_cancels(num_cancels) {   }
+
+    void run() override {   }
+    bool cancelled() const override { return flag.load(); }
+    void cancel() override { num_cancels.fetch_add(1); }
+
+    const std::atomic<bool>& flag;
+    std::atomic<int>& num_cancels;
+};
+
+DEFINE_TEST(retired_timers_are_purged) {
+    details::TimerWheel wheel;
+    std::atomic<bool> retired { true }, kept { false };
+    std::atomic<int> num_cancels { 0 };
+    auto now = details::TimerWheel::Clock::now();
+    for (int idx = 0; idx < 1000; ++idx) {
+        // Spread over the levels of the wheel, up to 50 minutes
+        auto deadline = now + std::chrono::milliseconds(1 + idx * idx * 3);
+        wheel.add(deadline, std::make_unique<FlagTask>(idx % 10 == 0 ? kept : retired, num_cancels), false);
+    }
+    details::TimerList purged = wheel.purge();
+    int num_purged = 0;
+    while (auto node = purged.pop()) {
+        ASSERT(node->task->cancelled());
+        ++num_purged;
+    }
+    ASSERT_EQ(num_purged, 900);
+    ASSERT_EQ(wheel.size(), 100u);
+    // The rest still expire in order
+    auto expired = wheel.advance(now + 1h);
+    int num_expired = 0;
+    while (auto node = expired.pop()) {
+        ASSERT(!node->task->cancelled());
+        ++num_expired;
+    }
+    ASSERT_EQ(num_expired, 100);
+    ASSERT(wheel.empty());
+
+    // Timeouts, whose results come first, do not pile up in the wheel of the pool
+    ThreadPool pool(1);
+    constexpr int NUM_RESULTS = 10'000;
+    for (int idx = 0; idx < NUM_RESULTS; ++idx) {
+        ASSERT_EQ(AsyncResult<int>::instant(idx).withTimeout(pool, 1h).get(), idx);
+    }
+    // The wheel is purged every 1024 retired timers
+    LOG_INFO << pool.numTimers() << " timers left in the wheel after " << NUM_RESULTS << " timeouts";
+    ASSERT(pool.numTimers() <= 1024);
+    auto slow = pool.submitAfter(100ms, []() { return 1; }).withTimeout(pool, 10ms);
+    try {
+        slow.get();
+        FAIL();
+    } catch (const TimeoutError&) {
+        // pass
+    }
+}
+
+
+DEFINE_TEST(pending_timers_benchmark) {
+    ThreadPool pool(2);
+    constexpr int NUM_TIMERS = 200'000;
+    StopSource source;
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> delay_ms(1'000, 3'600'000);
+    std::vector<AsyncResult<void>> results;
+    results.reserve(NUM_TIMERS);
+
+    Timer timer;
+    for (int idx = 0; idx < NUM_TIMERS; ++idx) {
+        results.push_back(pool.submitAfter(std::chrono::milliseconds(delay_ms(gen)), []() {}, source.token()));
+    }
+    double insert_ms = timer.elapsedMilliseconds();
+    LOG_INFO << std::fixed << std::setprecision(2) << NUM_TIMERS << " pending timers inserted in "
+             << insert_ms << " ms, " << 1e6 * insert_ms / NUM_TIMERS << " ns per timer";
+
+    // The short timers are not delayed by the pending ones
+    timer.start();
+    pool.submitAfter(5ms, []() {}).get();
+    double short_ms = timer.elapsedMilliseconds();
+    LOG_INFO << std::fixed << std::setprecision(2) << "Short timer expired in " << short_ms << " ms";
+    ASSERT(short_ms < 50);
+    source.requestStop();
+}
+
+
+int main() {
+    RUN_TEST(submit_after_just_works, "submitAfter & submitAt just work");
+    RUN_TEST(deadlines_are_ordered, "Timers expire in order of deadlines");
+    RUN_TEST(distant_deadlines, "Distant deadlines");
+    RUN_TEST(cancelled_timers_are_skipped, "Cancelled timers are skipped");
+    RUN_TEST(periodic_just_works, "Periodic task just works");
+    RUN_TEST(stopped_pool_cancels_timers, "Stopped pool cancels its timers");
+    RUN_TEST(retired_timers_are_purged, "Retired timers are purged");
+    RUN_TEST(pending_timers_benchmark, "Many pending timers");
+    COMPLETE();
+}
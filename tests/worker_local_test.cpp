@@ -0,0 +1,225 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+#include <mutex>
+#include <vector>
+
+#include "utils/logger.hpp"
+#include "test_utils/timer.hpp"
+#include "test_utils/tester.hpp"
+#include "test_utils/matrix.hpp"
+#include "test_utils/alloc_counter.hpp"
+
+#include "thread_pool.hpp"
+#include "async_function.hpp"
+#include "parallel_for.hpp"
+#include "worker_local.hpp"
+
+using namespace std::chrono_literals;
+
+
+// As multiplyRowByMtx in MatrixTest: a new vector per call
+ColumnVec<int64_t> multiplyRowByMtx(const RowView<int64_t> lhs, const Matrix<int64_t>& rhs_t) {
+    ColumnVec<int64_t> result(rhs_t.rows());
+    for (int row = 0; row < rhs_t.rows(); ++row) {
+        for (int col = 0; col < rhs_t.cols(); ++col) {
+            result[row] += lhs[col] * rhs_t[row][col];
+        }
+    }
+    return result;
+}
+
+// The same product into a reused buffer
+void multiplyRowByMtxInto(const RowView<int64_t> lhs, const Matrix<int64_t>& rhs_t, std::vector<int64_t>& result) {
+    result.assign(rhs_t.rows(), 0);
+    for (int row = 0; row < rhs_t.rows(); ++row) {
+        for (int col = 0; col < rhs_t.cols(); ++col) {
+            result[row] += lhs[col] * rhs_t[row][col];
+        }
+    }
+}
+
+
+DEFINE_TEST(worker_local_just_works) {
+    ThreadPool pool(4);
+    std::atomic<int> constructed = 0;
+    WorkerLocal<std::vector<int64_t> > seen(pool, [&constructed]() {
+        ++constructed;
+        return std::vector<int64_t>();
+    });
+    // Nothing is constructed until used
+    ASSERT_EQ(seen.size(), 0u);
+
+    constexpr int64_t SIZE = 100'000;
+    parallel_for(pool, 0, SIZE, [&seen](int64_t idx) { seen.local().push_back(idx); });
+    // The workers and the caller at most
+    ASSERT(seen.size() >= 1 && seen.size() <= 5);
+    ASSERT_EQ(static_cast<size_t>(constructed.load()), seen.size());
+    std::vector<int64_t> all;
+    seen.forEach([&all](const std::vector<int64_t>& part) { all.insert(all.end(), part.begin(), part.end()); });
+    std::sort(all.begin(), all.end());
+    std::vector<int64_t> expected(SIZE);
+    std::iota(expected.begin(), expected.end(), 0);
+    ASSERT(all == expected);
+
+    // The same instance for the same thread
+    ASSERT(&seen.local() == &seen.local());
+    auto from_worker = call_async<std::vector<int64_t>*>(pool, [&seen]() { return &seen.local(); }).get();
+    ASSERT(from_worker != &seen.local());
+    ThreadPool single(1);
+    WorkerLocal<int> counter(single);
+    auto first = call_async<int*>(single, [&counter]() { return &counter.local(); }).get();
+    auto second = call_async<int*>(single, [&counter]() { return &counter.local(); }).get();
+    ASSERT(first == second);
+
+    seen.clear();
+    ASSERT_EQ(seen.size(), 0u);
+    ASSERT(seen.local().empty());
+}
+
+
+DEFINE_TEST(nested_fork_join) {
+    // A worker, that waits for a nested loop, runs its parts itself: they get the same instance
+    ThreadPool single(1);
+    WorkerLocal<std::vector<int64_t> > scratch(single);
+    auto shared = call_async<bool>(single, [&scratch, &single]() {
+        std::vector<int64_t>& outer = scratch.local();
+        bool same = true;
+        parallel_for(single, 0, 100, [&](int64_t) { same = same && &scratch.local() == &outer; });
+        return same;
+    });
+    ASSERT(shared.get());
+
+    // So the reference is taken again after the nested loop, not held across it
+    ThreadPool pool(4);
+    constexpr int64_t SIZE = 200;
+    WorkerLocal<std::vector<int64_t> > buffers(pool);
+    Combinable<int64_t> sum(pool);
+    parallel_for(pool, 0, SIZE, [&](int64_t row) {
+        buffers.local().assign(SIZE, row);
+        parallel_for(pool, 0, SIZE, [&](int64_t col) {
+            std::vector<int64_t>& inner = buffers.local();
+            inner.assign(1, col);
+            sum.local() += inner[0];
+        });
+        std::vector<int64_t>& buffer = buffers.local();
+        buffer.assign(SIZE, row);
+        sum.local() += std::accumulate(buffer.begin(), buffer.end(), int64_t(0));
+    });
+    ASSERT_EQ(sum.combine(std::plus<int64_t>()), SIZE * SIZE * (SIZE - 1));
+}
+
+
+DEFINE_TEST(combinable) {
+    ThreadPool pool(4);
+    constexpr int64_t SIZE = 1'000'000;
+    Combinable<int64_t> sum(pool);
+    Combinable<int64_t> max(pool, -1);
+    parallel_for(pool, 0, SIZE, [&](int64_t idx) {
+        sum.local() += idx;
+        max.local() = std::max(max.local(), idx % 1000);
+    });
+    ASSERT_EQ(sum.combine(std::plus<int64_t>()), SIZE * (SIZE - 1) / 2);
+    ASSERT_EQ(max.combine([](int64_t lhs, int64_t rhs) { return std::max(lhs, rhs); }), 999);
+    int64_t each = 0;
+    sum.combineEach([&each](int64_t value) { each += value; });
+    ASSERT_EQ(each, SIZE * (SIZE - 1) / 2);
+
+    // Back to the identity
+    sum.clear();
+    ASSERT_EQ(sum.combine(std::plus<int64_t>()), 0);
+    Combinable<int64_t> product(pool, 1);
+    parallel_for(pool, 1, 16, [&product](int64_t idx) { product.local() *= idx; });
+    ASSERT_EQ(product.combine(std::multiplies<int64_t>()), 1'307'674'368'000);
+}
+
+
+DEFINE_TEST(contention_and_allocations_benchmark) {
+    constexpr int64_t NUM_VOTES = 2'000'000;
+    constexpr int64_t SIZE = 256;
+    std::mt19937 PRG;
+    std::uniform_int_distribution<int64_t> elt_dist(-10, 10);
+    Matrix<int64_t> lhs(SIZE, SIZE), rhs_t(SIZE, SIZE);
+    for (int64_t row = 0; row < SIZE; ++row) {
+        for (int64_t col = 0; col < SIZE; ++col) {
+            lhs[row][col] = elt_dist(PRG);
+            rhs_t[row][col] = elt_dist(PRG);
+        }
+    }
+    Timer timer;
+    for (int num_workers : {1, 4}) {
+        ThreadPool pool(num_workers);
+
+        // Votes of the threads, as test_starvation counts them
+        std::unordered_map<std::thread::id, int64_t> votes;
+        std::mutex mtx;
+        timer.start();
+        parallel_for(pool, 0, NUM_VOTES, [&](int64_t) {
+            std::lock_guard guard(mtx);
+            ++votes[std::this_thread::get_id()];
+        });
+        double mutex_ms = timer.elapsedMilliseconds();
+        std::atomic<int64_t> shared = 0;
+        timer.start();
+        parallel_for(pool, 0, NUM_VOTES, [&shared](int64_t) { shared.fetch_add(1, std::memory_order_relaxed); });
+        double atomic_ms = timer.elapsedMilliseconds();
+        Combinable<int64_t> local_votes(pool);
+        timer.start();
+        parallel_for(pool, 0, NUM_VOTES, [&local_votes](int64_t) { ++local_votes.local(); });
+        double combinable_ms = timer.elapsedMilliseconds();
+        ASSERT_EQ(local_votes.combine(std::plus<int64_t>()), NUM_VOTES);
+        ASSERT_EQ(shared.load(), NUM_VOTES);
+
+        // Row products, checksummed by each task
+        Combinable<int64_t> fresh_sum(pool), scratch_sum(pool);
+        int64_t fresh_allocs = numAllocations();
+        timer.start();
+        parallel_for(pool, 0, SIZE, [&](int64_t row) {
+            ColumnVec<int64_t> product = multiplyRowByMtx(lhs[row], rhs_t);
+            for (int64_t idx = 0; idx < product.size(); ++idx) {
+                fresh_sum.local() += product[idx];
+            }
+        });
+        double fresh_ms = timer.elapsedMilliseconds();
+        fresh_allocs = numAllocations() - fresh_allocs;
+        WorkerLocal<std::vector<int64_t> > scratch(pool);
+        int64_t scratch_allocs = numAllocations();
+        timer.start();
+        parallel_for(pool, 0, SIZE, [&](int64_t row) {
+            std::vector<int64_t>& product = scratch.local();
+            multiplyRowByMtxInto(lhs[row], rhs_t, product);
+            for (int64_t value : product) {
+                scratch_sum.local() += value;
+            }
+        });
+        double scratch_ms = timer.elapsedMilliseconds();
+        scratch_allocs = numAllocations() - scratch_allocs;
+        ASSERT_EQ(fresh_sum.combine(std::plus<int64_t>()), scratch_sum.combine(std::plus<int64_t>()));
+
+        LOG_INFO << std::fixed << std::setprecision(2) << num_workers << " workers, " << NUM_VOTES
+                 << " votes: mutex map " << mutex_ms << " ms, atomic " << atomic_ms << " ms, Combinable "
+                 << combinable_ms << " ms; " << SIZE << " row products: new ColumnVec " << fresh_ms << " ms, "
+                 << fresh_allocs << " allocations, WorkerLocal scratch " << scratch_ms << " ms, "
+                 << scratch_allocs << " allocations";
+    }
+}
+
+
+int main() {
+    RUN_TEST(worker_local_just_works, "WorkerLocal just works");
+    RUN_TEST(nested_fork_join, "Nested fork-join");
+    RUN_TEST(combinable, "Combinable");
+    RUN_TEST(contention_and_allocations_benchmark, "Contention and allocations benchmark");
+    COMPLETE();
+}